@@ -0,0 +1,356 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file arg_stream.c
+ *
+ * This file implements reading arguments that are separated by a delimiter
+ * from a file descriptor, e.g. the output of "find -print0".
+ *
+ * Two buffers are used. When threads are available, a reader thread fills
+ * one buffer while the arguments in the other are handed to the caller.
+ * An argument that straddles two buffers is assembled in a spill buffer,
+ * so the memory used is about three times the buffer size, whatever the
+ * size of the input.
+ */
+
+#if !defined(_MSC_VER)
+// read, poll and the pthreads are POSIX.
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "parse_cmd.h"
+#include "parse_cmd_config.h"
+
+#if defined(HAVE_UNISTD_H)
+#include <unistd.h>
+#endif
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_POLL_H) && defined(HAVE_UNISTD_H)
+#define ARG_STREAM_USE_THREADS
+#include <pthread.h>
+#include <poll.h>
+#endif
+
+/**
+ * \internal
+ * The default size of one buffer.
+ */
+#define ARG_STREAM_DEFAULT_BUFFER (1 << 20)
+
+/**
+ * \internal
+ * A buffer that is filled by the reader and emptied by the parser.
+ */
+typedef struct stream_buffer {
+    char*   data;       ///< The bytes read.
+    size_t  size;       ///< Number of bytes in data.
+    int     full;       ///< Whether the buffer is ready to be parsed.
+    int     eof;        ///< The end of the input is reached after data.
+    int     error;      ///< Reading failed after data.
+} stream_buffer;
+
+/**
+ * \internal
+ * The state shared between the reader and the parser.
+ */
+typedef struct arg_stream {
+    int             fd;         ///< The file descriptor to read from.
+    size_t          capacity;   ///< The capacity of one buffer.
+    stream_buffer   buffers[2]; ///< The buffers that are read alternately.
+    char*           spill;      ///< Assembles an argument that straddles
+                                //   two buffers.
+    size_t          spill_size; ///< Number of bytes in spill.
+#if defined(ARG_STREAM_USE_THREADS)
+    pthread_mutex_t lock;       ///< Protects the state of the buffers.
+    pthread_cond_t  changed;    ///< Signals a change of a buffer state.
+    int             stop;       ///< Tells the reader to stop.
+    int             wake[2];    ///< A pipe that wakes a reader waiting for
+                                //   input when parsing stops early.
+#endif
+} arg_stream;
+
+/*
+ * Fills a buffer with the bytes that are available, up to its capacity.
+ * This doesn't wait for the buffer to fill up, so the arguments read from
+ * a pipe are handed out as soon as they are written.
+ */
+static void
+arg_stream_fill(arg_stream* stream, stream_buffer* buf)
+{
+    for (;;) {
+#if defined(ARG_STREAM_USE_THREADS)
+        ssize_t n;
+        struct pollfd fds[2];
+        fds[0].fd       = stream->fd;
+        fds[0].events   = POLLIN;
+        fds[1].fd       = stream->wake[0];
+        fds[1].events   = POLLIN;
+        if (poll(fds, 2, -1) < 0) {
+            n = -1;
+        }
+        else if (fds[1].revents) {
+            // Parsing stopped, the input isn't needed anymore.
+            buf->size   = 0;
+            buf->eof    = 1;
+            buf->error  = 0;
+            break;
+        }
+        else {
+            n = read(stream->fd, buf->data, stream->capacity);
+        }
+#elif defined(HAVE_UNISTD_H)
+        ssize_t n = read(stream->fd, buf->data, stream->capacity);
+#else
+        long n = -1;
+        errno = EBADF;
+#endif
+        if (n < 0 && errno == EINTR)
+            continue;
+        buf->size   = n > 0 ? (size_t) n : 0;
+        buf->eof    = n == 0;
+        buf->error  = n < 0;
+        break;
+    }
+}
+
+#if defined(ARG_STREAM_USE_THREADS)
+
+/*
+ * The reader thread fills the buffers alternately until the end of the input
+ * or until it is told to stop.
+ */
+static void*
+arg_stream_reader(void* arg)
+{
+    arg_stream* stream = arg;
+    int k = 0;
+    int done = 0;
+
+    while (!done) {
+        stream_buffer* buf = &stream->buffers[k];
+
+        pthread_mutex_lock(&stream->lock);
+        while (buf->full && !stream->stop)
+            pthread_cond_wait(&stream->changed, &stream->lock);
+        done = stream->stop;
+        pthread_mutex_unlock(&stream->lock);
+        if (done)
+            break;
+
+        arg_stream_fill(stream, buf);
+        done = buf->eof || buf->error;
+
+        pthread_mutex_lock(&stream->lock);
+        buf->full = 1;
+        pthread_cond_broadcast(&stream->changed);
+        pthread_mutex_unlock(&stream->lock);
+
+        k = !k;
+    }
+    return NULL;
+}
+
+#endif
+
+/*
+ * Appends bytes to the spill buffer.
+ */
+static int
+arg_stream_spill(arg_stream* stream, const char* data, size_t n)
+{
+    if (stream->spill_size + n > stream->capacity)
+        return OPTION_LIMIT_EXCEEDED;
+    memcpy(stream->spill + stream->spill_size, data, n);
+    stream->spill_size += n;
+    return OPTION_OK;
+}
+
+/*
+ * Hands one argument to the callback. With '\n' as delimiter a '\r' that
+ * ends the argument is removed, so CRLF input gives the same arguments.
+ */
+static int
+arg_stream_emit(
+        char*                       arg,
+        size_t                      length,
+        char                        delimiter,
+        option_argument_callback    callback,
+        void*                       data
+        )
+{
+    if (delimiter == '\n' && length > 0 && arg[length - 1] == '\r')
+        arg[--length] = '\0';
+    return callback(data, arg, length);
+}
+
+/*
+ * Hands the complete arguments in a buffer to the callback. The delimiters
+ * are replaced by '\0' so the arguments can be used as C strings.
+ */
+static int
+arg_stream_parse(
+        arg_stream*                 stream,
+        stream_buffer*              buf,
+        char                        delimiter,
+        option_argument_callback    callback,
+        void*                       data
+        )
+{
+    char* begin = buf->data;
+    char* end   = buf->data + buf->size;
+    int ret;
+
+    while (begin < end) {
+        char* delim = memchr(begin, delimiter, (size_t)(end - begin));
+        if (!delim)
+            return arg_stream_spill(stream, begin, (size_t)(end - begin));
+
+        *delim = '\0';
+        if (stream->spill_size > 0) {
+            // Complete the argument that started in the previous buffer.
+            ret = arg_stream_spill(stream, begin, (size_t)(delim - begin));
+            if (ret)
+                return ret;
+            stream->spill[stream->spill_size] = '\0';
+            ret = arg_stream_emit(
+                    stream->spill, stream->spill_size, delimiter, callback, data
+                    );
+            stream->spill_size = 0;
+        }
+        else {
+            ret = arg_stream_emit(
+                    begin, (size_t)(delim - begin), delimiter, callback, data
+                    );
+        }
+        if (ret)
+            return ret;
+        begin = delim + 1;
+    }
+    return OPTION_OK;
+}
+
+int
+options_stream_arguments(
+        int                         fd,
+        char                        delimiter,
+        size_t                      buffer_size,
+        option_argument_callback    callback,
+        void*                       data
+        )
+{
+    arg_stream stream;
+    int k = 0;
+    int ret = OPTION_OK;
+    int done = 0;
+#if defined(ARG_STREAM_USE_THREADS)
+    pthread_t reader;
+    int started = 0;
+#endif
+
+    if (fd < 0 || !callback)
+        return OPTION_INVALID_ARGUMENT;
+
+    memset(&stream, 0, sizeof(stream));
+    stream.fd       = fd;
+    stream.capacity = buffer_size ? buffer_size : ARG_STREAM_DEFAULT_BUFFER;
+    stream.buffers[0].data  = malloc(stream.capacity);
+    stream.buffers[1].data  = malloc(stream.capacity);
+    stream.spill            = malloc(stream.capacity + 1);
+    if (!stream.buffers[0].data || !stream.buffers[1].data || !stream.spill) {
+        free(stream.buffers[0].data);
+        free(stream.buffers[1].data);
+        free(stream.spill);
+        return OPTION_OUT_OF_MEM;
+    }
+
+#if defined(ARG_STREAM_USE_THREADS)
+    pthread_mutex_init(&stream.lock, NULL);
+    pthread_cond_init(&stream.changed, NULL);
+    if (pipe(stream.wake) != 0) {
+        stream.wake[0] = stream.wake[1] = -1;
+        ret = OPTION_FILE_ERROR;
+    }
+    else if (pthread_create(&reader, NULL, arg_stream_reader, &stream) == 0)
+        started = 1;
+    else
+        ret = OPTION_OUT_OF_MEM;
+#endif
+
+    while (!done && ret == OPTION_OK) {
+        stream_buffer* buf = &stream.buffers[k];
+
+#if defined(ARG_STREAM_USE_THREADS)
+        pthread_mutex_lock(&stream.lock);
+        while (!buf->full)
+            pthread_cond_wait(&stream.changed, &stream.lock);
+        pthread_mutex_unlock(&stream.lock);
+#else
+        arg_stream_fill(&stream, buf);
+#endif
+
+        ret = arg_stream_parse(&stream, buf, delimiter, callback, data);
+        done = buf->eof || buf->error;
+        if (buf->error && ret == OPTION_OK)
+            ret = OPTION_FILE_ERROR;
+
+#if defined(ARG_STREAM_USE_THREADS)
+        pthread_mutex_lock(&stream.lock);
+        buf->full = 0;
+        pthread_cond_broadcast(&stream.changed);
+        pthread_mutex_unlock(&stream.lock);
+#endif
+        k = !k;
+    }
+
+    // The last argument doesn't need a delimiter.
+    if (ret == OPTION_OK && stream.spill_size > 0) {
+        stream.spill[stream.spill_size] = '\0';
+        ret = arg_stream_emit(
+                stream.spill, stream.spill_size, delimiter, callback, data
+                );
+    }
+
+#if defined(ARG_STREAM_USE_THREADS)
+    if (started) {
+        // When parsing stopped early the reader may be waiting for input.
+        pthread_mutex_lock(&stream.lock);
+        stream.stop = 1;
+        pthread_cond_broadcast(&stream.changed);
+        pthread_mutex_unlock(&stream.lock);
+        if (!done && write(stream.wake[1], "", 1) != 1)
+            ret = ret ? ret : OPTION_FILE_ERROR;
+        pthread_join(reader, NULL);
+    }
+    if (stream.wake[0] >= 0) {
+        close(stream.wake[0]);
+        close(stream.wake[1]);
+    }
+    pthread_cond_destroy(&stream.changed);
+    pthread_mutex_destroy(&stream.lock);
+#endif
+
+    free(stream.buffers[0].data);
+    free(stream.buffers[1].data);
+    free(stream.spill);
+    return ret;
+}
@@ -0,0 +1,55 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef ATOMIC_UTILS_H
+#define ATOMIC_UTILS_H
+
+/**
+ * \internal
+ * \file atomic_utils.h
+ *
+ * The few atomic operations the library needs. C99 has no atomics, so
+ * these map to the builtins of GCC and clang or to the Interlocked
+ * functions of Visual Studio. All of them are sequentially consistent.
+ *
+ * atomic_cas_ptr(p, expected, desired) stores desired in *p when *p
+ * equals expected and evaluates to non zero when it did.
+ */
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#define atomic_load_ptr(p)      InterlockedCompareExchangePointer((PVOID*)(p), NULL, NULL)
+#define atomic_exchange_ptr(p, v) InterlockedExchangePointer((PVOID*)(p), (v))
+#define atomic_cas_ptr(p, e, v) \
+    (InterlockedCompareExchangePointer((PVOID*)(p), (v), (e)) == (PVOID)(e))
+#define atomic_load_long(p)     InterlockedCompareExchange((p), 0, 0)
+#define atomic_store_long(p, v) ((void) InterlockedExchange((p), (v)))
+#define atomic_increment(p)     InterlockedIncrement(p)
+#define atomic_decrement(p)     InterlockedDecrement(p)
+#else
+#define atomic_load_ptr(p)      __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define atomic_exchange_ptr(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#define atomic_cas_ptr(p, e, v) \
+    __sync_bool_compare_and_swap((p), (e), (v))
+#define atomic_load_long(p)     __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define atomic_store_long(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define atomic_increment(p)     __atomic_add_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define atomic_decrement(p)     __atomic_sub_fetch((p), 1, __ATOMIC_SEQ_CST)
+#endif
+
+#endif
@@ -0,0 +1,289 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \internal
+ * \file cmd_string.c
+ *
+ * The text between the characters that matter to the quoting rules is
+ * skipped 16 bytes at a time: the bytes are compared with each of those
+ * characters at once and the comparisons are combined into a bit mask of
+ * which the lowest set bit is the next character of interest.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "parse_cmd.h"
+#include "cmd_string.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CMD_STRING_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+static int
+is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+static int
+is_special(char c)
+{
+    return is_blank(c) || c == '\'' || c == '"' || c == '\\';
+}
+
+#if defined(CMD_STRING_USE_SSE2)
+
+/*
+ * Returns the index of the lowest bit set in a non zero mask.
+ */
+static int
+lowest_bit(unsigned mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int i = 0;
+    while (!(mask & 1u)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+#endif
+
+/*
+ * Returns the first blank, quote or backslash in [p, end) or end.
+ */
+static const char*
+scan_unquoted(const char* p, const char* end)
+{
+#if defined(CMD_STRING_USE_SSE2)
+    const __m128i space     = _mm_set1_epi8(' ');
+    const __m128i tab       = _mm_set1_epi8('\t');
+    const __m128i newline   = _mm_set1_epi8('\n');
+    const __m128i single    = _mm_set1_epi8('\'');
+    const __m128i dquote    = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) p);
+        __m128i blanks = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+                _mm_cmpeq_epi8(v, newline)
+                );
+        __m128i quotes = _mm_or_si128(
+                _mm_or_si128(_mm_cmpeq_epi8(v, single),
+                             _mm_cmpeq_epi8(v, dquote)
+                             ),
+                _mm_cmpeq_epi8(v, backslash)
+                );
+        unsigned mask = (unsigned) _mm_movemask_epi8(_mm_or_si128(blanks, quotes));
+        if (mask)
+            return p + lowest_bit(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && !is_special(*p))
+        p++;
+    return p;
+}
+
+/*
+ * Returns the first double quote or backslash in [p, end) or end.
+ */
+static const char*
+scan_double_quoted(const char* p, const char* end)
+{
+#if defined(CMD_STRING_USE_SSE2)
+    const __m128i dquote    = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) p);
+        unsigned mask = (unsigned) _mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(v, dquote),
+                             _mm_cmpeq_epi8(v, backslash)
+                             )
+                );
+        if (mask)
+            return p + lowest_bit(mask);
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '"' && *p != '\\')
+        p++;
+    return p;
+}
+
+/*
+ * Returns the first single quote in [p, end) or end, memchr is vectorized
+ * by the C library.
+ */
+static const char*
+scan_single_quoted(const char* p, const char* end)
+{
+    const char* q = memchr(p, '\'', (size_t)(end - p));
+    return q ? q : end;
+}
+
+/*
+ * Moves the bytes [r, next) to w, returns the new write position.
+ */
+static char*
+move_bytes(char* w, const char* r, const char* next)
+{
+    size_t n = (size_t)(next - r);
+    if (w != r)
+        memmove(w, r, n);
+    return w + n;
+}
+
+static int
+cmd_string_push(cmd_string* split, const char* item)
+{
+    if (split->argc == split->capacity) {
+        int new_cap = split->capacity ? split->capacity * 2 : 16;
+        const char** new_argv = realloc(
+                (void*) split->argv, new_cap * sizeof(const char*)
+                );
+        if (!new_argv)
+            return OPTION_OUT_OF_MEM;
+        split->argv = new_argv;
+        split->capacity = new_cap;
+    }
+    split->argv[split->argc++] = item;
+    return OPTION_OK;
+}
+
+int
+cmd_string_split(
+        cmd_string* split,
+        const char* prog_name,
+        char*       str,
+        size_t*     offset
+        )
+{
+    const char* end = str + strlen(str);
+    const char* r   = str;
+    char*       w   = str;
+
+    if (cmd_string_push(split, prog_name))
+        return OPTION_OUT_OF_MEM;
+
+    for (;;) {
+        char* item;
+        int quoted = 0;
+
+        while (r < end && is_blank(*r))
+            r++;
+        if (r >= end)
+            break;
+
+        item = w;
+        for (;;) {
+            const char* next = scan_unquoted(r, end);
+            w = move_bytes(w, r, next);
+            r = next;
+            if (r >= end || is_blank(*r))
+                break;
+
+            if (*r == '\'') {
+                const char* open = r++;
+                next = scan_single_quoted(r, end);
+                if (next >= end) {
+                    *offset = (size_t)(open - str);
+                    return OPTION_PARSE_ERROR;
+                }
+                w = move_bytes(w, r, next);
+                r = next + 1;
+                quoted = 1;
+            }
+            else if (*r == '"') {
+                const char* open = r++;
+                for (;;) {
+                    next = scan_double_quoted(r, end);
+                    w = move_bytes(w, r, next);
+                    r = next;
+                    if (r + 1 >= end) {
+                        // end of input, or a backslash or quote at the end
+                        if (r < end && *r == '"') {
+                            r++;
+                            break;
+                        }
+                        *offset = (size_t)(open - str);
+                        return OPTION_PARSE_ERROR;
+                    }
+                    if (*r == '"') {
+                        r++;
+                        break;
+                    }
+                    // A backslash, only a few characters are escaped.
+                    if (r[1] == '\n') {
+                        r += 2;
+                    }
+                    else if (r[1] == '$' || r[1] == '`' || r[1] == '"' ||
+                             r[1] == '\\') {
+                        *w++ = r[1];
+                        r += 2;
+                    }
+                    else {
+                        *w++ = *r++;
+                    }
+                }
+                quoted = 1;
+            }
+            else {
+                // A backslash escapes any character.
+                if (r + 1 >= end) {
+                    *offset = (size_t)(r - str);
+                    return OPTION_PARSE_ERROR;
+                }
+                if (r[1] != '\n')
+                    *w++ = r[1];
+                r += 2;
+            }
+        }
+
+        // A line continuation alone isn't an item, '' is.
+        if (w == item && !quoted)
+            continue;
+
+        // r points at a blank or at the terminating '\0', w never passes r.
+        if (r < end)
+            r++;
+        *w++ = '\0';
+        if (cmd_string_push(split, item))
+            return OPTION_OUT_OF_MEM;
+    }
+    return OPTION_OK;
+}
+
+void
+cmd_string_free(cmd_string* split)
+{
+    if (!split)
+        return;
+    free((void*) split->argv);
+    memset(split, 0, sizeof(cmd_string));
+}
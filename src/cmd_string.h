@@ -0,0 +1,79 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef CMD_STRING_H
+#define CMD_STRING_H
+
+#include <stddef.h>
+
+/**
+ * \internal
+ * \file cmd_string.h
+ *
+ * Splits a command line given as one string into items with the quoting
+ * rules of a POSIX shell. The string is unquoted in place, the items point
+ * into it.
+ *
+ * Items are separated by spaces, tabs and newlines. Text between single
+ * quotes is taken literally. Between double quotes a backslash only
+ * escapes '$', '`', '"', '\\' and a newline, outside of quotes it escapes
+ * any character. A backslash followed by a newline is removed. There are
+ * no expansions, '$' and '`' are ordinary characters.
+ */
+
+/**
+ * \internal
+ * The items of a split command line.
+ */
+typedef struct cmd_string {
+    const char**    argv;       ///< The items, argv[0] is the program name.
+    int             argc;       ///< Number of items in argv.
+    int             capacity;   ///< Capacity of argv.
+} cmd_string;
+
+/**
+ * \internal
+ * \brief Splits a command line in place.
+ *
+ * @param [out] split     The items, it should be zero initialized. It
+ *                        should be freed with cmd_string_free() even when
+ *                        this function fails.
+ * @param [in]  prog_name Is stored as the first item.
+ * @param [in,out] str    The command line, it is modified.
+ * @param [out] offset    The offset in str of an unterminated quote or
+ *                        of a trailing backslash.
+ *
+ * \returns OPTION_OK, OPTION_PARSE_ERROR when a quote isn't terminated or
+ *          the string ends with a backslash or OPTION_OUT_OF_MEM.
+ */
+int
+cmd_string_split(
+        cmd_string* split,
+        const char* prog_name,
+        char*       str,
+        size_t*     offset
+        );
+
+/**
+ * \internal
+ * \brief Frees the items, not the string they point into.
+ */
+void
+cmd_string_free(cmd_string* split);
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file config_file.c
+ *
+ * This file implements setting options from a configuration file. The file
+ * is mapped into memory and the values are terminated in place, so the
+ * string values of the options point into the mapping. The mapping belongs
+ * to the option_context.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "parse_cmd.h"
+#include "parse_cmd_private.h"
+#include "file_map.h"
+
+/**
+ * \internal
+ * The maximum length of "section.key".
+ */
+#define CONFIG_MAX_NAME 256
+
+static int
+is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static char*
+trim_end(char* begin, char* end)
+{
+    while (end > begin && is_space(end[-1]))
+        end--;
+    return end;
+}
+
+static int
+config_report(
+        const option_context*           options,
+        const option_parse_settings*    settings,
+        int                             error,
+        size_t                          offset,
+        int                             position
+        )
+{
+    option_diagnostic diag = {error, -1, (int) offset, position};
+    options_report(settings, &diag, NULL, options->predef_options);
+    return error;
+}
+
+/*
+ * Parses the lines of a configuration file and sets the options.
+ */
+static int
+config_parse(
+        option_context*                 options,
+        char*                           data,
+        size_t                          size,
+        const option_parse_settings*    settings
+        )
+{
+    char* const end = data + size;
+    char* line      = data;
+    char name[CONFIG_MAX_NAME];
+    size_t section_length = 0;
+
+    while (line < end) {
+        char* eol   = memchr(line, '\n', (size_t)(end - line));
+        char* p     = line;
+        char* stop;
+        char* eq;
+        char* value;
+        const char* key;
+        size_t key_length;
+        int position, ret;
+
+        if (!eol)
+            eol = end;
+        line = eol < end ? eol + 1 : end;
+
+        while (p < eol && is_space(*p))
+            p++;
+        stop = trim_end(p, eol);
+        if (p == stop || *p == '#' || *p == ';')
+            continue;
+
+        if (*p == '[') {
+            // A section prefixes the keys that follow: [net] port = 80
+            // sets "net.port".
+            if (stop[-1] != ']' || stop - p < 2)
+                return config_report(
+                        options, settings, OPTION_PARSE_ERROR, p - data, -1
+                        );
+            p++;
+            stop = trim_end(p, stop - 1);
+            while (p < stop && is_space(*p))
+                p++;
+            section_length = (size_t)(stop - p);
+            if (section_length + 1 >= CONFIG_MAX_NAME)
+                return config_report(
+                        options, settings, OPTION_LIMIT_EXCEEDED, p - data, -1
+                        );
+            memcpy(name, p, section_length);
+            if (section_length)
+                name[section_length++] = '.';
+            continue;
+        }
+
+        eq = memchr(p, '=', (size_t)(stop - p));
+        if (!eq || trim_end(p, eq) == p)
+            return config_report(
+                    options, settings, OPTION_PARSE_ERROR, p - data, -1
+                    );
+        key_length = (size_t)(trim_end(p, eq) - p);
+
+        value = eq + 1;
+        while (value < stop && is_space(*value))
+            value++;
+        if (stop - value >= 2 && *value == '"' && stop[-1] == '"') {
+            value++;
+            stop--;
+        }
+        // stop is at most eol, which is a '\n' or the terminating '\0'.
+        *stop = '\0';
+
+        if (section_length) {
+            if (section_length + key_length > CONFIG_MAX_NAME)
+                return config_report(
+                        options, settings, OPTION_LIMIT_EXCEEDED, p - data, -1
+                        );
+            memcpy(name + section_length, p, key_length);
+            key = name;
+            key_length += section_length;
+        }
+        else {
+            key = p;
+        }
+
+        position = option_index_find(options->index, key, key_length);
+        if (position < 0)
+            return config_report(
+                    options, settings, OPTION_UNKNOWN, p - data, -1
+                    );
+        ret = options_merge_option(options, position, value, OPTION_SOURCE_FILE);
+        if (ret)
+            return config_report(
+                    options, settings, ret, value - data, position
+                    );
+    }
+    return OPTION_OK;
+}
+
+int
+options_load_config(
+        option_context*                 options,
+        const char*                     path,
+        const option_parse_settings*    settings,
+        int                             map_flags
+        )
+{
+    file_map map;
+    int ret;
+
+    if (!options || !path)
+        return OPTION_INVALID_ARGUMENT;
+
+    if (options->n_configs == options->configs_capacity) {
+        int new_cap = options->configs_capacity ? options->configs_capacity * 2 : 2;
+        file_map* new_configs = realloc(
+                options->configs, new_cap * sizeof(file_map)
+                );
+        if (!new_configs)
+            return OPTION_OUT_OF_MEM;
+        options->configs = new_configs;
+        options->configs_capacity = new_cap;
+    }
+
+    ret = file_map_open(
+            &map,
+            path,
+            FILE_MAP_WRITABLE | FILE_MAP_TERMINATED | map_flags
+            );
+    if (ret) {
+        option_diagnostic diag = {ret, -1, 0, -1};
+        options_report(settings, &diag, NULL, NULL);
+        return ret;
+    }
+    // The values point into the mapping, so keep it even when parsing fails.
+    options->configs[options->n_configs++] = map;
+
+    return config_parse(options, map.data, map.size, settings);
+}
+
+int
+option_context_load_config(
+        option_context*                 options,
+        const char*                     path,
+        const option_parse_settings*    settings
+        )
+{
+    return options_load_config(options, path, settings, FILE_MAP_SEQUENTIAL);
+}
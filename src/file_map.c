@@ -0,0 +1,214 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \internal
+ * \file file_map.c
+ */
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#else
+// mmap, fstat and friends are POSIX.
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "parse_cmd.h"
+#include "parse_cmd_config.h"
+#include "file_map.h"
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && \
+    defined(HAVE_SYS_STAT_H) && defined(HAVE_FCNTL_H) && defined(HAVE_UNISTD_H)
+#define FILE_MAP_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+#if defined(FILE_MAP_USE_MMAP)
+
+int
+file_map_open(file_map* map, const char* path, int flags)
+{
+    struct stat st;
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    int prot    = PROT_READ;
+    int fd;
+    char* data;
+
+    memset(map, 0, sizeof(file_map));
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return OPTION_FILE_ERROR;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return OPTION_FILE_ERROR;
+    }
+
+    map->size   = (size_t) st.st_size;
+    map->device = (unsigned long long) st.st_dev;
+    map->inode  = (unsigned long long) st.st_ino;
+    map->length = map->size;
+
+    if (flags & FILE_MAP_WRITABLE)
+        prot |= PROT_WRITE;
+
+    if (flags & FILE_MAP_COPY) {
+        // Always terminated, the file may shrink or grow while it is read.
+        size_t n = 0;
+        map->length = (map->size / page + 1) * page;
+        data = mmap(NULL, map->length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return OPTION_OUT_OF_MEM;
+        }
+        while (n < map->size) {
+            ssize_t r = read(fd, data + n, map->size - n);
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r < 0) {
+                munmap(data, map->length);
+                close(fd);
+                return OPTION_FILE_ERROR;
+            }
+            if (r == 0)
+                break;
+            n += (size_t) r;
+        }
+        map->size = n;
+        if (!(flags & FILE_MAP_WRITABLE))
+            mprotect(data, map->length, PROT_READ);
+        close(fd);
+        map->data = data;
+        return OPTION_OK;
+    }
+
+    if (flags & FILE_MAP_TERMINATED) {
+        // Reserve room for a terminating '\0' and map the file over the
+        // reservation, the bytes after the end of the file read as zero.
+        map->length = (map->size / page + 1) * page;
+        data = mmap(NULL, map->length, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return OPTION_OUT_OF_MEM;
+        }
+        if (map->size > 0 &&
+            mmap(data, map->size, prot, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+                MAP_FAILED) {
+            munmap(data, map->length);
+            close(fd);
+            return OPTION_FILE_ERROR;
+        }
+    }
+    else if (map->size == 0) {
+        // mmap refuses empty mappings.
+        static char empty[1];
+        close(fd);
+        map->data = empty;
+        return OPTION_OK;
+    }
+    else {
+        data = mmap(NULL, map->size, prot, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return OPTION_FILE_ERROR;
+        }
+    }
+    close(fd);
+
+#if defined(MADV_SEQUENTIAL)
+    if (flags & FILE_MAP_SEQUENTIAL)
+        madvise(data, map->length, MADV_SEQUENTIAL);
+#endif
+
+    map->data = data;
+    return OPTION_OK;
+}
+
+void
+file_map_close(file_map* map)
+{
+    if (map && map->data && map->length > 0)
+        munmap(map->data, map->length);
+    if (map)
+        map->data = NULL;
+}
+
+#else
+
+int
+file_map_open(file_map* map, const char* path, int flags)
+{
+    FILE* file;
+    long size;
+
+    (void) flags;
+    memset(map, 0, sizeof(file_map));
+
+    file = fopen(path, "rb");
+    if (!file)
+        return OPTION_FILE_ERROR;
+
+    if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 ||
+        fseek(file, 0, SEEK_SET) != 0) {
+        fclose(file);
+        return OPTION_FILE_ERROR;
+    }
+
+    // Always terminate and keep the buffer writable.
+    map->data = malloc((size_t) size + 1);
+    if (!map->data) {
+        fclose(file);
+        return OPTION_OUT_OF_MEM;
+    }
+    if (fread(map->data, 1, (size_t) size, file) != (size_t) size) {
+        free(map->data);
+        map->data = NULL;
+        fclose(file);
+        return OPTION_FILE_ERROR;
+    }
+    fclose(file);
+
+    map->data[size] = '\0';
+    map->size       = (size_t) size;
+    map->length     = (size_t) size + 1;
+    return OPTION_OK;
+}
+
+void
+file_map_close(file_map* map)
+{
+    if (map) {
+        free(map->data);
+        map->data = NULL;
+    }
+}
+
+#endif
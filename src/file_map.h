@@ -0,0 +1,94 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef FILE_MAP_H
+#define FILE_MAP_H
+
+#include <stddef.h>
+
+/**
+ * \internal
+ * \file file_map.h
+ *
+ * Maps files into memory. When mmap is available the file is mapped,
+ * otherwise it is read into a buffer; the users don't need to know.
+ */
+
+/**
+ * \internal
+ * Flags for file_map_open().
+ */
+enum FILE_MAP_FLAGS {
+    /**
+     * The mapping may be modified, the modifications are private to the
+     * process and never reach the file. Pages are only copied by the
+     * kernel when they are written to.
+     */
+    FILE_MAP_WRITABLE   = 1 << 0,
+    /**
+     * There is a '\0' byte directly after the contents of the file, so the
+     * contents can be used as a C string.
+     */
+    FILE_MAP_TERMINATED = 1 << 1,
+    /**
+     * The file will be read from front to back.
+     */
+    FILE_MAP_SEQUENTIAL = 1 << 2,
+    /**
+     * The contents are read into anonymous memory instead of being mapped.
+     * Use this for files that may be truncated while they are in use: the
+     * kernel takes the truncated pages away from private mappings too, and
+     * an access to them raises SIGBUS.
+     */
+    FILE_MAP_COPY       = 1 << 3
+};
+
+/**
+ * \internal
+ * A file mapped into memory.
+ */
+typedef struct file_map {
+    char*               data;       ///< The contents of the file.
+    size_t              size;       ///< The size of the file in bytes.
+    size_t              length;     ///< The number of bytes mapped.
+    unsigned long long  device;     ///< Identifies the file system or 0.
+    unsigned long long  inode;      ///< Identifies the file or 0.
+} file_map;
+
+/**
+ * \internal
+ * \brief Maps a file into memory.
+ *
+ * @param [out] map   The mapping.
+ * @param [in]  path  The file to map.
+ * @param [in]  flags A combination of FILE_MAP_FLAGS.
+ *
+ * \returns OPTION_OK, OPTION_FILE_ERROR when the file can't be opened or
+ *          mapped or OPTION_OUT_OF_MEM.
+ */
+int
+file_map_open(file_map* map, const char* path, int flags);
+
+/**
+ * \internal
+ * \brief Removes the mapping of a file.
+ */
+void
+file_map_close(file_map* map);
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file file_value.c
+ *
+ * This file implements the values of OPT_FILE options. Parsing only
+ * remembers the "@path", the file is mapped when the value is asked for.
+ * The accessor takes a const option_context that may be shared between
+ * threads, e.g. a snapshot of an option_reloader, so the mappings are
+ * published with compare and swap; a thread that loses the race unmaps
+ * its own mapping and uses the one that won.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "parse_cmd.h"
+#include "parse_cmd_private.h"
+#include "atomic_utils.h"
+#include "file_map.h"
+
+/*
+ * Returns the mapping of the file of a predefined option, maps it when
+ * this is the first access.
+ */
+static int
+file_value_map(
+        const option_context*   context,
+        int                     position,
+        const char*             path,
+        const file_map**        out
+        )
+{
+    // The cache is part of the logical state of the context, the value
+    // itself doesn't change by mapping it.
+    file_map*** slots = (file_map***) &context->file_values;
+    file_map** values = atomic_load_ptr(slots);
+    file_map* map;
+    int ret;
+
+    if (!values) {
+        file_map** fresh = calloc(
+                (size_t) context->n_predef_options, sizeof(file_map*)
+                );
+        if (!fresh)
+            return OPTION_OUT_OF_MEM;
+        if (!atomic_cas_ptr(slots, (file_map**) NULL, fresh))
+            free(fresh);
+        values = atomic_load_ptr(slots);
+    }
+
+    map = atomic_load_ptr(&values[position]);
+    if (!map) {
+        file_map* fresh = malloc(sizeof(file_map));
+        if (!fresh)
+            return OPTION_OUT_OF_MEM;
+        ret = file_map_open(fresh, path, 0);
+        if (ret) {
+            free(fresh);
+            return ret;
+        }
+        if (!atomic_cas_ptr(&values[position], (file_map*) NULL, fresh)) {
+            file_map_close(fresh);
+            free(fresh);
+        }
+        map = atomic_load_ptr(&values[position]);
+    }
+    *out = map;
+    return OPTION_OK;
+}
+
+int
+option_context_file_value(
+        const option_context*   context,
+        const char*             name,
+        const void**            data,
+        size_t*                 size
+        )
+{
+    cmd_option* option;
+    const char* value;
+    assert(context && name && data && size);
+
+    if (!context || !name || !data || !size)
+        return OPTION_INVALID_ARGUMENT;
+
+    option = option_context_find_option(context, name);
+
+    if (!option)
+        return OPTION_NOT_SPECIFIED;
+    if (option->option_type != OPT_FILE)
+        return OPTION_WRONG_OPTION_TYPE;
+
+    value = option->value.string_value;
+    if (value[0] == '@' && value[1] != '@') {
+        const file_map* map;
+        int ret = file_value_map(
+                context,
+                (int) (option - context->predef_options),
+                value + 1,
+                &map
+                );
+        if (ret)
+            return ret;
+        *data = map->data;
+        *size = map->size;
+        return OPTION_OK;
+    }
+
+    // "@@text" escapes a literal text that starts with '@'.
+    if (value[0] == '@')
+        value++;
+    *data = value;
+    *size = strlen(value);
+    return OPTION_OK;
+}
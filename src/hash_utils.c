@@ -0,0 +1,189 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \internal
+ * \file hash_utils.c
+ */
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#else
+// open, read and the pthreads are POSIX.
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "hash_utils.h"
+#include "parse_cmd_config.h"
+
+#if defined(HAVE_UNISTD_H) && defined(HAVE_FCNTL_H)
+#define HASH_USE_OPEN
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#if defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#endif
+
+#define ROTL64(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+#define SIPROUND                                                        \
+    do {                                                                \
+        v0 += v1; v1 = ROTL64(v1, 13); v1 ^= v0; v0 = ROTL64(v0, 32);  \
+        v2 += v3; v3 = ROTL64(v3, 16); v3 ^= v2;                       \
+        v0 += v3; v3 = ROTL64(v3, 21); v3 ^= v0;                       \
+        v2 += v1; v1 = ROTL64(v1, 17); v1 ^= v2; v2 = ROTL64(v2, 32);  \
+    } while (0)
+
+/*
+ * Reads 8 bytes as a little endian number, independent of the alignment
+ * and the endianness of the host.
+ */
+static uint64_t
+read_le64(const unsigned char* p)
+{
+    return  ((uint64_t)p[0])       | ((uint64_t)p[1] << 8)  |
+            ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+            ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) |
+            ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+uint64_t
+siphash24(const void* data, size_t len, const uint64_t key[2])
+{
+    const unsigned char* in  = data;
+    const unsigned char* end = in + (len - (len % 8));
+    uint64_t v0 = UINT64_C(0x736f6d6570736575) ^ key[0];
+    uint64_t v1 = UINT64_C(0x646f72616e646f6d) ^ key[1];
+    uint64_t v2 = UINT64_C(0x6c7967656e657261) ^ key[0];
+    uint64_t v3 = UINT64_C(0x7465646279746573) ^ key[1];
+    uint64_t b  = ((uint64_t)len) << 56;
+    uint64_t m;
+
+    for (; in != end; in += 8) {
+        m = read_le64(in);
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+    switch (len & 7) {
+        case 7: b |= ((uint64_t)in[6]) << 48; /* fall through */
+        case 6: b |= ((uint64_t)in[5]) << 40; /* fall through */
+        case 5: b |= ((uint64_t)in[4]) << 32; /* fall through */
+        case 4: b |= ((uint64_t)in[3]) << 24; /* fall through */
+        case 3: b |= ((uint64_t)in[2]) << 16; /* fall through */
+        case 2: b |= ((uint64_t)in[1]) << 8;  /* fall through */
+        case 1: b |= ((uint64_t)in[0]);
+        default:
+            break;
+    }
+
+    v3 ^= b;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= b;
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * \internal
+ * The key of this process, it is initialized once.
+ */
+static uint64_t process_key[2];
+
+/*
+ * Reads the seed from /dev/urandom, the descriptor isn't inherited by
+ * programs that are started meanwhile.
+ */
+static int
+hash_read_urandom(uint64_t seed[2])
+{
+#if defined(HASH_USE_OPEN)
+    size_t n = 0;
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return 0;
+    while (n < 2 * sizeof(uint64_t)) {
+        ssize_t r = read(fd, (char*) seed + n, 2 * sizeof(uint64_t) - n);
+        if (r <= 0)
+            break;
+        n += (size_t) r;
+    }
+    close(fd);
+    return n == 2 * sizeof(uint64_t);
+#else
+    size_t nread = 0;
+    FILE* random = fopen("/dev/urandom", "rb");
+
+    if (random) {
+        nread = fread(seed, 2 * sizeof(uint64_t), 1, random);
+        fclose(random);
+    }
+    return nread == 1;
+#endif
+}
+
+static void
+hash_init_key(void)
+{
+    uint64_t seed[2] = {0, 0};
+
+    if (!hash_read_urandom(seed)) {
+        // No random source, mix in whatever differs between runs.
+        uint64_t fallback[2];
+        seed[0] = seed[1] = 0;
+        fallback[0] = (uint64_t) time(NULL);
+        fallback[1] = (uint64_t) clock() ^ (uint64_t)(size_t) &fallback;
+        seed[0] = siphash24(fallback, sizeof(fallback), seed);
+        seed[1] = siphash24(&seed[0], sizeof(seed[0]), fallback);
+    }
+    process_key[0] = seed[0];
+    process_key[1] = seed[1];
+}
+
+void
+hash_random_key(uint64_t key[2])
+{
+#if defined(HAVE_PTHREAD_H)
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, hash_init_key);
+#else
+    static int have_key = 0;
+    if (!have_key) {
+        hash_init_key();
+        have_key = 1;
+    }
+#endif
+
+    key[0] = process_key[0];
+    key[1] = process_key[1];
+}
@@ -0,0 +1,58 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef HASH_UTILS_H
+#define HASH_UTILS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \internal
+ * \file hash_utils.h
+ *
+ * Keyed hashing used by the option indices. The hash is SipHash-2-4, so
+ * as long as the key stays secret, option names chosen by a third party
+ * (e.g. a plugin) can't be crafted to collide.
+ */
+
+/**
+ * \internal
+ * \brief Computes the SipHash-2-4 of a piece of memory.
+ *
+ * @param [in] data The bytes to hash.
+ * @param [in] len  The number of bytes to hash.
+ * @param [in] key  The 128 bit key of the hash.
+ *
+ * \returns the 64 bit hash value.
+ */
+uint64_t
+siphash24(const void* data, size_t len, const uint64_t key[2]);
+
+/**
+ * \internal
+ * \brief Obtains a random key for siphash24().
+ *
+ * The key is read once per process from the systems random source, when
+ * that isn't available it is derived from the time and the address space
+ * layout.
+ */
+void
+hash_random_key(uint64_t key[2]);
+
+#endif
@@ -0,0 +1,570 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file option_blob.c
+ *
+ * This file implements the serialized form of an option_context. A blob
+ * consists of a header, a table of the predefined options, the offsets of
+ * the arguments, a hash table of the long names and the strings. Every
+ * reference is an offset from the start of the blob, so the blob can be
+ * used at any address: in a shared mapping, a memfd or a pipe buffer.
+ *
+ * Reading a blob never writes to it, so after fork() the pages of a blob
+ * stay shared between the processes.
+ */
+
+#if !defined(_MSC_VER)
+// memfd_create, fcntl and the seals are Linux extensions.
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "parse_cmd.h"
+#include "parse_cmd_config.h"
+#include "parse_cmd_private.h"
+#include "hash_utils.h"
+
+#if defined(HAVE_UNISTD_H)
+#include <unistd.h>
+#endif
+
+#if defined(HAVE_MEMFD_CREATE)
+#include <sys/mman.h>
+#endif
+
+#if defined(HAVE_FCNTL_H)
+#include <fcntl.h>
+#endif
+
+/**
+ * \internal
+ * "PCMB" identifies a blob.
+ */
+#define BLOB_MAGIC 0x424d4350u
+
+/**
+ * \internal
+ * Increment when the layout changes.
+ */
+#define BLOB_VERSION 1u
+
+/**
+ * \internal
+ * The start of a blob.
+ */
+struct option_blob {
+    uint32_t    magic;          ///< BLOB_MAGIC.
+    uint32_t    version;        ///< BLOB_VERSION.
+    uint64_t    size;           ///< The size of the blob in bytes.
+    uint64_t    key[2];         ///< The key of the hash of the names.
+    uint32_t    program_name;   ///< Offset of the name of the program.
+    uint32_t    n_options;      ///< The number of predefined options.
+    uint32_t    options;        ///< Offset of the blob_option table.
+    uint32_t    n_args;         ///< The number of arguments.
+    uint32_t    args;           ///< Offset of the argument offsets.
+    uint32_t    index_capacity; ///< Slots in the hash table, a power of 2.
+    uint32_t    index;          ///< Offset of the blob_slot table.
+    uint32_t    strings;        ///< Offset of the strings.
+    uint32_t    strings_size;   ///< Bytes in the strings.
+};
+
+/**
+ * \internal
+ * A predefined option in a blob.
+ */
+typedef struct blob_option {
+    double      floating_value; ///< The value of an OPT_FLOAT.
+    int32_t     integer_value;  ///< The value of an OPT_INT or OPT_FLAG.
+    uint32_t    string_value;   ///< Offset of the value or 0 for NULL.
+    uint32_t    long_opt;       ///< Offset of the long name.
+    uint32_t    long_length;    ///< The length of the long name.
+    int32_t     option_type;    ///< The OPTION_VALUE_TYPES of the option.
+    uint8_t     short_opt;      ///< The short name or '\0'.
+    uint8_t     specified;      ///< Whether the option was specified.
+    uint8_t     padding[2];     ///< Always zero.
+} blob_option;
+
+/**
+ * \internal
+ * A slot of the hash table of the long names.
+ */
+typedef struct blob_slot {
+    uint32_t    position;       ///< Position of the option + 1, 0 if empty.
+    uint32_t    hash;           ///< The low bits of the hash of the name.
+} blob_slot;
+
+/**
+ * \internal
+ * Appends the strings of a blob, counts the size first when data is NULL.
+ */
+typedef struct blob_strings {
+    char*       data;           ///< Where the strings go or NULL.
+    size_t      base;           ///< Offset of the strings in the blob.
+    size_t      size;           ///< The bytes used so far.
+} blob_strings;
+
+static uint32_t
+blob_add_string(blob_strings* strings, const char* str)
+{
+    size_t offset, length;
+
+    if (!str)
+        return 0;
+    length = strlen(str) + 1;
+    offset = strings->base + strings->size;
+    if (strings->data)
+        memcpy(strings->data + strings->size, str, length);
+    strings->size += length;
+    // Only written when the blob fits in 32 bit offsets.
+    return (uint32_t) offset;
+}
+
+static size_t
+blob_align(size_t n)
+{
+    return (n + 7) & ~(size_t) 7;
+}
+
+static uint32_t
+blob_index_capacity(int n_options)
+{
+    uint32_t capacity = 8;
+    while (capacity < (uint32_t) n_options * 2)
+        capacity *= 2;
+    return capacity;
+}
+
+/*
+ * Lays out a blob, writes it when out isn't NULL.
+ *
+ * \returns the size of the blob.
+ */
+static size_t
+blob_write(const option_context* options, char* out, const uint64_t key[2])
+{
+    struct option_blob header;
+    blob_option* table = NULL;
+    uint32_t* args = NULL;
+    blob_slot* slots = NULL;
+    blob_strings strings;
+    size_t options_offset, args_offset, index_offset, strings_offset;
+    uint32_t capacity, mask;
+    int i;
+
+    capacity        = blob_index_capacity(options->n_predef_options);
+    options_offset  = blob_align(sizeof(header));
+    args_offset     = options_offset +
+                      (size_t) options->n_predef_options * sizeof(blob_option);
+    index_offset    = blob_align(
+            args_offset + (size_t) options->n_args * sizeof(uint32_t)
+            );
+    strings_offset  = index_offset + (size_t) capacity * sizeof(blob_slot);
+
+    if (out) {
+        table   = (blob_option*) (out + options_offset);
+        args    = (uint32_t*) (out + args_offset);
+        slots   = (blob_slot*) (out + index_offset);
+        memset(out, 0, strings_offset);
+    }
+    strings.data = out ? out + strings_offset : NULL;
+    strings.base = strings_offset;
+    strings.size = 0;
+
+    memset(&header, 0, sizeof(header));
+    header.magic            = BLOB_MAGIC;
+    header.version          = BLOB_VERSION;
+    header.key[0]           = key[0];
+    header.key[1]           = key[1];
+    header.n_options        = (uint32_t) options->n_predef_options;
+    header.n_args           = (uint32_t) options->n_args;
+    header.index_capacity   = capacity;
+    header.options          = (uint32_t) options_offset;
+    header.args             = (uint32_t) args_offset;
+    header.index            = (uint32_t) index_offset;
+    header.strings          = (uint32_t) strings_offset;
+    header.program_name     = blob_add_string(
+            &strings, options->program_name ? options->program_name : ""
+            );
+
+    mask = capacity - 1;
+    for (i = 0; i < options->n_predef_options; i++) {
+        const cmd_option* option = &options->predef_options[i];
+        uint32_t name = blob_add_string(&strings, option->long_opt);
+        uint32_t value = 0;
+        uint64_t hash;
+        uint32_t slot;
+
+        if (option->option_type == OPT_STR || option->option_type == OPT_FILE)
+            value = blob_add_string(&strings, option->value.string_value);
+        if (!out)
+            continue;
+
+        table[i].long_opt       = name;
+        table[i].long_length    = (uint32_t) strlen(option->long_opt);
+        table[i].option_type    = option->option_type;
+        table[i].short_opt      = (uint8_t) option->short_opt;
+        table[i].string_value   = value;
+        if (option->option_type == OPT_FLOAT)
+            table[i].floating_value = option->value.floating_value;
+        else if (option->option_type == OPT_INT ||
+                 option->option_type == OPT_FLAG)
+            table[i].integer_value = option->value.integer_value;
+
+        hash = siphash24(option->long_opt, table[i].long_length, key);
+        for (slot = (uint32_t) hash & mask;
+             slots[slot].position;
+             slot = (slot + 1) & mask)
+            ;
+        slots[slot].position    = (uint32_t) i + 1;
+        slots[slot].hash        = (uint32_t) hash;
+    }
+    for (i = 0; i < options->n_options && out; i++) {
+        int position = (int) (options->options[i] - options->predef_options);
+        table[position].specified = 1;
+    }
+    for (i = 0; i < options->n_args; i++) {
+        uint32_t arg = blob_add_string(&strings, options->args[i]);
+        if (out)
+            args[i] = arg;
+    }
+
+    header.strings_size = (uint32_t) strings.size;
+    header.size = blob_align(strings_offset + strings.size);
+    if (out)
+        memcpy(out, &header, sizeof(header));
+    return blob_align(strings_offset + strings.size);
+}
+
+int
+option_context_serialize(
+        const option_context*   options,
+        void**                  blob,
+        size_t*                 size
+        )
+{
+    uint64_t key[2];
+    size_t n;
+    char* out;
+
+    if (!options || !blob || !size)
+        return OPTION_INVALID_ARGUMENT;
+
+    hash_random_key(key);
+    n = blob_write(options, NULL, key);
+    if (n > UINT32_MAX)
+        return OPTION_LIMIT_EXCEEDED;   // the offsets are 32 bits.
+    out = calloc(1, n);
+    if (!out)
+        return OPTION_OUT_OF_MEM;
+    blob_write(options, out, key);
+    *blob = out;
+    *size = n;
+    return OPTION_OK;
+}
+
+/*
+ * Writes all bytes, retries when interrupted.
+ */
+static int
+blob_write_fd(int fd, const char* data, size_t size)
+{
+#if defined(HAVE_UNISTD_H)
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return OPTION_FILE_ERROR;
+        data += n;
+        size -= (size_t) n;
+    }
+    return OPTION_OK;
+#else
+    (void) fd;
+    (void) data;
+    (void) size;
+    return OPTION_FILE_ERROR;
+#endif
+}
+
+/*
+ * Creates an anonymous file, a memfd when available.
+ */
+static int
+blob_create_file(int* sealable)
+{
+    int fd = -1;
+#if defined(HAVE_MEMFD_CREATE)
+    fd = memfd_create("parse-cmd-options", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd >= 0) {
+        *sealable = 1;
+        return fd;
+    }
+#endif
+    *sealable = 0;
+#if defined(HAVE_UNISTD_H) && defined(HAVE_FCNTL_H)
+    {
+        // tmpfile() removes the file, keep only a descriptor. Unlike dup(),
+        // F_DUPFD_CLOEXEC keeps it closed on exec.
+        FILE* file = tmpfile();
+        if (!file)
+            return -1;
+        fd = fcntl(fileno(file), F_DUPFD_CLOEXEC, 0);
+        fclose(file);
+    }
+#endif
+    return fd;
+}
+
+int
+option_context_serialize_fd(
+        const option_context*   options,
+        int*                    fd,
+        size_t*                 size
+        )
+{
+    void* blob = NULL;
+    size_t n = 0;
+    int sealable = 0, out, ret;
+
+    if (!fd || !size)
+        return OPTION_INVALID_ARGUMENT;
+
+    ret = option_context_serialize(options, &blob, &n);
+    if (ret)
+        return ret;
+
+    out = blob_create_file(&sealable);
+    if (out < 0) {
+        free(blob);
+        return OPTION_FILE_ERROR;
+    }
+    ret = blob_write_fd(out, blob, n);
+    free(blob);
+#if defined(HAVE_MEMFD_CREATE) && defined(F_ADD_SEALS)
+    // Nobody can change the blob under the feet of the readers.
+    if (ret == OPTION_OK && sealable &&
+        fcntl(out, F_ADD_SEALS,
+              F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)
+        ret = OPTION_FILE_ERROR;
+#endif
+    if (ret) {
+#if defined(HAVE_UNISTD_H)
+        close(out);
+#endif
+        return ret;
+    }
+    *fd = out;
+    *size = n;
+    return OPTION_OK;
+}
+
+/*
+ * Whether offset points at a '\0' terminated string in the strings.
+ */
+static int
+blob_valid_string(const struct option_blob* blob, uint32_t offset)
+{
+    return offset >= blob->strings &&
+           offset < blob->strings + blob->strings_size;
+}
+
+int
+option_blob_open(const option_blob** blob, const void* data, size_t size)
+{
+    const struct option_blob* b = data;
+    const char* bytes = data;
+    const blob_option* table;
+    const uint32_t* args;
+    const blob_slot* slots;
+    uint64_t end;
+    uint32_t i;
+
+    if (!blob || !data)
+        return OPTION_INVALID_ARGUMENT;
+    if (((uintptr_t) data & 7) || size < sizeof(struct option_blob))
+        return OPTION_INVALID_ARGUMENT;
+    if (b->magic != BLOB_MAGIC || b->version != BLOB_VERSION ||
+        b->size > size)
+        return OPTION_INVALID_ARGUMENT;
+
+    // Check the layout once, so the accessors can trust the offsets.
+    if (b->options != blob_align(sizeof(struct option_blob)) ||
+        b->args != b->options + (uint64_t) b->n_options * sizeof(blob_option) ||
+        b->index != blob_align(b->args + (uint64_t) b->n_args * sizeof(uint32_t)) ||
+        b->index_capacity == 0 ||
+        (b->index_capacity & (b->index_capacity - 1)) ||
+        b->index_capacity <= b->n_options ||
+        b->strings != b->index +
+                      (uint64_t) b->index_capacity * sizeof(blob_slot))
+        return OPTION_INVALID_ARGUMENT;
+    end = (uint64_t) b->strings + b->strings_size;
+    if (end > b->size || (b->strings_size && bytes[end - 1] != '\0'))
+        return OPTION_INVALID_ARGUMENT;
+    if (!blob_valid_string(b, b->program_name))
+        return OPTION_INVALID_ARGUMENT;
+
+    table = (const blob_option*) (bytes + b->options);
+    for (i = 0; i < b->n_options; i++) {
+        if (!blob_valid_string(b, table[i].long_opt) ||
+            table[i].long_opt + (uint64_t) table[i].long_length >= end ||
+            bytes[table[i].long_opt + table[i].long_length] != '\0' ||
+            table[i].option_type < OPT_STR || table[i].option_type > OPT_FILE ||
+            (table[i].string_value &&
+             !blob_valid_string(b, table[i].string_value)))
+            return OPTION_INVALID_ARGUMENT;
+    }
+    args = (const uint32_t*) (bytes + b->args);
+    for (i = 0; i < b->n_args; i++)
+        if (!blob_valid_string(b, args[i]))
+            return OPTION_INVALID_ARGUMENT;
+    slots = (const blob_slot*) (bytes + b->index);
+    for (i = 0; i < b->index_capacity; i++)
+        if (slots[i].position > b->n_options)
+            return OPTION_INVALID_ARGUMENT;
+
+    *blob = b;
+    return OPTION_OK;
+}
+
+/*
+ * Returns the option with the long name or NULL.
+ */
+static const blob_option*
+blob_find(const option_blob* blob, const char* name)
+{
+    const char* bytes = (const char*) blob;
+    const blob_option* table = (const blob_option*) (bytes + blob->options);
+    const blob_slot* slots = (const blob_slot*) (bytes + blob->index);
+    size_t length = strlen(name);
+    uint64_t hash = siphash24(name, length, blob->key);
+    uint32_t mask = blob->index_capacity - 1;
+    uint32_t slot, probes;
+
+    for (slot = (uint32_t) hash & mask, probes = 0;
+         slots[slot].position && probes < blob->index_capacity;
+         slot = (slot + 1) & mask, probes++) {
+        const blob_option* option = &table[slots[slot].position - 1];
+        if (slots[slot].hash == (uint32_t) hash &&
+            option->long_length == length &&
+            memcmp(bytes + option->long_opt, name, length) == 0)
+            return option;
+    }
+    return NULL;
+}
+
+/*
+ * Finds a specified option of the given type.
+ */
+static int
+blob_value(
+        const option_blob*      blob,
+        const char*             name,
+        int                     type,
+        const blob_option**     option
+        )
+{
+    if (!blob || !name)
+        return OPTION_INVALID_ARGUMENT;
+    *option = blob_find(blob, name);
+    if (!*option || !(*option)->specified)
+        return OPTION_NOT_SPECIFIED;
+    if ((*option)->option_type != type)
+        return OPTION_WRONG_OPTION_TYPE;
+    return OPTION_OK;
+}
+
+int
+option_blob_have_option(const option_blob* blob, const char* name)
+{
+    const blob_option* option;
+    if (!blob || !name)
+        return 0;
+    option = blob_find(blob, name);
+    return option && option->specified ? 1 : 0;
+}
+
+int
+option_blob_str_value(
+        const option_blob*  blob,
+        const char*         name,
+        const char**        value
+        )
+{
+    const blob_option* option;
+    int ret = blob_value(blob, name, OPT_STR, &option);
+    if (ret)
+        return ret;
+    *value = option->string_value ?
+             (const char*) blob + option->string_value : NULL;
+    return OPTION_OK;
+}
+
+int
+option_blob_int_value(const option_blob* blob, const char* name, int* value)
+{
+    const blob_option* option;
+    int ret = blob_value(blob, name, OPT_INT, &option);
+    if (ret)
+        return ret;
+    *value = option->integer_value;
+    return OPTION_OK;
+}
+
+int
+option_blob_float_value(
+        const option_blob*  blob,
+        const char*         name,
+        double*             value
+        )
+{
+    const blob_option* option;
+    int ret = blob_value(blob, name, OPT_FLOAT, &option);
+    if (ret)
+        return ret;
+    *value = option->floating_value;
+    return OPTION_OK;
+}
+
+int
+option_blob_nargs(const option_blob* blob)
+{
+    return blob ? (int) blob->n_args : -1;
+}
+
+const char*
+option_blob_get_argument(const option_blob* blob, int nth)
+{
+    const uint32_t* args;
+    if (!blob || nth < 0 || (uint32_t) nth >= blob->n_args)
+        return NULL;
+    args = (const uint32_t*) ((const char*) blob + blob->args);
+    return (const char*) blob + args[nth];
+}
+
+const char*
+option_blob_prog_name(const option_blob* blob)
+{
+    return blob ? (const char*) blob + blob->program_name : NULL;
+}
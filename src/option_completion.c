@@ -0,0 +1,295 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file option_completion.c
+ *
+ * This file implements completion of a partially typed command line.
+ *
+ * The spellings of the options, "--name" and "-c", are sorted once. The
+ * candidates for a prefix are then a contiguous range that is found with
+ * two binary searches. The same sorted list is the completion index file,
+ * which a shell script can search with look(1).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parse_cmd.h"
+#include "parse_cmd_private.h"
+
+/**
+ * \internal
+ * A spelling of a predefined option.
+ */
+typedef struct completion_entry {
+    const char* name;       ///< "--name" or "-c", '\0' terminated.
+    int         position;   ///< The predefined option.
+} completion_entry;
+
+/**
+ * \internal
+ * The sorted spellings of the predefined options.
+ */
+struct option_completer {
+    const cmd_option*   predef;     ///< The predefined options.
+    option_index        index;      ///< Finds the predefined options.
+    completion_entry*   entries;    ///< The sorted spellings.
+    size_t              n_entries;  ///< The number of spellings.
+    char*               names;      ///< Storage of the spellings.
+};
+
+static int compare_entries(const void* a, const void* b)
+{
+    return strcmp(((const completion_entry*) a)->name,
+                  ((const completion_entry*) b)->name);
+}
+
+/*
+ * The first entry that doesn't sort before prefix, or when past is set,
+ * the first entry after all entries that start with prefix.
+ */
+static size_t
+find_prefix(const option_completer* c, const char* prefix, int past)
+{
+    size_t lo = 0, hi = c->n_entries, length = strlen(prefix);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strncmp(c->entries[mid].name, prefix, length);
+        if (cmp < 0 || (past && cmp == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * Finds the option in a word that takes a value. When the value is inside
+ * the word, its offset is stored in value_offset, otherwise the next word
+ * is the value and value_offset is 0.
+ *
+ * \returns the position of the option or -1 when the word doesn't need a
+ *          value.
+ */
+static int
+word_value(const option_completer* c, const char* word, size_t* value_offset)
+{
+    int n;
+
+    *value_offset = 0;
+    if (word[0] == '-' && word[1] == '-') {
+        const char* name = word + 2;
+        const char* equals = strchr(name, '=');
+        size_t length = equals ? (size_t)(equals - name) : strlen(name);
+
+        n = option_index_find(&c->index, name, length);
+        if (n < 0 || c->predef[n].option_type == OPT_FLAG)
+            return -1;
+        if (equals)
+            *value_offset = (size_t)(equals + 1 - word);
+        return n;
+    }
+    if (word[0] == '-' && word[1] != '\0') {
+        const char* p;
+        for (p = word + 1; *p != '\0' && *p != '='; p++) {
+            n = option_index_find_short(&c->index, *p);
+            if (n < 0)
+                return -1;
+            if (c->predef[n].option_type != OPT_FLAG) {
+                if (p[1] != '\0')
+                    *value_offset = (size_t)(p + (p[1] == '=' ? 2 : 1) - word);
+                return n;
+            }
+        }
+    }
+    return -1;
+}
+
+int
+option_completer_create(
+        option_completer**  completer,
+        const cmd_option*   predef_opts,
+        unsigned            n_opts
+        )
+{
+    option_completer* c;
+    size_t size = 0, n = 0;
+    char* p;
+    unsigned i;
+    int ret;
+
+    if (!completer || (n_opts && !predef_opts))
+        return OPTION_INVALID_ARGUMENT;
+    c = calloc(1, sizeof(option_completer));
+    if (!c)
+        return OPTION_OUT_OF_MEM;
+    ret = options_build_index(&c->index, predef_opts, n_opts);
+    if (ret) {
+        free(c);
+        return ret;
+    }
+    c->predef = predef_opts;
+
+    for (i = 0; i < n_opts; i++) {
+        if (predef_opts[i].long_opt)
+            size += strlen(predef_opts[i].long_opt) + 3;
+        if (predef_opts[i].short_opt != '\0')
+            size += 3;
+    }
+    c->entries  = malloc((2 * n_opts + 1) * sizeof(completion_entry));
+    c->names    = malloc(size + 1);
+    if (!c->entries || !c->names) {
+        option_completer_free(c);
+        return OPTION_OUT_OF_MEM;
+    }
+
+    // Only the spellings that the parser resolves to this option.
+    p = c->names;
+    for (i = 0; i < n_opts; i++) {
+        const cmd_option* opt = &predef_opts[i];
+        if (opt->long_opt &&
+            option_index_find(&c->index, opt->long_opt, strlen(opt->long_opt))
+                == (int) i) {
+            c->entries[n].name      = p;
+            c->entries[n++].position= (int) i;
+            p += sprintf(p, "--%s", opt->long_opt) + 1;
+        }
+        if (opt->short_opt != '\0' &&
+            option_index_find_short(&c->index, opt->short_opt) == (int) i) {
+            c->entries[n].name      = p;
+            c->entries[n++].position= (int) i;
+            p += sprintf(p, "-%c", opt->short_opt) + 1;
+        }
+    }
+    c->n_entries = n;
+    qsort(c->entries, n, sizeof(completion_entry), compare_entries);
+
+    *completer = c;
+    return OPTION_OK;
+}
+
+void
+option_completer_free(option_completer* completer)
+{
+    if (!completer)
+        return;
+    option_index_destroy(&completer->index);
+    free(completer->entries);
+    free(completer->names);
+    free(completer);
+}
+
+int
+option_completer_query(
+        const option_completer* completer,
+        int                     n_words,
+        const char* const*      words,
+        option_completion*      completion
+        )
+{
+    const char* word = "";
+    size_t offset;
+    int i, n, pending = -1;
+
+    if (!completer || !completion || n_words < 0 || (n_words && !words))
+        return OPTION_INVALID_ARGUMENT;
+
+    memset(completion, 0, sizeof(option_completion));
+    completion->option_index = -1;
+
+    // Replay the words in front of the current one, a value may look
+    // like an option.
+    for (i = 0; i < n_words - 1; i++) {
+        if (pending >= 0) {
+            pending = -1;
+            continue;
+        }
+        n = word_value(completer, words[i], &offset);
+        if (n >= 0 && offset == 0)
+            pending = n;
+    }
+    if (n_words)
+        word = words[n_words - 1];
+
+    if (pending >= 0) {
+        completion->kind            = OPTION_COMPLETE_VALUE;
+        completion->option_index    = pending;
+        return OPTION_OK;
+    }
+    n = word_value(completer, word, &offset);
+    if (n >= 0 && offset > 0) {
+        completion->kind            = OPTION_COMPLETE_VALUE;
+        completion->option_index    = n;
+        completion->value_offset    = offset;
+        return OPTION_OK;
+    }
+
+    completion->kind  = word[0] == '-' ? OPTION_COMPLETE_OPTION
+                                       : OPTION_COMPLETE_ARGUMENT;
+    if (word[0] == '-' || word[0] == '\0') {
+        completion->first = find_prefix(completer, word, 0);
+        completion->count = find_prefix(completer, word, 1) - completion->first;
+    }
+    return OPTION_OK;
+}
+
+const char*
+option_completer_candidate(
+        const option_completer* completer,
+        size_t                  nth,
+        int*                    position
+        )
+{
+    if (!completer || nth >= completer->n_entries)
+        return NULL;
+    if (position)
+        *position = completer->entries[nth].position;
+    return completer->entries[nth].name;
+}
+
+int
+option_completer_write_index(
+        const option_completer* completer,
+        const char*             path
+        )
+{
+    FILE* out;
+    size_t i;
+    int ret = OPTION_OK;
+
+    if (!completer || !path)
+        return OPTION_INVALID_ARGUMENT;
+    out = fopen(path, "w");
+    if (!out)
+        return OPTION_FILE_ERROR;
+
+    for (i = 0; i < completer->n_entries; i++) {
+        const completion_entry* e = &completer->entries[i];
+        if (fprintf(out, "%s\t%s\n",
+                    e->name, option_type_name(&completer->predef[e->position])
+                    ) < 0) {
+            ret = OPTION_FILE_ERROR;
+            break;
+        }
+    }
+    if (fclose(out) != 0)
+        ret = OPTION_FILE_ERROR;
+    return ret;
+}
@@ -0,0 +1,103 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file option_env.c
+ *
+ * This file implements setting options from environment variables.
+ * Instead of asking getenv for every option, the environment is walked
+ * once and every variable with the prefix is looked up in the index of
+ * the options.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "parse_cmd.h"
+#include "parse_cmd_private.h"
+
+#if defined(_MSC_VER)
+#define environ _environ
+#else
+extern char** environ;
+#endif
+
+/**
+ * \internal
+ * Variables with longer names can't name an option.
+ */
+#define OPTION_ENV_MAX_NAME 256
+
+int
+option_value_is_false(const char* value)
+{
+    return value[0] == '\0' || strcmp(value, "0") == 0 ||
+           strcmp(value, "false") == 0 || strcmp(value, "no") == 0 ||
+           strcmp(value, "off") == 0;
+}
+
+int
+options_merge_environment(option_context*               options,
+                          const option_parse_settings*  settings
+                          )
+{
+    const char* const* env = settings->environment;
+    size_t prefix_length = strlen(settings->env_prefix);
+    char name[OPTION_ENV_MAX_NAME];
+
+    if (!env)
+        env = (const char* const*) environ;
+    if (!env)
+        return OPTION_OK;
+
+    for (; *env; env++) {
+        const char* var = *env;
+        const char* value;
+        size_t length = 0;
+        int position, ret;
+
+        if (strncmp(var, settings->env_prefix, prefix_length) != 0)
+            continue;
+
+        // MYTOOL_OUTPUT_DIR names the option "output-dir".
+        for (var += prefix_length; var[length] && var[length] != '='; length++) {
+            char c = var[length];
+            if (length == OPTION_ENV_MAX_NAME)
+                break;
+            if (c >= 'A' && c <= 'Z')
+                c = (char) (c - 'A' + 'a');
+            else if (c == '_')
+                c = '-';
+            name[length] = c;
+        }
+        if (var[length] != '=' || length == 0)
+            continue;
+        value = var + length + 1;
+
+        position = option_index_find(options->index, name, length);
+        if (position < 0)
+            continue;
+        ret = options_merge_option(options, position, value, OPTION_SOURCE_ENV);
+        if (ret) {
+            option_diagnostic diag = {ret, -1, 0, position};
+            options_report(settings, &diag, NULL, options->predef_options);
+            return ret;
+        }
+    }
+    return OPTION_OK;
+}
@@ -0,0 +1,235 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \internal
+ * \file option_index.c
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "parse_cmd.h"
+#include "hash_utils.h"
+#include "option_index.h"
+
+/*
+ * The table is grown when it is half full, this keeps the probe sequences
+ * of the linear probing short.
+ */
+static int
+option_index_needs_growth(const option_index* index)
+{
+    return (index->size + 1) * 2 > index->capacity;
+}
+
+static option_index_slot*
+option_index_alloc_slots(size_t capacity)
+{
+    size_t i;
+    option_index_slot* slots = malloc(capacity * sizeof(option_index_slot));
+    if (!slots)
+        return NULL;
+    for (i = 0; i < capacity; i++) {
+        slots[i].hash       = 0;
+        slots[i].name       = NULL;
+        slots[i].length     = 0;
+        slots[i].position   = -1;
+    }
+    return slots;
+}
+
+/*
+ * Doubles the capacity, the stored hashes are reused so the names
+ * aren't hashed again.
+ */
+static int
+option_index_grow(option_index* index)
+{
+    size_t i;
+    size_t new_cap = index->capacity * 2;
+    size_t mask    = new_cap - 1;
+    option_index_slot* slots = option_index_alloc_slots(new_cap);
+    if (!slots)
+        return OPTION_OUT_OF_MEM;
+
+    for (i = 0; i < index->capacity; i++) {
+        size_t pos;
+        if (index->slots[i].position < 0)
+            continue;
+        pos = (size_t)index->slots[i].hash & mask;
+        while (slots[pos].position >= 0)
+            pos = (pos + 1) & mask;
+        slots[pos] = index->slots[i];
+    }
+
+    free(index->slots);
+    index->slots    = slots;
+    index->capacity = new_cap;
+    return OPTION_OK;
+}
+
+/*
+ * Returns the slot that contains name, or the empty slot where it
+ * should be inserted.
+ */
+static size_t
+option_index_probe(
+        const option_index* index,
+        const char*         name,
+        size_t              length,
+        uint64_t            hash
+        )
+{
+    size_t mask = index->capacity - 1;
+    size_t pos  = (size_t)hash & mask;
+
+    while (index->slots[pos].position >= 0) {
+        const option_index_slot* slot = &index->slots[pos];
+        if (slot->hash == hash &&
+            slot->length == length &&
+            memcmp(slot->name, name, length) == 0)
+            break;
+        pos = (pos + 1) & mask;
+    }
+    return pos;
+}
+
+int
+option_index_init(option_index* index, size_t expected)
+{
+    size_t i;
+    size_t capacity = 8;
+
+    assert(index);
+    while (capacity < expected * 2)
+        capacity *= 2;
+
+    hash_random_key(index->key);
+    index->slots    = option_index_alloc_slots(capacity);
+    index->capacity = capacity;
+    index->size     = 0;
+    for (i = 0; i < sizeof(index->shorts) / sizeof(index->shorts[0]); i++)
+        index->shorts[i] = -1;
+
+    return index->slots ? OPTION_OK : OPTION_OUT_OF_MEM;
+}
+
+void
+option_index_destroy(option_index* index)
+{
+    if (index) {
+        free(index->slots);
+        index->slots    = NULL;
+        index->capacity = 0;
+        index->size     = 0;
+    }
+}
+
+int
+option_index_insert(
+        option_index*   index,
+        const char*     name,
+        size_t          length,
+        int             position
+        )
+{
+    uint64_t hash;
+    size_t pos;
+
+    assert(index && name && position >= 0);
+
+    if (option_index_needs_growth(index)) {
+        int ret = option_index_grow(index);
+        if (ret)
+            return ret;
+    }
+
+    hash = siphash24(name, length, index->key);
+    pos  = option_index_probe(index, name, length, hash);
+    if (index->slots[pos].position >= 0)
+        return OPTION_DUPLICATE;
+
+    index->slots[pos].hash      = hash;
+    index->slots[pos].name      = name;
+    index->slots[pos].length    = length;
+    index->slots[pos].position  = position;
+    index->size++;
+    return OPTION_OK;
+}
+
+int
+option_index_remove(option_index* index, const char* name, size_t length)
+{
+    size_t mask = index->capacity - 1;
+    size_t hole, pos;
+    uint64_t hash = siphash24(name, length, index->key);
+
+    hole = option_index_probe(index, name, length, hash);
+    if (index->slots[hole].position < 0)
+        return OPTION_NOT_SPECIFIED;
+
+    // Backward shift deletion: move entries of the same probe sequence
+    // into the hole, so lookups don't need tomb stones.
+    pos = hole;
+    for (;;) {
+        size_t home;
+        pos = (pos + 1) & mask;
+        if (index->slots[pos].position < 0)
+            break;
+        home = (size_t)index->slots[pos].hash & mask;
+        // Only move the entry when its home isn't in (hole, pos].
+        if (((pos - home) & mask) >= ((pos - hole) & mask)) {
+            index->slots[hole] = index->slots[pos];
+            hole = pos;
+        }
+    }
+    index->slots[hole].position = -1;
+    index->slots[hole].name     = NULL;
+    index->size--;
+    return OPTION_OK;
+}
+
+int
+option_index_find(const option_index* index, const char* name, size_t length)
+{
+    uint64_t hash;
+
+    if (!index || !index->slots || !name)
+        return -1;
+
+    hash = siphash24(name, length, index->key);
+    return index->slots[option_index_probe(index, name, length, hash)].position;
+}
+
+int
+option_index_insert_short(option_index* index, char c, int position)
+{
+    unsigned char uc = (unsigned char) c;
+    if (index->shorts[uc] >= 0)
+        return OPTION_DUPLICATE;
+    index->shorts[uc] = position;
+    return OPTION_OK;
+}
+
+int
+option_index_find_short(const option_index* index, char c)
+{
+    return index->shorts[(unsigned char) c];
+}
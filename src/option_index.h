@@ -0,0 +1,136 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef OPTION_INDEX_H
+#define OPTION_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * \internal
+ * \file option_index.h
+ *
+ * The option index maps the names of options to their position in the
+ * array of predefined options. Long options are kept in an open addressing
+ * hash table that is keyed with siphash24(), short options are kept in a
+ * table with one entry per character.
+ */
+
+/**
+ * \internal
+ * One slot of the hash table of an option_index.
+ */
+typedef struct option_index_slot {
+    uint64_t    hash;       ///< hash of the name.
+    const char* name;       ///< name of the option, not '\0' terminated.
+    size_t      length;     ///< length of the name in bytes.
+    int         position;   ///< position of the option or -1 if empty.
+} option_index_slot;
+
+/**
+ * \internal
+ * Looks up options by name in O(1).
+ *
+ * The index doesn't own the names, they should remain valid as long
+ * as the index is used.
+ */
+typedef struct option_index {
+    uint64_t            key[2];         ///< key for the hash function.
+    option_index_slot*  slots;          ///< the hash table.
+    size_t              capacity;       ///< number of slots, a power of 2.
+    size_t              size;           ///< number of occupied slots.
+    int                 shorts[256];    ///< positions of the short options.
+} option_index;
+
+/**
+ * \internal
+ * \brief initializes an empty index.
+ *
+ * @param [out] index    The index to initialize.
+ * @param [in]  expected The number of long options expected in the index.
+ *
+ * \returns OPTION_OK or OPTION_OUT_OF_MEM.
+ */
+int
+option_index_init(option_index* index, size_t expected);
+
+/**
+ * \internal
+ * \brief releases the memory held by an index.
+ */
+void
+option_index_destroy(option_index* index);
+
+/**
+ * \internal
+ * \brief Adds a long option to the index.
+ *
+ * \returns OPTION_OK, OPTION_DUPLICATE when the name already exists or
+ *          OPTION_OUT_OF_MEM.
+ */
+int
+option_index_insert(
+        option_index*   index,
+        const char*     name,
+        size_t          length,
+        int             position
+        );
+
+/**
+ * \internal
+ * \brief Removes a long option from the index.
+ *
+ * \returns OPTION_OK or OPTION_NOT_SPECIFIED when the name isn't present.
+ */
+int
+option_index_remove(option_index* index, const char* name, size_t length);
+
+/**
+ * \internal
+ * \brief Looks up a long option.
+ *
+ * @param [in] index  The index to search.
+ * @param [in] name   The name of the option, it doesn't need to be '\0'
+ *                    terminated.
+ * @param [in] length The length of the name in bytes.
+ *
+ * \returns the position of the option or -1 when it wasn't found.
+ */
+int
+option_index_find(const option_index* index, const char* name, size_t length);
+
+/**
+ * \internal
+ * \brief Adds a short option to the index.
+ *
+ * \returns OPTION_OK or OPTION_DUPLICATE when c is already in use.
+ */
+int
+option_index_insert_short(option_index* index, char c, int position);
+
+/**
+ * \internal
+ * \brief Looks up a short option.
+ *
+ * \returns the position of the option or -1 when it wasn't found.
+ */
+int
+option_index_find_short(const option_index* index, char c);
+
+#endif
@@ -0,0 +1,233 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file option_overlay.c
+ *
+ * This file implements overlays of an option_context. A name is looked up
+ * once in the index of the parent, the position then selects an override
+ * in the small inline table or, failing that, the option of the parent.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "parse_cmd.h"
+#include "parse_cmd_private.h"
+
+/*
+ * Returns the override of a predefined option or NULL.
+ */
+static option_override*
+overlay_override(const option_overlay* overlay, int position)
+{
+    unsigned i;
+    for (i = 0; i < overlay->count; i++)
+        if (overlay->overrides[i].position == position)
+            return (option_override*) &overlay->overrides[i];
+    return NULL;
+}
+
+/*
+ * Finds the value of a specified option in the overlay or its parent.
+ */
+static int
+overlay_value(
+        const option_overlay*   overlay,
+        const char*             name,
+        int                     type,
+        option_value*           value
+        )
+{
+    const option_context* parent;
+    const option_override* override;
+    int position;
+
+    if (!overlay || !name)
+        return OPTION_INVALID_ARGUMENT;
+
+    parent = overlay->parent;
+    position = option_index_find(parent->index, name, strlen(name));
+    if (position < 0)
+        return OPTION_NOT_SPECIFIED;
+
+    override = overlay_override(overlay, position);
+    if (override) {
+        if (!override->specified)
+            return OPTION_NOT_SPECIFIED;
+        *value = override->value;
+    }
+    else {
+        const cmd_option* option = option_context_find_option(parent, name);
+        if (!option)
+            return OPTION_NOT_SPECIFIED;
+        *value = option->value;
+    }
+    if (parent->predef_options[position].option_type != type)
+        return OPTION_WRONG_OPTION_TYPE;
+    return OPTION_OK;
+}
+
+/*
+ * Returns the override of an option, adds one when there is none yet.
+ */
+static int
+overlay_slot(option_overlay* overlay, const char* name, option_override** out)
+{
+    int position;
+
+    if (!overlay || !name)
+        return OPTION_INVALID_ARGUMENT;
+
+    position = option_index_find(overlay->parent->index, name, strlen(name));
+    if (position < 0)
+        return OPTION_UNKNOWN;
+
+    *out = overlay_override(overlay, position);
+    if (*out)
+        return OPTION_OK;
+    if (overlay->count == OPTION_OVERLAY_CAPACITY)
+        return OPTION_LIMIT_EXCEEDED;
+
+    *out = &overlay->overrides[overlay->count++];
+    memset(*out, 0, sizeof(option_override));
+    (*out)->position = position;
+    return OPTION_OK;
+}
+
+void
+option_overlay_init(option_overlay* overlay, const option_context* parent)
+{
+    assert(overlay && parent);
+    overlay->parent = parent;
+    overlay->count  = 0;
+}
+
+int
+option_overlay_create(option_overlay** overlay, const option_context* parent)
+{
+    if (!overlay || !parent)
+        return OPTION_INVALID_ARGUMENT;
+    *overlay = malloc(sizeof(option_overlay));
+    if (!*overlay)
+        return OPTION_OUT_OF_MEM;
+    option_overlay_init(*overlay, parent);
+    return OPTION_OK;
+}
+
+void
+option_overlay_free(option_overlay* overlay)
+{
+    free(overlay);
+}
+
+int
+option_overlay_set(option_overlay* overlay, const char* name, const char* value)
+{
+    option_override* override;
+    option_value converted;
+    unsigned count = overlay ? overlay->count : 0;
+    int ret = overlay_slot(overlay, name, &override);
+    if (ret)
+        return ret;
+
+    ret = option_convert_value(
+            &overlay->parent->predef_options[override->position],
+            value,
+            &converted
+            );
+    if (ret) {
+        // Don't leave a new, empty override behind.
+        overlay->count = count;
+        return ret;
+    }
+    override->value     = converted;
+    override->specified = 1;
+    return OPTION_OK;
+}
+
+int
+option_overlay_unset(option_overlay* overlay, const char* name)
+{
+    option_override* override;
+    int ret = overlay_slot(overlay, name, &override);
+    if (ret)
+        return ret;
+    override->specified = 0;
+    return OPTION_OK;
+}
+
+int
+option_overlay_have_option(const option_overlay* overlay, const char* name)
+{
+    const option_override* override;
+    int position;
+
+    if (!overlay || !name)
+        return 0;
+    position = option_index_find(overlay->parent->index, name, strlen(name));
+    if (position < 0)
+        return 0;
+    override = overlay_override(overlay, position);
+    if (override)
+        return override->specified;
+    return option_context_find_option(overlay->parent, name) != NULL;
+}
+
+int
+option_overlay_str_value(
+        const option_overlay*   overlay,
+        const char*             name,
+        const char**            value
+        )
+{
+    option_value v;
+    int ret = overlay_value(overlay, name, OPT_STR, &v);
+    if (ret == OPTION_OK)
+        *value = v.string_value;
+    return ret;
+}
+
+int
+option_overlay_int_value(
+        const option_overlay*   overlay,
+        const char*             name,
+        int*                    value
+        )
+{
+    option_value v;
+    int ret = overlay_value(overlay, name, OPT_INT, &v);
+    if (ret == OPTION_OK)
+        *value = v.integer_value;
+    return ret;
+}
+
+int
+option_overlay_float_value(
+        const option_overlay*   overlay,
+        const char*             name,
+        double*                 value
+        )
+{
+    option_value v;
+    int ret = overlay_value(overlay, name, OPT_FLOAT, &v);
+    if (ret == OPTION_OK)
+        *value = v.floating_value;
+    return ret;
+}
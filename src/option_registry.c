@@ -0,0 +1,219 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file option_registry.c
+ *
+ * This file implements the option_registry, a schema that can be extended
+ * with groups of options while the program runs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "parse_cmd.h"
+#include "parse_cmd_private.h"
+
+/*
+ * Creates the name under which an option of a group is registered
+ * "group.long_opt" or just "long_opt" when there is no group.
+ */
+static char*
+registry_make_name(const char* group, const char* long_opt)
+{
+    size_t glen = group ? strlen(group) : 0;
+    size_t olen = strlen(long_opt);
+    char* name  = malloc(glen + olen + 2);
+    char* p     = name;
+
+    if (!name)
+        return NULL;
+    if (group) {
+        memcpy(p, group, glen);
+        p += glen;
+        *p++ = '.';
+    }
+    memcpy(p, long_opt, olen + 1);
+    return name;
+}
+
+/*
+ * Makes sure there is room for n more options, the capacity is doubled
+ * to keep registration O(1) amortized.
+ */
+static int
+registry_reserve(option_registry* registry, unsigned n)
+{
+    cmd_option* new_opts;
+    int new_cap = registry->capacity ? registry->capacity : 8;
+
+    if ((unsigned)(registry->capacity - registry->n_options) >= n)
+        return OPTION_OK;
+
+    while ((unsigned)(new_cap - registry->n_options) < n)
+        new_cap *= 2;
+
+    new_opts = realloc(registry->options, new_cap * sizeof(cmd_option));
+    if (!new_opts)
+        return OPTION_OUT_OF_MEM;
+
+    registry->options  = new_opts;
+    registry->capacity = new_cap;
+    return OPTION_OK;
+}
+
+/*
+ * Removes the options registered from position first onward, this is used
+ * to leave the registry untouched when adding a group fails.
+ */
+static void
+registry_truncate(option_registry* registry, int first)
+{
+    while (registry->n_options > first) {
+        cmd_option* opt = &registry->options[--registry->n_options];
+        option_index_remove(
+                &registry->index, opt->long_opt, strlen(opt->long_opt)
+                );
+        if (opt->short_opt != '\0' &&
+            option_index_find_short(&registry->index, opt->short_opt) ==
+                registry->n_options)
+            registry->index.shorts[(unsigned char) opt->short_opt] = -1;
+        free((char*) opt->long_opt);
+    }
+}
+
+int
+option_registry_create(option_registry** registry)
+{
+    int ret;
+    if (!registry || *registry)
+        return OPTION_INVALID_ARGUMENT;
+
+    *registry = calloc(1, sizeof(option_registry));
+    if (!*registry)
+        return OPTION_OUT_OF_MEM;
+
+    ret = option_index_init(&(*registry)->index, 0);
+    if (ret) {
+        free(*registry);
+        *registry = NULL;
+    }
+    return ret;
+}
+
+void
+option_registry_free(option_registry* registry)
+{
+    if (registry) {
+        registry_truncate(registry, 0);
+        option_index_destroy(&registry->index);
+        free(registry->options);
+        free(registry);
+    }
+}
+
+int
+option_registry_add(
+        option_registry*    registry,
+        const char*         group,
+        const cmd_option*   opts,
+        unsigned            nopts
+        )
+{
+    unsigned i;
+    int ret;
+    int first;
+
+    if (!registry || (!opts && nopts > 0))
+        return OPTION_INVALID_ARGUMENT;
+    if (group && (group[0] == '\0' || strchr(group, '=')))
+        return OPTION_INVALID_ARGUMENT;
+
+    ret = registry_reserve(registry, nopts);
+    if (ret)
+        return ret;
+
+    first = registry->n_options;
+    for (i = 0; i < nopts; i++) {
+        cmd_option* opt;
+        char* name;
+
+        if (!opts[i].long_opt || strchr(opts[i].long_opt, '=')) {
+            ret = OPTION_INVALID_ARGUMENT;
+            break;
+        }
+
+        name = registry_make_name(group, opts[i].long_opt);
+        if (!name) {
+            ret = OPTION_OUT_OF_MEM;
+            break;
+        }
+
+        ret = option_index_insert(
+                &registry->index, name, strlen(name), registry->n_options
+                );
+        if (ret) {
+            free(name);
+            break;
+        }
+
+        opt  = &registry->options[registry->n_options++];
+        *opt = opts[i];
+        opt->long_opt = name;
+
+        // Only the options without a group can be given by a short option,
+        // the namespace of the short options is too small to share.
+        if (group)
+            opt->short_opt = '\0';
+        if (opt->short_opt != '\0') {
+            ret = option_index_insert_short(
+                    &registry->index, opt->short_opt, registry->n_options - 1
+                    );
+            if (ret) {
+                // Don't let the truncation remove the earlier short option.
+                opt->short_opt = '\0';
+                break;
+            }
+        }
+    }
+
+    if (ret)
+        registry_truncate(registry, first);
+
+    return ret;
+}
+
+const cmd_option*
+option_registry_find(const option_registry* registry, const char* name)
+{
+    int pos;
+    if (!registry || !name)
+        return NULL;
+
+    pos = option_index_find(&registry->index, name, strlen(name));
+    return pos >= 0 ? &registry->options[pos] : NULL;
+}
+
+int
+option_registry_num_options(const option_registry* registry)
+{
+    if (!registry)
+        return -1;
+    return registry->n_options;
+}
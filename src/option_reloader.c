@@ -0,0 +1,529 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file option_reloader.c
+ *
+ * This file implements options that are reloaded when their configuration
+ * file changes, while other threads read them.
+ *
+ * Every load produces a new option_context, a snapshot, that is never
+ * modified. The current snapshot is published by exchanging a pointer.
+ * A reader announces itself by incrementing the reader count of the
+ * parity of the current epoch before it loads the pointer. A replaced
+ * snapshot is retired at the epoch of the exchange; the epoch only
+ * advances when the readers of the previous parity are gone, so a snapshot
+ * retired at epoch R is no longer used once the epoch reaches R + 2.
+ * Retired snapshots are freed when the reloader checks for changes, the
+ * readers never wait and never take a lock.
+ */
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#else
+// inotify and stat are not part of C99.
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "parse_cmd.h"
+#include "parse_cmd_config.h"
+#include "parse_cmd_private.h"
+#include "atomic_utils.h"
+
+#if defined(HAVE_SYS_INOTIFY_H) && defined(HAVE_UNISTD_H)
+#define RELOADER_USE_INOTIFY
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#if defined(HAVE_SYS_STAT_H)
+#include <sys/stat.h>
+#endif
+
+/**
+ * \internal
+ * A snapshot that has been replaced and waits until its readers are gone.
+ */
+typedef struct retired_snapshot {
+    option_context* snapshot;   ///< The replaced snapshot.
+    long            epoch;      ///< The epoch in which it was replaced.
+} retired_snapshot;
+
+/**
+ * \internal
+ * Reloads options and publishes them to the readers.
+ */
+struct option_reloader {
+    option_context*     current;        ///< The published snapshot.
+    long                epoch;          ///< Advances when readers are gone.
+    long                readers[2];     ///< Readers per epoch parity.
+
+    cmd_option*         defaults;       ///< The predefined options.
+    unsigned            n_options;      ///< Number of predefined options.
+    int                 argc;           ///< The command line of the program.
+    const char* const*  argv;           ///< The command line of the program.
+    char*               path;           ///< The configuration file.
+    option_parse_settings settings;     ///< How to parse the sources.
+    unsigned            generation;     ///< Generation of current.
+
+    retired_snapshot*   retired;        ///< Snapshots waiting to be freed.
+    int                 n_retired;      ///< Number of retired snapshots.
+    int                 retired_capacity;///< Capacity of retired.
+
+    int                 watch_fd;       ///< The inotify instance or -1.
+    const char*         watch_name;     ///< The name of the file in its
+                                        //   directory.
+    long long           mtime;          ///< The time the file was modified
+                                        //   when it was loaded last.
+    long long           size;           ///< The size when loaded last.
+};
+
+/*
+ * Returns the modification time and size of a file, or -1 when unknown.
+ */
+static void
+reloader_stat(const char* path, long long* mtime, long long* size)
+{
+#if defined(HAVE_SYS_STAT_H)
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        *mtime  = (long long) st.st_mtime;
+        *size   = (long long) st.st_size;
+        return;
+    }
+#else
+    (void) path;
+#endif
+    *mtime  = -1;
+    *size   = -1;
+}
+
+/*
+ * Whether an option differs between two snapshots.
+ */
+static int
+option_differs(const cmd_option* a, int a_set, const cmd_option* b, int b_set)
+{
+    if (a_set != b_set)
+        return 1;
+    if (!a_set)
+        return 0;
+    switch (a->option_type) {
+    case OPT_STR:
+    case OPT_FILE:
+        return strcmp(a->value.string_value, b->value.string_value) != 0;
+    case OPT_INT:
+        return a->value.integer_value != b->value.integer_value;
+    case OPT_FLOAT:
+        return a->value.floating_value != b->value.floating_value;
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Marks which predefined options are specified in a snapshot.
+ */
+static void
+snapshot_specified(const option_context* snapshot, unsigned char* set)
+{
+    int i;
+    memset(set, 0, (size_t) snapshot->n_predef_options);
+    for (i = 0; i < snapshot->n_options; i++)
+        set[snapshot->options[i] - snapshot->predef_options] = 1;
+}
+
+/*
+ * Records in which generation the options of snapshot last changed.
+ */
+static int
+snapshot_diff(option_context* snapshot, const option_context* previous)
+{
+    unsigned n = (unsigned) snapshot->n_predef_options;
+    unsigned char* set = NULL;
+    unsigned char* previous_set = NULL;
+    unsigned i;
+
+    snapshot->changed = calloc(n ? n : 1, sizeof(unsigned));
+    set = malloc(n ? n : 1);
+    previous_set = malloc(n ? n : 1);
+    if (!snapshot->changed || !set || !previous_set) {
+        free(set);
+        free(previous_set);
+        return OPTION_OUT_OF_MEM;
+    }
+
+    snapshot_specified(snapshot, set);
+    if (previous)
+        snapshot_specified(previous, previous_set);
+
+    for (i = 0; i < n; i++) {
+        if (!previous)
+            snapshot->changed[i] = snapshot->generation;
+        else if (option_differs(&snapshot->predef_options[i], set[i],
+                                &previous->predef_options[i], previous_set[i]))
+            snapshot->changed[i] = snapshot->generation;
+        else
+            snapshot->changed[i] = previous->changed[i];
+    }
+    free(set);
+    free(previous_set);
+    return OPTION_OK;
+}
+
+/*
+ * Parses the command line and the configuration file into a new snapshot.
+ */
+static int
+reloader_build(option_reloader* reloader,
+               const option_context* previous,
+               option_context** out
+               )
+{
+    option_context* snapshot = NULL;
+    size_t size = reloader->n_options * sizeof(cmd_option);
+    cmd_option* predef = malloc(size ? size : 1);
+    int ret;
+
+    if (!predef)
+        return OPTION_OUT_OF_MEM;
+    if (size)
+        memcpy(predef, reloader->defaults, size);
+
+    ret = options_parse_ex(
+            &snapshot, reloader->argc, reloader->argv, predef,
+            reloader->n_options, &reloader->settings
+            );
+    if (ret) {
+        free(predef);
+        return ret;
+    }
+    snapshot->owned_predef  = predef;
+    snapshot->generation    = reloader->generation + 1;
+
+    reloader_stat(reloader->path, &reloader->mtime, &reloader->size);
+    // The file is expected to change, so it is copied instead of mapped.
+    ret = options_load_config(
+            snapshot, reloader->path, &reloader->settings, FILE_MAP_COPY
+            );
+    if (ret == OPTION_OK)
+        ret = snapshot_diff(snapshot, previous);
+    if (ret) {
+        option_context_free(snapshot);
+        return ret;
+    }
+    *out = snapshot;
+    return OPTION_OK;
+}
+
+/*
+ * Frees the retired snapshots that can't have readers anymore.
+ */
+static void
+reloader_reclaim(option_reloader* reloader)
+{
+    int flips, i, kept = 0;
+
+    // Advance the epoch when the readers of the previous parity are gone,
+    // twice is enough for everything that is retired now.
+    for (flips = 0; flips < 2 && reloader->n_retired > 0; flips++) {
+        long epoch = atomic_load_long(&reloader->epoch);
+        if (atomic_load_long(&reloader->readers[(epoch + 1) & 1]) != 0)
+            break;
+        atomic_increment(&reloader->epoch);
+    }
+
+    for (i = 0; i < reloader->n_retired; i++) {
+        retired_snapshot* r = &reloader->retired[i];
+        if (atomic_load_long(&reloader->epoch) - r->epoch >= 2)
+            option_context_free(r->snapshot);
+        else
+            reloader->retired[kept++] = *r;
+    }
+    reloader->n_retired = kept;
+}
+
+/*
+ * Publishes a new snapshot and retires the previous one.
+ */
+static int
+reloader_publish(option_reloader* reloader, option_context* snapshot)
+{
+    option_context* old;
+
+    if (reloader->n_retired == reloader->retired_capacity) {
+        int new_cap = reloader->retired_capacity ? reloader->retired_capacity * 2 : 4;
+        retired_snapshot* new_retired = realloc(
+                reloader->retired, new_cap * sizeof(retired_snapshot)
+                );
+        if (!new_retired)
+            return OPTION_OUT_OF_MEM;
+        reloader->retired = new_retired;
+        reloader->retired_capacity = new_cap;
+    }
+
+    old = atomic_exchange_ptr(&reloader->current, snapshot);
+    reloader->generation = snapshot->generation;
+    if (old) {
+        retired_snapshot* r = &reloader->retired[reloader->n_retired++];
+        r->snapshot = old;
+        r->epoch    = atomic_load_long(&reloader->epoch);
+    }
+    reloader_reclaim(reloader);
+    return OPTION_OK;
+}
+
+/*
+ * Watches the directory of the file, editors often replace a file instead
+ * of writing to it.
+ */
+static void
+reloader_watch(option_reloader* reloader)
+{
+    const char* slash = strrchr(reloader->path, '/');
+    reloader->watch_fd = -1;
+    reloader->watch_name = slash ? slash + 1 : reloader->path;
+#if defined(RELOADER_USE_INOTIFY)
+    {
+        char* dir;
+        size_t length = slash ? (size_t)(slash - reloader->path) : 1;
+        if (slash == reloader->path)
+            length = 1; // the root directory
+        dir = malloc(length + 1);
+        if (!dir)
+            return;
+        memcpy(dir, slash ? reloader->path : ".", length);
+        dir[length] = '\0';
+
+        reloader->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (reloader->watch_fd >= 0 &&
+            inotify_add_watch(
+                reloader->watch_fd, dir,
+                IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ATTRIB
+                ) < 0) {
+            close(reloader->watch_fd);
+            reloader->watch_fd = -1;
+        }
+        free(dir);
+    }
+#endif
+}
+
+/*
+ * Whether the configuration file changed since it was loaded.
+ */
+static int
+reloader_changed(option_reloader* reloader)
+{
+#if defined(RELOADER_USE_INOTIFY)
+    if (reloader->watch_fd >= 0) {
+        // Enough for a few events with names, read until empty.
+        char buf[4096]
+            __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        int changed = 0;
+        for (;;) {
+            ssize_t n = read(reloader->watch_fd, buf, sizeof(buf));
+            char* p = buf;
+            if (n <= 0)
+                break;
+            while (p < buf + n) {
+                const struct inotify_event* event =
+                    (const struct inotify_event*) p;
+                if (event->len &&
+                    strcmp(event->name, reloader->watch_name) == 0)
+                    changed = 1;
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        return changed;
+    }
+#endif
+    {
+        long long mtime, size;
+        reloader_stat(reloader->path, &mtime, &size);
+        return mtime != reloader->mtime || size != reloader->size;
+    }
+}
+
+int
+option_reloader_create(
+        option_reloader**               reloader,
+        int                             argc,
+        const char* const*              argv,
+        const cmd_option*               predef_opts,
+        unsigned                        nopts,
+        const char*                     path,
+        const option_parse_settings*    settings
+        )
+{
+    option_reloader* r;
+    option_context* snapshot = NULL;
+    size_t size = nopts * sizeof(cmd_option);
+    size_t path_length;
+    int ret;
+
+    if (!reloader || *reloader || !argv || argc < 1 || !path)
+        return OPTION_INVALID_ARGUMENT;
+
+    r = calloc(1, sizeof(option_reloader));
+    if (!r)
+        return OPTION_OUT_OF_MEM;
+
+    path_length = strlen(path);
+    r->defaults = malloc(size ? size : 1);
+    r->path     = malloc(path_length + 1);
+    if (!r->defaults || !r->path) {
+        free(r->defaults);
+        free(r->path);
+        free(r);
+        return OPTION_OUT_OF_MEM;
+    }
+    if (size)
+        memcpy(r->defaults, predef_opts, size);
+    memcpy(r->path, path, path_length + 1);
+    r->n_options    = nopts;
+    r->argc         = argc;
+    r->argv         = argv;
+    if (settings)
+        r->settings = *settings;
+
+    reloader_watch(r);
+    ret = reloader_build(r, NULL, &snapshot);
+    if (ret == OPTION_OK)
+        ret = reloader_publish(r, snapshot);
+    if (ret) {
+        if (snapshot && r->current != snapshot)
+            option_context_free(snapshot);
+        option_reloader_free(r);
+        return ret;
+    }
+    *reloader = r;
+    return OPTION_OK;
+}
+
+void
+option_reloader_free(option_reloader* reloader)
+{
+    int i;
+    if (!reloader)
+        return;
+    for (i = 0; i < reloader->n_retired; i++)
+        option_context_free(reloader->retired[i].snapshot);
+    option_context_free(reloader->current);
+#if defined(RELOADER_USE_INOTIFY)
+    if (reloader->watch_fd >= 0)
+        close(reloader->watch_fd);
+#endif
+    free(reloader->retired);
+    free(reloader->defaults);
+    free(reloader->path);
+    free(reloader);
+}
+
+int
+option_reloader_fd(const option_reloader* reloader)
+{
+    return reloader ? reloader->watch_fd : -1;
+}
+
+int
+option_reloader_reload(option_reloader* reloader)
+{
+    option_context* snapshot = NULL;
+    int ret;
+
+    if (!reloader)
+        return OPTION_INVALID_ARGUMENT;
+
+    ret = reloader_build(reloader, reloader->current, &snapshot);
+    if (ret == OPTION_OK) {
+        ret = reloader_publish(reloader, snapshot);
+        if (ret)
+            option_context_free(snapshot);
+    }
+    return ret;
+}
+
+int
+option_reloader_check(option_reloader* reloader, int* reloaded)
+{
+    int ret = OPTION_OK;
+
+    if (!reloader)
+        return OPTION_INVALID_ARGUMENT;
+    if (reloaded)
+        *reloaded = 0;
+
+    if (reloader_changed(reloader)) {
+        ret = option_reloader_reload(reloader);
+        if (ret == OPTION_OK && reloaded)
+            *reloaded = 1;
+    }
+    else {
+        reloader_reclaim(reloader);
+    }
+    return ret;
+}
+
+const option_context*
+option_reloader_acquire(option_reloader* reloader, long* ticket)
+{
+    long epoch;
+    for (;;) {
+        epoch = atomic_load_long(&reloader->epoch);
+        atomic_increment(&reloader->readers[epoch & 1]);
+        if (atomic_load_long(&reloader->epoch) == epoch)
+            break;
+        // The epoch advanced, the writer may not have seen this reader.
+        atomic_decrement(&reloader->readers[epoch & 1]);
+    }
+    *ticket = epoch;
+    return atomic_load_ptr(&reloader->current);
+}
+
+void
+option_reloader_release(option_reloader* reloader, long ticket)
+{
+    atomic_decrement(&reloader->readers[ticket & 1]);
+}
+
+unsigned
+option_context_generation(const option_context* context)
+{
+    return context ? context->generation : 0;
+}
+
+int
+option_context_changed_since(
+        const option_context*   context,
+        const char*             name,
+        unsigned                generation
+        )
+{
+    int position;
+    if (!context || !name || !context->changed)
+        return 0;
+    position = option_index_find(context->index, name, strlen(name));
+    if (position < 0)
+        return 0;
+    return context->changed[position] > generation;
+}
@@ -38,34 +38,35 @@
 #include <assert.h>
 
 #include "parse_cmd.h"
-
-/**
- * Stores the encountered options and arguments.
- * \internal
- */
-struct option_context {
-    const char*     program_name;       ///< Stores the name of the program.
-    const char*     program_description;///< A description of the program.
-    cmd_option**    options;            ///< The options specified by the user
-                                        //   on the command line.
-    const cmd_option* predef_options;   ///< The predefined options that
-                                        //   the program accepts.
-    int             n_predef_options;   ///< number of predefined options
-    const char**    args;               ///< The arguments specified on the
-                                        //   command line
-    int             n_options;          ///< Number of options specified
-                                        //   on the command line.
-    int             options_capacity;   ///< Capacity of options storage.
-    int             n_args;             ///< Number of arguments specified.
-    int             arguments_capacity; ///< Capacity of the arguments.
-};
-
+#include "parse_cmd_private.h"
+#include "string_utils.h"
 
 void option_context_free(option_context* context)
 {
+    int i;
     if (context) {
         free(context->options);
         free(context->args);
+        option_index_destroy(context->owned_index);
+        free(context->owned_index);
+        response_files_free(&context->responses);
+        cmd_string_free(&context->split);
+        free(context->sources);
+        for (i = 0; i < context->n_configs; i++)
+            file_map_close(&context->configs[i]);
+        free(context->configs);
+        if (context->file_values) {
+            for (i = 0; i < context->n_predef_options; i++) {
+                if (context->file_values[i]) {
+                    file_map_close(context->file_values[i]);
+                    free(context->file_values[i]);
+                }
+            }
+            free(context->file_values);
+        }
+        free(context->changed);
+        free(context->owned_predef);
+        option_context_help_invalidate(context);
         free(context);
     }
 }
@@ -73,7 +74,7 @@ void option_context_free(option_context* context)
 /*
  * All options but flags take a value.
  */
-static int option_takes_value(cmd_option* option)
+static int option_takes_value(const cmd_option* option)
 {
     return option->option_type != OPT_FLAG ? 1 : 0;
 }
@@ -81,13 +82,11 @@ static int option_takes_value(cmd_option* option)
 /*
  * An option is a short option when it starts with a dash ('-').
  * multiple short options can be specified after the dash.
+ * Only the first two characters are inspected.
  */
 static int is_short_opt(const char* opt)
 {
-    int len = strlen(opt);
-    if (len < 2)
-        return 0;
-    return (opt[0] == '-' && opt[1] != '-') ? 1 : 0;
+    return (opt[0] == '-' && opt[1] != '\0' && opt[1] != '-') ? 1 : 0;
 }
 
 /*
@@ -114,78 +113,144 @@ static int options_add_name(option_context* options, const char* name)
 }
 
 /*
- * Utility to find an equals sign in a string.
+ * Utility to find an equals sign in a string. The string is scanned once,
+ * length receives the number of bytes before the '=' or the end of the
+ * string.
+ *
+ * @ return a pointer to the '=' or NULL when there is none.
  */
-static int find_equals(const char* str)
+static const char* find_equals(const char* str, size_t* length)
 {
     const char* p = str;
-    int ret = -1;
-    while (*p != '\0') {
-        if (*p == '=') {
-            ret = (int)(p - str);
-            break;
-        }
+    while (*p != '\0' && *p != '=')
         p++;
-    }
-    return ret;
+    *length = (size_t)(p - str);
+    return *p == '=' ? p : NULL;
+}
+
+/*
+ * Checks whether a '\0' terminated token is longer than max bytes,
+ * without looking further than max + 1 bytes. A max of 0 means there is
+ * no limit.
+ */
+static int token_exceeds(const char* token, size_t max)
+{
+    size_t i;
+    if (max == 0)
+        return 0;
+    for (i = 0; i <= max; i++)
+        if (token[i] == '\0')
+            return 0;
+    return 1;
 }
 
-static int long_opt_contains_value(const char* str)
+/*
+ * Checks a token against the limits and, with OPTION_FLAG_VALIDATE_UTF8,
+ * its encoding. The offset of the problem in the token is stored in offset.
+ *
+ * \returns OPTION_OK, OPTION_LIMIT_EXCEEDED or OPTION_INVALID_ENCODING.
+ */
+static int
+token_check(const char*             token,
+            const option_limits*    limits,
+            unsigned                flags,
+            int*                    offset
+            )
 {
-    int pos = find_equals(str);
-    return pos >= 0 ? 1 : 0;
+    size_t bad = 0;
+
+    *offset = 0;
+    if (token_exceeds(token, limits->max_token_length))
+        return OPTION_LIMIT_EXCEEDED;
+    if ((flags & OPTION_FLAG_VALIDATE_UTF8) &&
+        utf8_count(token, strlen(token), NULL, &bad) != OPTION_OK) {
+        *offset = (int) bad;
+        return OPTION_INVALID_ENCODING;
+    }
+    return OPTION_OK;
 }
 
 /*
- * Looks between options whether opt is specified
+ * Looks up whether opt is specified in the index.
  *
  * Note make sure not to include the leading "--" of an option.
  *
  * @ return a value >= 0 when it is found and -1 when it isn't found.
  */
 static int find_long_option(const char* opt,
-                            cmd_option* opts,
-                            unsigned    nopts)
+                            size_t length,
+                            const option_index* index)
 {
-    char buffer[BUFSIZ];
-    unsigned i = 0;
-    int ret = -1;
+    return option_index_find(index, opt, length);
+}
 
-    // capture piece of string without =
-    for (i = 0; opt[i] != '\0' && i < BUFSIZ - 1; ++i) {
-        if (opt[i] == '=')
-            break;
-        buffer[i] = opt[i];
-    }
-    buffer[i] = '\0';
+/*
+ * Looks up whether the short option opt is specified in the index.
+ *
+ * @ return a value >= 0 when it is found and -1 when it isn't found.
+ */
+static int find_short_option(char opt, const option_index* index)
+{
+    return option_index_find_short(index, opt);
+}
 
-    for (i = 0; i < nopts; ++i) {
-        if (strcmp(buffer, opts[i].long_opt) == 0) {
-            ret = (int)i;
-            break;
+int
+options_value_follows(
+        const option_index* index,
+        const cmd_option*   predef_opts,
+        const char*         token
+        )
+{
+    int n;
+
+    if (is_long_opt(token)) {
+        size_t name_length;
+        if (find_equals(token + 2, &name_length))
+            return -1;
+        n = find_long_option(token + 2, name_length, index);
+        return n >= 0 && option_takes_value(&predef_opts[n]) ? n : -1;
+    }
+    if (is_short_opt(token)) {
+        // As options_scan(), the first option that takes a value ends the
+        // cluster and takes the rest of the token as value.
+        for (token++; *token != '\0' && *token != '='; token++) {
+            n = find_short_option(*token, index);
+            if (n < 0)
+                return -1;
+            if (option_takes_value(&predef_opts[n]))
+                return token[1] == '\0' ? n : -1;
         }
     }
-    return ret;
+    return -1;
 }
 
 /*
- * Looks between options whether opt is specified
- *
- * @ return a value >= 0 when it is found and -1 when it isn't found.
+ * Adds all predefined options to an index. When a name is used more
+ * than once, the first option wins; just like it would with a linear
+ * search through the options.
  */
-static int find_short_option(char opt,
-                             cmd_option* opts,
-                             unsigned nopts)
-{
-    unsigned i = 0;
-    int ret = -1;
-    for (i = 0; i < nopts; ++i) {
-        if (opt == opts[i].short_opt) {
-            ret = (int)i;
-            break;
+int
+options_build_index(option_index* index, const cmd_option* opts, unsigned nopts)
+{
+    unsigned i;
+    int ret = option_index_init(index, nopts);
+    if (ret)
+        return ret;
+
+    for (i = 0; i < nopts; i++) {
+        if (opts[i].long_opt) {
+            ret = option_index_insert(
+                    index, opts[i].long_opt, strlen(opts[i].long_opt), (int)i
+                    );
+            if (ret == OPTION_OUT_OF_MEM) {
+                option_index_destroy(index);
+                return ret;
+            }
         }
+        if (opts[i].short_opt != '\0')
+            option_index_insert_short(index, opts[i].short_opt, (int)i);
     }
-    return ret;
+    return OPTION_OK;
 }
 
 /**
@@ -228,6 +293,64 @@ static int options_add_parsed_argument(
     return ret;
 }
 
+/*
+ * Converts the string value of an option to the type of the option.
+ *
+ * @ return OPTION_OK, OPTION_MISSING_VALUE when a value is required but
+ *   value is NULL or OPTION_PARSE_ERROR when the value can't be converted.
+ */
+int
+option_convert_value(const cmd_option* option,
+                     const char* value,
+                     option_value* out
+                     )
+{
+    int ret;
+    int intval;
+    double floatval;
+
+    // Check whether a value is required and specified.
+    if (option_takes_value(option) && !value)
+        return OPTION_MISSING_VALUE;
+
+    // Parses the option value if necessary. Or specifies a one
+    // when a flag is found in the integer value.
+    switch (option->option_type) {
+    case OPT_STR:
+        out->string_value = value;
+        break;
+    case OPT_FILE:
+        // The file is opened on first access, only check the syntax here.
+        if (value[0] == '@' && value[1] == '\0')
+            return OPTION_PARSE_ERROR;
+        out->string_value = value;
+        break;
+    case OPT_INT:
+        {
+            char trailing_garbage[2];
+            ret = sscanf(value, "%d%1s", &intval, trailing_garbage);
+            if (ret != 1)
+                return OPTION_PARSE_ERROR;
+        }
+        out->integer_value = intval;
+        break;
+    case OPT_FLOAT:
+        ret = sscanf(value, "%lf", &floatval);
+        if (ret != 1)
+            return OPTION_PARSE_ERROR;
+        out->floating_value = floatval;
+        break;
+    case OPT_FLAG:
+        out->integer_value = 1;
+        break;
+    default:
+        assert(0 == 1); // invalid value specified.
+        return OPTION_WRONG_OPTION_TYPE;
+    }
+
+    return OPTION_OK;
+}
+
 /**
  * \internal
  * When an option is specified to the program, it makes itself
@@ -236,6 +359,8 @@ static int options_add_parsed_argument(
  * \param [in, out] options the option context to add this option to.
  * \param [in]      option the option to add.
  * \param [in]      The string value of its options.
+ *
+ * \returns OPTION_OK, or the error of option_convert_value.
  */
 static int
 options_add_parsed_option(option_context* options,
@@ -243,7 +368,11 @@ options_add_parsed_option(option_context* options,
                           const char* value
                           )
 {
-    int ret;
+    option_value converted;
+    int ret = option_convert_value(option, value, &converted);
+    if (ret)
+        return ret;
+
     /* Increase array size. */
     if (options->n_options + 1 >= options->options_capacity) {
         options->options_capacity *= 2;
@@ -265,208 +394,527 @@ options_add_parsed_option(option_context* options,
         }
     }
     options->options[options->n_options++] = option;
-    int intval;
-    double floatval;
+    option->value = converted;
 
-    // Check whether a value is required and specified.
-    if (option_takes_value(option) && !value) {
-        fprintf(stderr, "option --%s -%c: takes a value.\n",
-            option->long_opt,
-            option->short_opt
-            );
-        return OPTION_PARSE_ERROR;
+    return OPTION_OK;
+}
+
+/*
+ * Returns the sources of the values of the predefined options, they are
+ * tracked from the end of the scan of the command line or from the moment
+ * a second source is merged. Until then all options in the context came
+ * from the command line.
+ */
+static unsigned char*
+options_sources(option_context* options)
+{
+    int i;
+    if (options->sources || options->n_predef_options == 0)
+        return options->sources;
+
+    options->sources = calloc((size_t) options->n_predef_options, 1);
+    if (!options->sources)
+        return NULL;
+    for (i = 0; i < options->n_options; i++) {
+        int pos = (int) (options->options[i] - options->predef_options);
+        options->sources[pos] = OPTION_SOURCE_ARGV;
     }
+    return options->sources;
+}
 
-    // Parses the option value if necessary. Or specifies a one
-    // when a flag is found in the integer value.
-    switch (option->option_type) {
-    case OPT_STR:
-        option->value.string_value = value;
-        break;
-    case OPT_INT:
-        {
-            char trailing_garbage[2];
-            ret = sscanf(value, "%d%1s", &intval, trailing_garbage);
-            if (ret != 1) {
-                fprintf(stderr, "option --%s -%c: expected int argument\n",
-                        option->long_opt,
-                        option->short_opt
-                        );
-                return OPTION_PARSE_ERROR;
-            }
-        }
-        option->value.integer_value = intval;
-        break;
-    case OPT_FLOAT:
-        ret = sscanf(value, "%lf", &floatval);
-        if (ret != 1) {
-            fprintf(stderr, "option --%s -%c: expected float argument\n",
-                option->long_opt,
-                option->short_opt
-            );
-            return OPTION_PARSE_ERROR;
+/*
+ * Takes a flag that a source switched off out of the options specified.
+ */
+static void
+options_remove_option(option_context* options, cmd_option* option)
+{
+    int i;
+    for (i = 0; i < options->n_options; i++) {
+        if (options->options[i] == option) {
+            memmove(&options->options[i], &options->options[i + 1],
+                    (size_t) (options->n_options - i - 1) * sizeof(cmd_option*)
+                    );
+            options->n_options--;
+            break;
         }
-        option->value.floating_value = floatval;
-        break;
-    case OPT_FLAG:
-        option->value.integer_value = 1;
-        break;
-    default:
-        assert(0 == 1); // invalid value specified.
-        return OPTION_WRONG_OPTION_TYPE;
     }
-
-    return OPTION_OK;
+    option->value.integer_value = 0;
 }
 
-int options_parse(option_context**  ppoptions,
-                  int               argc,
-                  const char* const* argv,
-                  cmd_option*       predef_opts,
-                  unsigned          n_opts
-                  )
+int
+options_merge_option(option_context*    options,
+                     int                position,
+                     const char*        value,
+                     int                source
+                     )
 {
-    int i, n, ret =  OPTION_OK;
-    option_context* options = NULL;
+    // The context got the predefined options as mutable array.
+    cmd_option* option = (cmd_option*) &options->predef_options[position];
+    unsigned char* sources = options_sources(options);
+    option_value converted;
+    int ret;
 
-    // Check whether arguments are specified
-    if (argc < 1 || !argv) {
-        fprintf(stderr, "argc and argv should reflect a program name\n");
-        return OPTION_INVALID_ARGUMENT;
+    if (!sources)
+        return OPTION_OUT_OF_MEM;
+    if (source < (sources[position] & ~OPTION_SOURCE_CLEARED))
+        return OPTION_OK;   // A more important source has set the option.
+
+    if (option->option_type == OPT_FLAG && option_value_is_false(value)) {
+        if (sources[position] != OPTION_SOURCE_NONE &&
+            !(sources[position] & OPTION_SOURCE_CLEARED))
+            options_remove_option(options, option);
+        sources[position] = (unsigned char) (source | OPTION_SOURCE_CLEARED);
+        return OPTION_OK;
     }
 
-    if (*ppoptions) {
-        fprintf(stderr, "parse_options: *options != NULL\n");
-        return OPTION_INVALID_ARGUMENT;
+    if (sources[position] == OPTION_SOURCE_NONE ||
+        (sources[position] & OPTION_SOURCE_CLEARED)) {
+        ret = options_add_parsed_option(options, option, value);
     }
-
-    // Allocate the necessary memory.
-    *ppoptions = malloc(sizeof(option_context));
-    if (!(*ppoptions)) {
-        free(*ppoptions);
-        fprintf(stderr, "parse_options: out of memory\n");
-        return OPTION_OUT_OF_MEM;
+    else {
+        ret = option_convert_value(option, value, &converted);
+        if (ret == OPTION_OK)
+            option->value = converted;
     }
+    if (ret == OPTION_OK)
+        sources[position] = (unsigned char) source;
+    return ret;
+}
 
-    options = *ppoptions;
-    memset(options, 0, sizeof(option_context));
+/**
+ * \internal
+ * Describes an option found by the parser.
+ */
+typedef struct parse_event {
+    cmd_option* option;         ///< The option found.
+    int         position;       ///< The index of the predefined option.
+    const char* value;          ///< The value or NULL if there is none.
+    int         argv_index;     ///< Where the option is named.
+    int         offset;         ///< Byte offset of the name in its token.
+    int         value_index;    ///< The token of the value or -1.
+    int         value_offset;   ///< Byte offset of the value in its token.
+} parse_event;
 
-    options_add_name(options, argv[0]);
-    options->predef_options  = predef_opts;
-    options->n_predef_options= n_opts;
+/**
+ * \internal
+ * The parser reports the options, arguments and errors it encounters
+ * to a parse_sink. The sink decides what to do with them, this way
+ * the same parser is used to build an option_context or to only
+ * validate the command line.
+ */
+typedef struct parse_sink parse_sink;
+
+struct parse_sink {
+    /**
+     * Called for each option found, value is NULL when the option is a flag
+     * or when the value is missing from the command line.
+     * \returns OPTION_OK to continue parsing.
+     */
+    int (*option)(parse_sink* sink, const parse_event* event);
+    /**
+     * Called for each argument found.
+     * \returns OPTION_OK to continue parsing.
+     */
+    int (*argument)(parse_sink* sink, const char* argument, int argv_index);
+    /**
+     * Called when argv[argv_index] can't be parsed from byte offset onward.
+     * \returns OPTION_OK to continue parsing.
+     */
+    int (*error)(parse_sink* sink, int error, int argv_index, int offset);
+};
+
+/*
+ * Walks over the command line and reports everything to the sink.
+ *
+ * Every token is inspected in time linear to its length, limits and,
+ * with OPTION_FLAG_VALIDATE_UTF8, the encoding are checked before a token
+ * is interpreted.
+ *
+ * \returns OPTION_OK or the first non zero value returned by the sink.
+ */
+static int
+options_scan(const option_index*    index,
+             cmd_option*            predef_opts,
+             int                    argc,
+             const char* const*     argv,
+             const option_limits*   limits,
+             unsigned               flags,
+             parse_sink*            sink
+             )
+{
+    int i, n, problem, offset, ret = OPTION_OK;
+    parse_event event;
 
-    for (i = 1; i < argc; i++) {
+    for (i = 1; i < argc && ret == OPTION_OK; i++) {
 
         const char *opt_value;
-        cmd_option* option;
+
+        event.argv_index    = i;
+        event.value_index   = -1;
+        event.value_offset  = -1;
+
+        problem = token_check(argv[i], limits, flags, &offset);
+        if (problem) {
+            ret = sink->error(sink, problem, i, offset);
+            continue;
+        }
 
         /* We typically first test whether it is an long or short option
          * Then we test whether we know it. If it isn't an option. It
          * is an argument to the program.
          */
-        if (is_long_opt(argv[i]) && long_opt_contains_value(argv[i])) {
-            const char* opt = argv[i];
-            opt += 2; // skip leading "--"
-            n = find_long_option(opt, predef_opts, n_opts);
-            if (n < 0) {
-                fprintf(stderr, "Unknown option \"%s\"\n", argv[i]);
-                ret = OPTION_UNKNOWN;
-                break;
-            }
-            option = &predef_opts[n];
-            opt_value = argv[i];
-            opt_value += find_equals(opt_value) + 1;
-            ret = options_add_parsed_option(options, option, opt_value);
-            if (ret)
-                break;
-        }
-        else if (is_long_opt(argv[i])) {
+        if (is_long_opt(argv[i])) {
             // skip "--"
             const char* opt_start = argv[i] + 2;
-            if (i + 1 < argc)
-                opt_value = argv[i + 1];
-            else
-                opt_value = NULL;
+            size_t name_length;
+            const char* equals = find_equals(opt_start, &name_length);
 
-            n = find_long_option(opt_start, predef_opts, n_opts);
+            n = find_long_option(opt_start, name_length, index);
             if (n < 0) {
-                fprintf(stderr, "Unknown option \"%s\"\n", argv[i]);
-                ret = OPTION_UNKNOWN;
-                break;
+                ret = sink->error(sink, OPTION_UNKNOWN, i, 2);
+                continue;
             }
-            option = &predef_opts[n];
-            if (option_takes_value(option))
-            {
-                ret = options_add_parsed_option(options, option, opt_value);
-                i++;
+            opt_value = NULL;
+            if (equals) {
+                opt_value = equals + 1;
+                event.value_index   = i;
+                event.value_offset  = (int)(opt_value - argv[i]);
             }
-            else {
-                ret = options_add_parsed_option(options, option, NULL);
+            else if (option_takes_value(&predef_opts[n]) && i + 1 < argc) {
+                problem = token_check(argv[i + 1], limits, flags, &offset);
+                if (problem) {
+                    ret = sink->error(sink, problem, ++i, offset);
+                    continue;
+                }
+                opt_value = argv[++i];
+                event.value_index   = i;
+                event.value_offset  = 0;
             }
         } 
         else if (is_short_opt(argv[i])) {
             // skip '-'
             const char* opt_start = argv[i] + 1;
-            while (*opt_start != '\0' && *opt_start != '=') {
+            int opt_index = i;
+            unsigned cluster = 0;
+            while (*opt_start != '\0' && *opt_start != '=' && ret == OPTION_OK) {
                 char c = *opt_start;
-                n = find_short_option(c, predef_opts, n_opts);
+                int char_offset = (int)(opt_start - argv[opt_index]);
+                if (limits->max_cluster_length &&
+                    ++cluster > limits->max_cluster_length) {
+                    ret = sink->error(
+                            sink, OPTION_LIMIT_EXCEEDED, opt_index, char_offset
+                            );
+                    break;
+                }
+                n = find_short_option(c, index);
                 if (n < 0) {
-                    fprintf(stderr, "Unknown option -%c\n", c);
-                    ret = OPTION_UNKNOWN;
+                    // the rest of the cluster can't be interpreted.
+                    ret = sink->error(
+                            sink, OPTION_UNKNOWN, opt_index, char_offset
+                            );
                     break;
                 }
-                option = &predef_opts[n];
-                if (option_takes_value(option)) {
+                event.option    = &predef_opts[n];
+                event.position  = n;
+                event.offset    = char_offset;
+                event.value     = NULL;
+                if (option_takes_value(event.option)) {
                     // by default the rest of the options are the argument.
                     opt_value = opt_start + 1;
                     // If there are no more characters, the next item in argv
                     // is the argument.
                     if (*opt_value == '\0') {
-                        i++;
-                        if (i< argc)
-                            opt_value = argv[i];
-                        else{
-                            fprintf(stderr,
-                                    "Option -%c expected an argument\n",
-                                    c
+                        opt_value = NULL;
+                        if (i + 1 < argc) {
+                            problem = token_check(
+                                    argv[i + 1], limits, flags, &offset
                                     );
-                            return OPTION_PARSE_ERROR;
+                            if (problem) {
+                                ret = sink->error(sink, problem, ++i, offset);
+                                break;
+                            }
+                            opt_value = argv[++i];
+                            event.value_index   = i;
+                            event.value_offset  = 0;
                         }
                     }
-                    // If the argument starts with '=', the next character is
-                    // the argument.
-                    else if (*opt_value == '=')
-                        opt_value++;
-
-                    ret = options_add_parsed_option(
-                            options,
-                            option,
-                            opt_value
-                            );
+                    else {
+                        // If the argument starts with '=', the next character
+                        // is the argument.
+                        if (*opt_value == '=')
+                            opt_value++;
+                        event.value_index   = opt_index;
+                        event.value_offset  = (int)(opt_value - argv[opt_index]);
+                    }
+                    event.value = opt_value;
+                    ret = sink->option(sink, &event);
                     break;
-                } else {
-                    ret = options_add_parsed_option(
-                            options,
-                            option,
-                            NULL
-                            );
                 }
-
+                ret = sink->option(sink, &event);
                 opt_start++;
             }
-            
-            if (ret != OPTION_OK)
-                break;
+            continue;
         }
         else { // is an argument not an option with optional value
-            ret = options_add_parsed_argument(options, argv[i]);
-            if (ret != OPTION_OK)
-                break;
+            ret = sink->argument(sink, argv[i], i);
+            continue;
+        }
+
+        // A long option was found.
+        event.option    = &predef_opts[n];
+        event.position  = n;
+        event.offset    = 2;
+        event.value     = opt_value;
+        ret = sink->option(sink, &event);
+    }
+
+    return ret;
+}
+
+/*
+ * Describes the problem with the value of an option, the location points
+ * at the value if there is one, otherwise at the option.
+ */
+static void
+diagnostic_from_event(option_diagnostic* diag, int error, const parse_event* event)
+{
+    diag->error         = error;
+    diag->option_index  = event->position;
+    if (error != OPTION_MISSING_VALUE && event->value_index >= 0) {
+        diag->argv_index    = event->value_index;
+        diag->byte_offset   = event->value_offset;
+    }
+    else {
+        diag->argv_index    = event->argv_index;
+        diag->byte_offset   = event->offset;
+    }
+}
+
+/**
+ * \internal
+ * A parse_sink that stores everything in an option_context and stops
+ * at the first error.
+ */
+typedef struct context_sink {
+    parse_sink          base;       ///< The callbacks of the sink.
+    option_context*     options;    ///< The context to store the results in.
+    const char* const*  argv;       ///< The command line being parsed.
+    const option_parse_settings* settings; ///< How to report problems.
+} context_sink;
+
+static int
+context_sink_option(parse_sink* sink, const parse_event* event)
+{
+    context_sink* self = (context_sink*) sink;
+    option_diagnostic diag;
+    int ret = options_add_parsed_option(
+            self->options, event->option, event->value
+            );
+    if (ret == OPTION_OK || ret == OPTION_OUT_OF_MEM)
+        return ret;
+
+    diagnostic_from_event(&diag, ret, event);
+    options_report(
+            self->settings, &diag, self->argv, self->options->predef_options
+            );
+    // Keep the return value of older versions.
+    return ret == OPTION_MISSING_VALUE ? OPTION_PARSE_ERROR : ret;
+}
+
+/**
+ * \internal
+ * The state of the arguments streamed in place of a "-" argument.
+ */
+typedef struct context_stream {
+    context_sink*   sink;       ///< The sink of the parse.
+    int             argv_index; ///< The "-" that is replaced.
+    int             stopped;    ///< Whether the callback or a reported
+                                //   problem stopped the stream.
+} context_stream;
+
+static int context_sink_error(
+        parse_sink* sink, int error, int argv_index, int offset
+        );
+
+/*
+ * Checks a streamed argument like an item of the command line before it
+ * is handed to the callback of the stream.
+ */
+static int
+context_stream_argument(void* data, const char* argument, size_t length)
+{
+    context_stream* self = data;
+    const option_parse_settings* settings = self->sink->settings;
+    int offset, problem;
+
+    problem = token_check(argument, &settings->limits, settings->flags, &offset);
+    if (problem) {
+        self->stopped = 1;
+        // The offset refers to the "-" that the argument replaces.
+        return context_sink_error(&self->sink->base, problem, self->argv_index, 0);
+    }
+    problem = settings->stream->callback(settings->stream->data, argument, length);
+    if (problem)
+        self->stopped = 1;
+    return problem;
+}
+
+/*
+ * Replaces the "-" at argv_index by the arguments of the stream.
+ */
+static int
+context_sink_stream(context_sink* sink, int argv_index)
+{
+    const option_argument_stream* stream = sink->settings->stream;
+    context_stream state = {sink, argv_index, 0};
+    int ret;
+
+    if (!stream->callback)
+        return context_sink_error(
+                &sink->base, OPTION_INVALID_ARGUMENT, argv_index, 0
+                );
+    ret = options_stream_arguments(
+            stream->fd, stream->delimiter, stream->buffer_size,
+            context_stream_argument, &state
+            );
+    // A problem with the input itself, e.g. an argument that doesn't fit
+    // in a buffer.
+    if (ret && !state.stopped)
+        return context_sink_error(&sink->base, ret, argv_index, 0);
+    return ret;
+}
+
+static int
+context_sink_argument(parse_sink* sink, const char* argument, int argv_index)
+{
+    context_sink* self = (context_sink*) sink;
+    if (self->settings && self->settings->stream &&
+        strcmp(argument, "-") == 0)
+        return context_sink_stream(self, argv_index);
+    return options_add_parsed_argument(self->options, argument);
+}
+
+static int
+context_sink_error(parse_sink* sink, int error, int argv_index, int offset)
+{
+    context_sink* self = (context_sink*) sink;
+    option_diagnostic diag = {error, argv_index, offset, -1};
+    if (error == OPTION_UNKNOWN && self->settings &&
+        (self->settings->flags & OPTION_FLAG_IGNORE_UNKNOWN))
+        return OPTION_OK;
+    options_report(
+            self->settings, &diag, self->argv, self->options->predef_options
+            );
+    return error;
+}
+
+/*
+ * Reports a problem that isn't related to a token of the command line.
+ */
+static int
+options_report_general(const option_parse_settings* settings, int error)
+{
+    option_diagnostic diag = {error, -1, 0, -1};
+    options_report(settings, &diag, NULL, NULL);
+    return error;
+}
+
+/*
+ * Parses the command line with the predefined options. When index is NULL
+ * the context builds and owns an index of the predefined options, otherwise
+ * the context borrows index.
+ */
+static int
+options_parse_schema(option_context**   ppoptions,
+                     int                argc,
+                     const char* const* argv,
+                     cmd_option*        predef_opts,
+                     unsigned           n_opts,
+                     const option_index* index,
+                     const option_parse_settings* settings
+                     )
+{
+    int ret =  OPTION_OK;
+    option_context* options = NULL;
+    const option_limits no_limits = {0, 0, 0};
+    const option_limits* limits = settings ? &settings->limits : &no_limits;
+    context_sink sink = {
+        {context_sink_option, context_sink_argument, context_sink_error}
+    };
+
+    // Check whether arguments are specified
+    if (argc < 1 || !argv || !ppoptions || *ppoptions)
+        return options_report_general(settings, OPTION_INVALID_ARGUMENT);
+
+    if (limits->max_argc && (unsigned) argc > limits->max_argc)
+        return options_report_general(settings, OPTION_LIMIT_EXCEEDED);
+
+    // Allocate the necessary memory.
+    *ppoptions = malloc(sizeof(option_context));
+    if (!(*ppoptions))
+        return options_report_general(settings, OPTION_OUT_OF_MEM);
+
+    options = *ppoptions;
+    memset(options, 0, sizeof(option_context));
+
+    options_add_name(options, argv[0]);
+    options->predef_options  = predef_opts;
+    options->n_predef_options= n_opts;
+
+    if (index) {
+        options->index = index;
+    }
+    else {
+        options->owned_index = malloc(sizeof(option_index));
+        if (options->owned_index)
+            ret = options_build_index(options->owned_index, predef_opts, n_opts);
+        if (!options->owned_index || ret) {
+            free(options->owned_index);
+            free(options);
+            *ppoptions = NULL;
+            return options_report_general(settings, OPTION_OUT_OF_MEM);
+        }
+        options->index = options->owned_index;
+    }
+
+    if (settings && (settings->flags & OPTION_FLAG_RESPONSE_FILES)) {
+        option_diagnostic diag;
+        ret = response_files_expand(
+                &options->responses, argc, argv, options->index, predef_opts,
+                &diag
+                );
+        if (ret) {
+            options_report(settings, &diag, argv, predef_opts);
+            option_context_free(options);
+            *ppoptions = NULL;
+            return ret;
         }
+        argc = options->responses.argc;
+        argv = options->responses.argv;
     }
+    options->argc = argc;
+    options->argv = argv;
+
+    sink.options    = options;
+    sink.argv       = argv;
+    sink.settings   = settings;
+    ret = options_scan(
+            options->index, predef_opts, argc, argv, limits,
+            settings ? settings->flags : 0, &sink.base
+            );
+
+    if (ret == OPTION_OK && settings && settings->env_prefix)
+        ret = options_merge_environment(options, settings);
+
+    // Lets option_context_find_option() look options up in O(1), without
+    // the sources it falls back to a scan.
+    if (ret == OPTION_OK)
+        options_sources(options);
 
     // Error parsing options clean the rubbish.
     if (ret != OPTION_OK) {
+        if (ret == OPTION_OUT_OF_MEM)
+            options_report_general(settings, ret);
         option_context_free(options);
         *ppoptions = NULL;
     }
@@ -474,6 +922,256 @@ int options_parse(option_context**  ppoptions,
     return ret;
 }
 
+/**
+ * \internal
+ * A parse_sink that only records diagnostics, it keeps going after
+ * an error in order to find all of them.
+ */
+typedef struct validate_sink {
+    parse_sink          base;       ///< The callbacks of the sink.
+    option_diagnostics  diagnostics;///< Storage for the diagnostics.
+} validate_sink;
+
+static int
+validate_sink_option(parse_sink* sink, const parse_event* event)
+{
+    validate_sink* self = (validate_sink*) sink;
+    option_value converted;
+    int ret = option_convert_value(event->option, event->value, &converted);
+    if (ret) {
+        option_diagnostic diag;
+        diagnostic_from_event(&diag, ret, event);
+        option_diagnostics_add(&self->diagnostics, &diag);
+    }
+    return OPTION_OK;
+}
+
+static int
+validate_sink_argument(parse_sink* sink, const char* argument, int argv_index)
+{
+    (void) sink;
+    (void) argument;
+    (void) argv_index;
+    return OPTION_OK;
+}
+
+static int
+validate_sink_error(parse_sink* sink, int error, int argv_index, int offset)
+{
+    validate_sink* self = (validate_sink*) sink;
+    option_diagnostic diag = {error, argv_index, offset, -1};
+    option_diagnostics_add(&self->diagnostics, &diag);
+    return OPTION_OK;
+}
+
+int options_parse(option_context**  ppoptions,
+                  int               argc,
+                  const char* const* argv,
+                  cmd_option*       predef_opts,
+                  unsigned          n_opts
+                  )
+{
+    return options_parse_schema(
+            ppoptions, argc, argv, predef_opts, n_opts, NULL, NULL
+            );
+}
+
+int options_parse_ex(option_context**               ppoptions,
+                     int                            argc,
+                     const char* const*             argv,
+                     cmd_option*                    predef_opts,
+                     unsigned                       n_opts,
+                     const option_parse_settings*   settings
+                     )
+{
+    return options_parse_schema(
+            ppoptions, argc, argv, predef_opts, n_opts, NULL, settings
+            );
+}
+
+int options_parse_string(option_context**               ppoptions,
+                         const char*                    prog_name,
+                         char*                          command,
+                         cmd_option*                    predef_opts,
+                         unsigned                       n_opts,
+                         const option_parse_settings*   settings
+                         )
+{
+    cmd_string split;
+    size_t offset = 0;
+    int ret;
+
+    if (!prog_name || !command)
+        return options_report_general(settings, OPTION_INVALID_ARGUMENT);
+
+    memset(&split, 0, sizeof(cmd_string));
+    ret = cmd_string_split(&split, prog_name, command, &offset);
+    if (ret) {
+        option_diagnostic diag = {ret, -1, (int) offset, -1};
+        options_report(settings, &diag, NULL, NULL);
+        cmd_string_free(&split);
+        return ret;
+    }
+
+    ret = options_parse_schema(
+            ppoptions, split.argc, split.argv, predef_opts, n_opts, NULL,
+            settings
+            );
+    if (ret) {
+        cmd_string_free(&split);
+        return ret;
+    }
+    (*ppoptions)->split = split;
+    return OPTION_OK;
+}
+
+int options_parse_registry(option_context**     ppoptions,
+                           int                  argc,
+                           const char* const*   argv,
+                           option_registry*     registry
+                           )
+{
+    if (!registry)
+        return options_report_general(NULL, OPTION_INVALID_ARGUMENT);
+
+    return options_parse_schema(
+            ppoptions,
+            argc,
+            argv,
+            registry->options,
+            (unsigned) registry->n_options,
+            &registry->index,
+            NULL
+            );
+}
+
+int options_parse_registry_ex(option_context**               ppoptions,
+                              int                            argc,
+                              const char* const*             argv,
+                              option_registry*               registry,
+                              const option_parse_settings*   settings
+                              )
+{
+    if (!registry)
+        return options_report_general(settings, OPTION_INVALID_ARGUMENT);
+
+    return options_parse_schema(
+            ppoptions,
+            argc,
+            argv,
+            registry->options,
+            (unsigned) registry->n_options,
+            &registry->index,
+            settings
+            );
+}
+
+/*
+ * Validates the command line and records the problems in diags.
+ */
+static int
+options_validate_schema(int                 argc,
+                        const char* const*  argv,
+                        const cmd_option*   predef_opts,
+                        unsigned            n_opts,
+                        const option_index* index,
+                        const option_limits* limits,
+                        unsigned            flags,
+                        option_diagnostics* diags
+                        )
+{
+    int ret;
+    option_index built;
+    validate_sink sink = {
+        {validate_sink_option, validate_sink_argument, validate_sink_error}
+    };
+
+    if (argc < 1 || !argv || !diags || (!diags->records && diags->capacity))
+        return OPTION_INVALID_ARGUMENT;
+
+    sink.diagnostics = *diags;
+    sink.diagnostics.count = 0;
+
+    // Rejecting a huge command line should be cheap.
+    if (limits->max_argc && (unsigned) argc > limits->max_argc) {
+        option_diagnostic diag = {OPTION_LIMIT_EXCEEDED, -1, 0, -1};
+        option_diagnostics_add(&sink.diagnostics, &diag);
+    }
+    else {
+        // A registry brings its index, otherwise one is built for this call.
+        if (!index) {
+            ret = options_build_index(&built, predef_opts, n_opts);
+            if (ret)
+                return ret;
+        }
+
+        // The validate sink doesn't modify the options.
+        options_scan(
+                index ? index : &built, (cmd_option*) predef_opts, argc, argv,
+                limits, flags, &sink.base
+                );
+        if (!index)
+            option_index_destroy(&built);
+    }
+
+    diags->count = sink.diagnostics.count;
+    if (diags->count == 0)
+        return OPTION_OK;
+    if (diags->capacity > 0)
+        return diags->records[0].error;
+    return OPTION_PARSE_ERROR;
+}
+
+int options_validate(int                 argc,
+                     const char* const*  argv,
+                     const cmd_option*   predef_opts,
+                     unsigned            n_opts,
+                     option_diagnostic*  diagnostics,
+                     unsigned            max_diagnostics,
+                     unsigned*           n_diagnostics
+                     )
+{
+    int ret;
+    const option_limits no_limits = {0, 0, 0};
+    option_diagnostics diags = {diagnostics, max_diagnostics, 0};
+
+    ret = options_validate_schema(
+            argc, argv, predef_opts, n_opts, NULL, &no_limits, 0, &diags
+            );
+    if (n_diagnostics)
+        *n_diagnostics = diags.count;
+    return ret;
+}
+
+int options_validate_ex(int                             argc,
+                        const char* const*              argv,
+                        const cmd_option*               predef_opts,
+                        unsigned                        n_opts,
+                        const option_parse_settings*    settings
+                        )
+{
+    if (!settings || !settings->diagnostics)
+        return OPTION_INVALID_ARGUMENT;
+    return options_validate_schema(
+            argc, argv, predef_opts, n_opts, NULL, &settings->limits,
+            settings->flags, settings->diagnostics
+            );
+}
+
+int options_validate_registry(int                             argc,
+                              const char* const*              argv,
+                              const option_registry*          registry,
+                              const option_parse_settings*    settings
+                              )
+{
+    if (!registry || !settings || !settings->diagnostics)
+        return OPTION_INVALID_ARGUMENT;
+    return options_validate_schema(
+            argc, argv, registry->options, (unsigned) registry->n_options,
+            &registry->index, &settings->limits, settings->flags,
+            settings->diagnostics
+            );
+}
 
 int
 option_context_str_value(
@@ -556,17 +1254,22 @@ option_context_float_value(
 cmd_option*
 option_context_find_option(const option_context* context, const char* name)
 {
-    int i, ret = -1;
+    int i, position;
+
+    // The sources tell in O(1) whether the option was specified.
+    if (context->index && context->sources) {
+        position = option_index_find(context->index, name, strlen(name));
+        if (position < 0 ||
+            context->sources[position] == OPTION_SOURCE_NONE ||
+            (context->sources[position] & OPTION_SOURCE_CLEARED))
+            return NULL;
+        return (cmd_option*) &context->predef_options[position];
+    }
     for (i = 0; i < context->n_options; i++) {
-        if (strcmp(name, context->options[i]->long_opt) == 0) {
-            ret = i;
-            break;
-        }
+        if (strcmp(name, context->options[i]->long_opt) == 0)
+            return context->options[i];
     }
-    if (ret >= 0)
-        return context->options[ret];
-    else
-        return NULL;
+    return NULL;
 }
 
 int
@@ -576,6 +1279,16 @@ option_context_have_option(const option_context* context, const char* name)
     return option_context_find_option(context, name) != NULL;
 }
 
+const char* const*
+option_context_argv(const option_context* context, int* argc)
+{
+    if (!context)
+        return NULL;
+    if (argc)
+        *argc = context->argc;
+    return context->argv;
+}
+
 int option_context_nargs(const option_context* context)
 {
     assert(context);
@@ -629,8 +1342,10 @@ option_context_set_description(
         const char* description
         )
 {
-    if (options)
+    if (options) {
         options->program_description = description;
+        option_context_help_invalidate(options);
+    }
 }
 
 const char* option_context_prog_name(const option_context* context)
@@ -23,6 +23,9 @@
 #ifndef PARSE_CMD_H
 #define PARSE_CMD_H
 
+#include <stddef.h>
+#include <stdio.h>
+
 #include "parse_cmd_export.h"
 
 #ifdef __cplusplus
@@ -36,7 +39,8 @@ enum OPTION_VALUE_TYPES {
     OPT_STR,    ///< Option value is a string (requires argument).
     OPT_INT,    ///< Option value is an int (requires argument).
     OPT_FLOAT,  ///< Option value is a floating point number (req arg).
-    OPT_FLAG    ///< Option is use as a flag don't specify a argument.
+    OPT_FLAG,   ///< Option is use as a flag don't specify a argument.
+    OPT_FILE    ///< Option value is a file "@path" or literal text (req arg).
 };
 
 /**
@@ -52,7 +56,12 @@ enum OPTION_RET_VAL {
     OPTION_INVALID_ARGUMENT, ///< An invalid argument to a function was specified.
     OPTION_UNKNOWN,          ///< An unknown option encountered.
     OPTION_NOT_SPECIFIED,    ///< asking for the value of a unspecified option.
-    OPTION_INVALID_ENCODING  ///< Encountered text which wasn't encoded validly.
+    OPTION_INVALID_ENCODING, ///< Encountered text which wasn't encoded validly.
+    OPTION_DUPLICATE,        ///< An option with the same name already exists.
+    OPTION_MISSING_VALUE,    ///< An option that takes a value didn't get one.
+    OPTION_LIMIT_EXCEEDED,   ///< The input exceeds a configured limit.
+    OPTION_FILE_ERROR,       ///< A file couldn't be opened or read.
+    OPTION_RECURSIVE_FILE    ///< A file includes itself (indirectly).
 };
 
 /**
@@ -78,9 +87,189 @@ typedef struct cmd_option {
     const char*     help;       ///< Describes the option.
 } cmd_option;
 
+/**
+ * Describes one problem found on the command line.
+ */
+typedef struct option_diagnostic {
+    int error;          ///< An OPTION_RET_VAL that describes the problem.
+    int argv_index;     ///< The index in argv of the offending token or -1
+                        //   when the problem isn't related to a token.
+    int byte_offset;    ///< The offset in the token where the problem is.
+    int option_index;   ///< The index of the predefined option involved
+                        //   or -1 when the option is unknown.
+} option_diagnostic;
+
+/**
+ * Caller owned storage for diagnostics.
+ *
+ * When more problems are found than fit in records, the remaining ones
+ * are only counted.
+ */
+typedef struct option_diagnostics {
+    option_diagnostic*  records;    ///< Storage for capacity diagnostics.
+    unsigned            capacity;   ///< The number of records available.
+    unsigned            count;      ///< The number of problems found, this
+                                    //   may exceed capacity.
+} option_diagnostics;
+
+/**
+ * Flags that change how the command line is parsed.
+ */
+enum OPTION_PARSE_FLAGS {
+    OPTION_FLAG_SILENT = 1 << 0,        ///< Don't print problems to stderr.
+    /**
+     * Items of the command line of the form "@file" are replaced by the
+     * items in file. The file is mapped into memory and the items point
+     * into the mapping, which stays valid until the option_context is
+     * freed. Items are separated by white space, text between single
+     * quotes is taken literally and elsewhere a backslash takes the next
+     * character literally. Response files may include other response
+     * files. The argv_index of diagnostics refers to the expanded command
+     * line, except for problems with the response files themselves.
+     * The value of an OPT_FILE option, as in "--key @path" or "-k @path",
+     * isn't expanded, it names the file of the value.
+     */
+    OPTION_FLAG_RESPONSE_FILES = 1 << 1,
+    /**
+     * Options that aren't predefined are skipped instead of being an
+     * error. This is meant for code that parses only its own options from
+     * a command line that belongs to someone else, see
+     * options_parse_process(). The value of a skipped option can't be
+     * told apart from an argument.
+     */
+    OPTION_FLAG_IGNORE_UNKNOWN = 1 << 2,
+    /**
+     * Every item of the command line must be valid UTF-8, otherwise it is
+     * an OPTION_INVALID_ENCODING error at the first invalid byte. Runs of
+     * ASCII are checked many bytes at a time, so this costs little more
+     * than reading the command line.
+     */
+    OPTION_FLAG_VALIDATE_UTF8 = 1 << 3
+};
+
+/**
+ * Limits on the size of a command line, a value of 0 means unlimited.
+ *
+ * The limits are checked before a token is interpreted, so a command line
+ * from an untrusted source can be rejected cheaply. A token that exceeds
+ * a limit is reported as OPTION_LIMIT_EXCEEDED.
+ */
+typedef struct option_limits {
+    unsigned    max_argc;           ///< Maximum number of items in argv.
+    size_t      max_token_length;   ///< Maximum length of one item in bytes.
+    unsigned    max_cluster_length; ///< Maximum number of short options
+                                    //   combined in one item e.g. "-abc".
+} option_limits;
+
+/**
+ * Receives the arguments read by options_stream_arguments() or by a parse
+ * with an option_argument_stream.
+ *
+ * \param[in] data     The data passed to options_stream_arguments() or
+ *                     the data of the option_argument_stream.
+ * \param[in] argument The argument, it is terminated by a '\0' and is
+ *                     only valid during the call.
+ * \param[in] length   The length of argument in bytes.
+ *
+ * \returns 0 to continue, any other value stops reading and is returned
+ *          by options_stream_arguments() or the parse.
+ */
+typedef int (*option_argument_callback)(
+        void*       data,
+        const char* argument,
+        size_t      length
+        );
+
+/**
+ * Reads the arguments that replace a "-" argument of the command line from
+ * a file descriptor, e.g. for "find -print0 | tool --from0 -".
+ *
+ * The arguments are read as by options_stream_arguments(), so the memory
+ * used doesn't depend on the size of the input. Every argument is checked
+ * like an item of the command line, against the limits and, with
+ * OPTION_FLAG_VALIDATE_UTF8, its encoding, a problem is reported at the
+ * "-". The arguments aren't stored in the option_context, they are handed
+ * to the callback in order.
+ */
+typedef struct option_argument_stream {
+    int                         fd;         ///< Is read, it isn't closed.
+    char                        delimiter;  ///< Typically '\0' or '\n'.
+    size_t                      buffer_size;///< 0 for the default of 1 MiB.
+    option_argument_callback    callback;   ///< Receives the arguments.
+    void*                       data;       ///< Passed to the callback.
+} option_argument_stream;
+
+/**
+ * Settings for options_parse_ex(), a zero initialized struct gives the
+ * behavior of options_parse().
+ */
+typedef struct option_parse_settings {
+    unsigned            flags;      ///< A combination of OPTION_PARSE_FLAGS.
+    option_diagnostics* diagnostics;///< When not NULL problems are recorded
+                                    //   here.
+    option_limits       limits;     ///< Limits on the command line.
+    /**
+     * When not NULL, options are also set by the environment variables
+     * whose names start with env_prefix. The rest of the name is
+     * lowercased and its underscores become dashes, so with the prefix
+     * "MYTOOL_" the variable MYTOOL_OUTPUT_DIR sets --output-dir. Options
+     * on the command line take precedence. A variable that is empty, "0",
+     * "false", "no" or "off" switches a flag off, also when a
+     * configuration file sets it.
+     */
+    const char*         env_prefix;
+    const char* const*  environment;///< The NULL terminated "NAME=value"
+                                    //   strings to use instead of the
+                                    //   environment of the process.
+    /**
+     * When not NULL, a "-" argument is replaced by the arguments read from
+     * the stream. A non zero return value of its callback stops the parse,
+     * which then returns that value.
+     */
+    const option_argument_stream* stream;
+} option_parse_settings;
+
 /// typedef for struct option_context
 typedef struct option_context option_context;
 
+/**
+ * The number of options an option_overlay can override.
+ */
+#define OPTION_OVERLAY_CAPACITY 8
+
+/**
+ * An option overridden by an option_overlay.
+ */
+typedef struct option_override {
+    int             position;   ///< The predefined option.
+    int             specified;  ///< 0 when the override hides the option.
+    option_value    value;      ///< The value of the option.
+} option_override;
+
+/**
+ * A context that overrides a few options of a parent option_context.
+ *
+ * Options that aren't overridden are read from the parent, which isn't
+ * modified and may be shared between threads. An overlay is small enough
+ * to live on the stack, see option_overlay_init(). Treat the members as
+ * private.
+ */
+typedef struct option_overlay {
+    const option_context*   parent;     ///< The context that is overlaid.
+    unsigned                count;      ///< The number of overrides.
+    option_override         overrides[OPTION_OVERLAY_CAPACITY];
+                                        ///< The overridden options.
+} option_overlay;
+
+/// typedef for struct option_registry
+typedef struct option_registry option_registry;
+
+/// typedef for struct option_reloader
+typedef struct option_reloader option_reloader;
+
+/// typedef for struct option_blob
+typedef struct option_blob option_blob;
+
 /**
  * Parses the command line.
  *
@@ -111,6 +300,326 @@ options_parse(
         unsigned nopts
         );
 
+/**
+ * Parses the command line with additional settings.
+ *
+ * This function behaves as options_parse(), additionally the problems
+ * found are recorded in settings->diagnostics and with OPTION_FLAG_SILENT
+ * nothing is written to stderr.
+ *
+ * \param[in,out] options     The context to initialize. options can't be
+ *                            NULL and *options must be NULL.
+ * \param[in]     argc        Matches argc of main function.
+ * \param[in]     argv        Matches argv of main function.
+ * \param[in]     predef_opts The options the program knows about.
+ * \param[in]     nopts       The number of predefined options.
+ * \param[in]     settings    The settings may be NULL.
+ *
+ * \returns OPTION_OK when successful.
+ */
+PARSE_CMD_EXPORT int
+options_parse_ex(
+        option_context**                options,
+        int                             argc,
+        const char* const*              argv,
+        cmd_option*                     predef_opts,
+        unsigned                        nopts,
+        const option_parse_settings*    settings
+        );
+
+/**
+ * Parses a command line that is given as one string.
+ *
+ * The string is split into items with the quoting rules of a POSIX shell:
+ * items are separated by spaces, tabs and newlines, text between single
+ * quotes is taken literally, between double quotes a backslash only
+ * escapes '$', '`', '"', '\\' and a newline and outside of quotes a
+ * backslash escapes any character. Nothing is expanded.
+ *
+ * The string is unquoted in place and the values of the options point
+ * into it, so command must stay valid until the context is freed. An
+ * unterminated quote is reported as OPTION_PARSE_ERROR with an argv_index
+ * of -1 and the byte_offset of the quote in command.
+ *
+ * \param[in,out] options     The context to initialize. options can't be
+ *                            NULL and *options must be NULL.
+ * \param[in]     prog_name   The name of the program, it is argv[0].
+ * \param[in,out] command     The options and arguments, it is modified.
+ * \param[in]     predef_opts The options the program knows about.
+ * \param[in]     nopts       The number of predefined options.
+ * \param[in]     settings    The settings may be NULL.
+ *
+ * \returns OPTION_OK when successful.
+ */
+PARSE_CMD_EXPORT int
+options_parse_string(
+        option_context**                options,
+        const char*                     prog_name,
+        char*                           command,
+        cmd_option*                     predef_opts,
+        unsigned                        nopts,
+        const option_parse_settings*    settings
+        );
+
+/**
+ * Parses the command line of the process.
+ *
+ * This is for libraries that have options of their own, e.g. --mylib-trace,
+ * but don't get the argv of main. The command line is read from
+ * /proc/self/cmdline the first time this function is called in the
+ * process, later calls, also from other libraries, parse the same copy.
+ * The copy lives until the process exits. Combine this with
+ * OPTION_FLAG_IGNORE_UNKNOWN to skip the options of the program.
+ *
+ * \param[in,out] options     The context to initialize. options can't be
+ *                            NULL and *options must be NULL.
+ * \param[in]     predef_opts The options the library knows about.
+ * \param[in]     nopts       The number of predefined options.
+ * \param[in]     settings    The settings may be NULL.
+ *
+ * \returns OPTION_OK when successful, OPTION_FILE_ERROR when the command
+ *          line of the process isn't available, e.g. when /proc isn't
+ *          mounted or on systems other than Linux.
+ */
+PARSE_CMD_EXPORT int
+options_parse_process(
+        option_context**                options,
+        cmd_option*                     predef_opts,
+        unsigned                        nopts,
+        const option_parse_settings*    settings
+        );
+
+/**
+ * Formats a diagnostic as a human readable message.
+ *
+ * \param[in]  diag        The diagnostic to describe.
+ * \param[in]  argv        The command line the diagnostic refers to.
+ * \param[in]  predef_opts The predefined options used while parsing.
+ * \param[out] buf         The message is written here, it is always '\0'
+ *                         terminated when size > 0.
+ * \param[in]  size        The size of buf.
+ *
+ * \returns The length of the complete message, when it is >= size the
+ *          message was truncated; just as with snprintf.
+ */
+PARSE_CMD_EXPORT int
+option_diagnostic_format(
+        const option_diagnostic*    diag,
+        const char* const*          argv,
+        const cmd_option*           predef_opts,
+        char*                       buf,
+        size_t                      size
+        );
+
+/**
+ * Checks whether a command line is valid without building a context.
+ *
+ * The command line is parsed as options_parse() would, but the values
+ * aren't stored and the parser doesn't stop at the first error. Every
+ * problem found is described by an option_diagnostic. Nothing is printed.
+ *
+ * \param[in]  argc            Matches argc of main function.
+ * \param[in]  argv            Matches argv of main function.
+ * \param[in]  predef_opts     The options the program knows about, they
+ *                             are not modified.
+ * \param[in]  nopts           The number of predefined options.
+ * \param[out] diagnostics     Storage for the diagnostics, may be NULL
+ *                             when max_diagnostics is 0.
+ * \param[in]  max_diagnostics The number of diagnostics that fit in
+ *                             diagnostics, further diagnostics are only
+ *                             counted.
+ * \param[out] n_diagnostics   The number of problems found, may be NULL.
+ *
+ * \returns OPTION_OK when the command line is valid, otherwise the error
+ *          of the first diagnostic.
+ */
+PARSE_CMD_EXPORT int
+options_validate(
+        int                 argc,
+        const char* const*  argv,
+        const cmd_option*   predef_opts,
+        unsigned            nopts,
+        option_diagnostic*  diagnostics,
+        unsigned            max_diagnostics,
+        unsigned*           n_diagnostics
+        );
+
+/**
+ * Checks whether a command line is valid with additional settings.
+ *
+ * This function behaves as options_validate(), the diagnostics are stored
+ * in settings->diagnostics, which must not be NULL, and settings->limits
+ * are applied.
+ *
+ * \returns OPTION_OK when the command line is valid, otherwise the error
+ *          of the first diagnostic.
+ */
+PARSE_CMD_EXPORT int
+options_validate_ex(
+        int                             argc,
+        const char* const*              argv,
+        const cmd_option*               predef_opts,
+        unsigned                        nopts,
+        const option_parse_settings*    settings
+        );
+
+/**
+ * Reads arguments that are separated by a delimiter from a file descriptor.
+ *
+ * This reads the output of e.g. "find -print0" or "xargs"-style input of
+ * any size. The input is read in chunks of buffer_size bytes, when threads
+ * are available the next chunk is read while the arguments of the current
+ * one are handed to the callback. The memory used is bounded by about
+ * three times buffer_size, whatever the size of the input.
+ *
+ * \param[in] fd          The file descriptor to read from, it isn't closed.
+ * \param[in] delimiter   The separator of the arguments, typically '\0'
+ *                        or '\n'. The last argument doesn't need one.
+ *                        With '\n' a '\r' at the end of an argument is
+ *                        removed.
+ * \param[in] buffer_size The size of a chunk, this also is the maximum
+ *                        length of an argument. Use 0 for the default
+ *                        of 1 MiB.
+ * \param[in] callback    Is called with each argument in order.
+ * \param[in] data        Is passed to the callback.
+ *
+ * \returns OPTION_OK when the input is read, OPTION_LIMIT_EXCEEDED when an
+ *          argument doesn't fit in buffer_size, OPTION_FILE_ERROR when
+ *          reading fails, OPTION_OUT_OF_MEM or the non-zero return value
+ *          of the callback.
+ */
+PARSE_CMD_EXPORT int
+options_stream_arguments(
+        int                         fd,
+        char                        delimiter,
+        size_t                      buffer_size,
+        option_argument_callback    callback,
+        void*                       data
+        );
+
+/**
+ * Creates an empty option registry.
+ *
+ * A registry is a schema of options that can grow while the program runs,
+ * e.g. when plugins are loaded that bring their own options. Options are
+ * found by name in O(1), the names are hashed with a random key, so
+ * names chosen by a plugin can't be used to degrade the lookups.
+ *
+ * \param[out] registry A pointer to a registry pointer that is NULL.
+ *
+ * \returns OPTION_OK when successful.
+ */
+PARSE_CMD_EXPORT int
+option_registry_create(option_registry** registry);
+
+/**
+ * Frees a registry and the copies of the options it holds.
+ */
+PARSE_CMD_EXPORT void
+option_registry_free(option_registry* registry);
+
+/**
+ * Adds a group of options to the registry.
+ *
+ * The options are copied into the registry. When group isn't NULL the
+ * long options are registered as "group.long_opt", so they are given on
+ * the command line as --group.long_opt. Short options are only registered
+ * for options without a group.
+ *
+ * \param[in,out] registry the registry to add the options to.
+ * \param[in]     group    the namespace of the options or NULL.
+ * \param[in]     opts     the options of the group.
+ * \param[in]     nopts    the number of options in opts.
+ *
+ * \returns OPTION_OK when successful, OPTION_DUPLICATE when one of the
+ *          names is already registered. When not successful the registry
+ *          is left unmodified.
+ */
+PARSE_CMD_EXPORT int
+option_registry_add(
+        option_registry*    registry,
+        const char*         group,
+        const cmd_option*   opts,
+        unsigned            nopts
+        );
+
+/**
+ * Finds a registered option.
+ *
+ * \param[in] registry the registry to search.
+ * \param[in] name     the full name of the option e.g. "group.long_opt".
+ *
+ * \returns A pointer to the option or NULL if it wasn't found.
+ */
+PARSE_CMD_EXPORT const cmd_option*
+option_registry_find(const option_registry* registry, const char* name);
+
+/**
+ * Get the number of options in the registry.
+ *
+ * \returns The number of options or -1 when registry == NULL.
+ */
+PARSE_CMD_EXPORT int
+option_registry_num_options(const option_registry* registry);
+
+/**
+ * Parses the command line with the options of a registry.
+ *
+ * This function behaves as options_parse() where the predefined options are
+ * all options in the registry. The registry should outlive the context and
+ * it should not be modified while the context is in use.
+ *
+ * \param[in,out] options  The context to initialize. options can't be
+ *                         NULL and *options must be NULL.
+ * \param[in]     argc     Matches argc of main function.
+ * \param[in]     argv     Matches argv of main function.
+ * \param[in]     registry The registry that defines the options.
+ *
+ * \returns OPTION_OK when successful.
+ */
+PARSE_CMD_EXPORT int
+options_parse_registry(
+        option_context**    options,
+        int                 argc,
+        const char* const*  argv,
+        option_registry*    registry
+        );
+
+/**
+ * Parses the command line with the options of a registry and settings.
+ *
+ * This function behaves as options_parse_ex() where the predefined options
+ * are all options in the registry, see options_parse_registry().
+ */
+PARSE_CMD_EXPORT int
+options_parse_registry_ex(
+        option_context**                options,
+        int                             argc,
+        const char* const*              argv,
+        option_registry*                registry,
+        const option_parse_settings*    settings
+        );
+
+/**
+ * Checks a command line against the options of a registry.
+ *
+ * This function behaves as options_validate_ex() where the predefined
+ * options are all options in the registry. The index of the registry is
+ * used, so validating many command lines against one registry allocates
+ * nothing.
+ *
+ * 
+eturns OPTION_OK when the command line is valid, otherwise the error
+ *          of the first diagnostic.
+ */
+PARSE_CMD_EXPORT int
+options_validate_registry(
+        int                             argc,
+        const char* const*              argv,
+        const option_registry*          registry,
+        const option_parse_settings*    settings
+        );
+
 /**
  * Frees an option context and its allocated resources.
  */
@@ -194,6 +703,211 @@ option_context_float_value(
         double*                 opt_value
         );
 
+/**
+ * Obtain the contents of an OPT_FILE option.
+ *
+ * A value of the form "@path" names a file. The file is not touched while
+ * parsing; it is mapped read-only by the first call to this function and
+ * stays mapped until the option_context is freed, later calls return the
+ * same span. A value starting with "@@" is the literal text after the
+ * first '@' and any other value is returned as it is. Programs that never
+ * ask for the value don't do any I/O for it.
+ *
+ * The span is not terminated by a '\0'. Don't truncate the file while it
+ * is mapped; on most systems accessing the removed pages raises SIGBUS.
+ *
+ * \param[in]   options     the option_context.
+ * \param[in]   opt_name    the name of the option without "-"or "--".
+ * \param[out]  data        The start of the contents.
+ * \param[out]  size        The number of bytes in the contents.
+ *
+ * \returns OPTION_OK, OPTION_NOT_SPECIFIED, OPTION_WRONG_OPTION_TYPE,
+ *          OPTION_FILE_ERROR when the file can't be mapped or
+ *          OPTION_OUT_OF_MEM.
+ */
+PARSE_CMD_EXPORT int
+option_context_file_value(
+        const option_context*   options,
+        const char*             opt_name,
+        const void**            data,
+        size_t*                 size
+        );
+
+/**
+ * Sets options from a configuration file.
+ *
+ * The file consists of lines of the form "key = value". A key is the long
+ * name of an option; after a line "[section]" the keys are prefixed with
+ * "section.", which matches the names of options registered in a group
+ * of an option_registry. White space around keys and values is ignored,
+ * a value between double quotes is taken without the quotes. Lines that
+ * start with '#' or ';' are comments. A flag is set unless its value is
+ * empty, "0", "false", "no" or "off", which switch it off.
+ *
+ * Options from the command line or the environment take precedence over
+ * the file; when several files are loaded, a later file overrides the
+ * earlier ones. Values are converted as on the command line.
+ *
+ * The file is mapped into memory, the string values point into the
+ * mapping which stays valid until the context is freed. The file must not
+ * be truncated meanwhile, because that invalidates the mapping; use an
+ * option_reloader for files that change while the program runs.
+ *
+ * \param[in,out] options  A parsed context.
+ * \param[in]     path     The configuration file.
+ * \param[in]     settings How to report problems, may be NULL. The
+ *                         argv_index of the diagnostics is -1 and their
+ *                         byte_offset is the offset in the file.
+ *
+ * \returns OPTION_OK, OPTION_FILE_ERROR when the file can't be read,
+ *          OPTION_PARSE_ERROR for a line that can't be understood or a
+ *          value that can't be converted, OPTION_UNKNOWN for an unknown
+ *          key or OPTION_OUT_OF_MEM. The options set before a problem
+ *          keep their value.
+ */
+PARSE_CMD_EXPORT int
+option_context_load_config(
+        option_context*                 options,
+        const char*                     path,
+        const option_parse_settings*    settings
+        );
+
+/**
+ * Creates options that are reloaded when their configuration file changes.
+ *
+ * The reloader parses the command line and the configuration file as
+ * option_context_load_config() does, into a snapshot: an option_context
+ * that is never modified. When the file changes, a new snapshot is built
+ * and published; threads that read the options get the snapshot that is
+ * current when they call option_reloader_acquire() without taking a lock.
+ *
+ * \param[out] reloader    A pointer to a reloader pointer that is NULL.
+ * \param[in]  argc        Matches argc of main function.
+ * \param[in]  argv        Matches argv of main function, it must stay
+ *                         valid as long as the reloader.
+ * \param[in]  predef_opts The options the program knows about, they are
+ *                         copied so the array isn't modified.
+ * \param[in]  nopts       The number of predefined options.
+ * \param[in]  path        The configuration file.
+ * \param[in]  settings    The settings for every load, may be NULL. The
+ *                         pointers in it must stay valid as long as the
+ *                         reloader.
+ *
+ * \returns OPTION_OK or the error of parsing the command line or loading
+ *          the file.
+ */
+PARSE_CMD_EXPORT int
+option_reloader_create(
+        option_reloader**               reloader,
+        int                             argc,
+        const char* const*              argv,
+        const cmd_option*               predef_opts,
+        unsigned                        nopts,
+        const char*                     path,
+        const option_parse_settings*    settings
+        );
+
+/**
+ * Frees the reloader and all snapshots, no thread may hold a snapshot.
+ */
+PARSE_CMD_EXPORT void
+option_reloader_free(option_reloader* reloader);
+
+/**
+ * Returns a file descriptor that becomes readable when the configuration
+ * file may have changed, or -1 when changes are only found by polling
+ * with option_reloader_check(). The descriptor belongs to the reloader.
+ */
+PARSE_CMD_EXPORT int
+option_reloader_fd(const option_reloader* reloader);
+
+/**
+ * Reloads when the configuration file has changed.
+ *
+ * This also frees the replaced snapshots that are no longer read. Only
+ * one thread at a time may call this function or
+ * option_reloader_reload(). When loading fails, the current snapshot
+ * stays in use.
+ *
+ * \param[in,out] reloader The reloader.
+ * \param[out]    reloaded Set to 1 when a new snapshot was published, may
+ *                         be NULL.
+ *
+ * \returns OPTION_OK or the error of loading the file.
+ */
+PARSE_CMD_EXPORT int
+option_reloader_check(option_reloader* reloader, int* reloaded);
+
+/**
+ * Reloads the options unconditionally, see option_reloader_check().
+ */
+PARSE_CMD_EXPORT int
+option_reloader_reload(option_reloader* reloader);
+
+/**
+ * Gets the current snapshot of the options.
+ *
+ * This never blocks. The snapshot stays valid, and unchanged, until it is
+ * given back with option_reloader_release(). A thread should hold a
+ * snapshot briefly, since replaced snapshots can't be freed while they
+ * are held.
+ *
+ * \param[in]  reloader The reloader.
+ * \param[out] ticket   Must be passed to option_reloader_release().
+ *
+ * \returns The current snapshot.
+ */
+PARSE_CMD_EXPORT const option_context*
+option_reloader_acquire(option_reloader* reloader, long* ticket);
+
+/**
+ * Gives back a snapshot obtained by option_reloader_acquire().
+ */
+PARSE_CMD_EXPORT void
+option_reloader_release(option_reloader* reloader, long ticket);
+
+/**
+ * Returns the generation of a snapshot of an option_reloader, it
+ * increments with every reload. Other contexts are generation 0.
+ */
+PARSE_CMD_EXPORT unsigned
+option_context_generation(const option_context* options);
+
+/**
+ * Tells whether an option of a snapshot changed after a generation.
+ *
+ * A reader that remembers the generation of the last snapshot it used
+ * finds the options it has to act upon in O(1) per option, even when it
+ * missed some reloads.
+ *
+ * \param[in] options    A snapshot of an option_reloader.
+ * \param[in] name       The long name of the option.
+ * \param[in] generation The generation to compare with.
+ *
+ * \returns 1 when the value, or whether it is specified, changed in a
+ *          later generation, otherwise 0.
+ */
+PARSE_CMD_EXPORT int
+option_context_changed_since(
+        const option_context*   options,
+        const char*             name,
+        unsigned                generation
+        );
+
+/**
+ * Get the command line that was parsed.
+ *
+ * This is the argv given to options_parse(), unless response files were
+ * expanded, then it is the expanded command line.
+ *
+ * \param[in]  options The parsed option context.
+ * \param[out] argc    Receives the number of items in the command line.
+ *
+ * \returns The items of the command line.
+ */
+PARSE_CMD_EXPORT const char* const*
+option_context_argv(const option_context* options, int* argc);
+
 /**
  * Get the number of non option arguments
  */
@@ -290,6 +1004,625 @@ option_context_short_help(const option_context* options, char** help);
 PARSE_CMD_EXPORT int
 option_context_help(const option_context* options, char**help);
 
+/**
+ * Get the long help rendered for a terminal width from a cache.
+ *
+ * The help is rendered once per width and kept in the option_context. The
+ * string is borrowed: don't modify or free it, it stays valid until
+ * option_context_help_invalidate() or option_context_free(). Concurrent
+ * calls on the same context are safe.
+ *
+ * @param [in]  options the option context to describe
+ * @param [in]  width   the width of the terminal, 0 or less for the width
+ *                      of the current terminal.
+ * @param [out] help    the borrowed help.
+ * @return      OPTION_OK if successful another OPTION_x when not.
+ */
+PARSE_CMD_EXPORT int
+option_context_help_cached(
+        const option_context*   options,
+        int                     width,
+        const char**            help
+        );
+
+/**
+ * Get the short help from the cache, as option_context_help_cached().
+ */
+PARSE_CMD_EXPORT int
+option_context_short_help_cached(
+        const option_context*   options,
+        int                     width,
+        const char**            help
+        );
+
+/**
+ * Discards the cached help, e.g. after the help of a predefined option
+ * changed. option_context_set_description() does this itself. The strings
+ * borrowed from the cache become invalid, so no other thread may use
+ * them or the cache meanwhile.
+ */
+PARSE_CMD_EXPORT void
+option_context_help_invalidate(option_context* options);
+
+/**
+ * Returns the width of the terminal that the help is rendered for.
+ *
+ * The width is taken from the COLUMNS environment variable, or when stdout
+ * is a terminal from the terminal, otherwise it is 80. It is obtained once
+ * and is reused until option_terminal_invalidate() marks it stale.
+ */
+PARSE_CMD_EXPORT int
+option_terminal_width(void);
+
+/**
+ * Marks the width of the terminal stale, the next help obtains it again.
+ * This is safe to call from a signal handler.
+ */
+PARSE_CMD_EXPORT void
+option_terminal_invalidate(void);
+
+/**
+ * Installs or removes a SIGWINCH handler that marks the width of the
+ * terminal stale when the terminal is resized.
+ *
+ * The handler passes the signal on to the handler that was installed
+ * before, which is restored when the handler is removed. Programs that
+ * handle SIGWINCH themselves may call option_terminal_invalidate() instead.
+ *
+ * @param [in]  enable  non zero to install the handler, 0 to remove it.
+ * @return      OPTION_OK or OPTION_INVALID_ARGUMENT when the platform has
+ *              no SIGWINCH.
+ */
+PARSE_CMD_EXPORT int
+option_terminal_watch_resize(int enable);
+
+/**
+ * Receives the help written by option_context_help_write().
+ *
+ * \param[in] data     The data passed to option_context_help_write().
+ * \param[in] text     A part of the help, it isn't terminated by a '\0'
+ *                     and is only valid during the call.
+ * \param[in] length   The length of text in bytes.
+ *
+ * \returns 0 to continue, any other value stops writing and is returned
+ *          by option_context_help_write().
+ */
+typedef int (*option_output_callback)(
+        void*       data,
+        const char* text,
+        size_t      length
+        );
+
+/**
+ * Writes the long help to a file descriptor.
+ *
+ * The help is the same as that of option_context_help(), but it isn't
+ * built in memory. The help of the options is written from where it is
+ * and the parts are gathered in writev() calls, so the memory used doesn't
+ * depend on the number of options.
+ *
+ * @param [in]  options the option context to describe
+ * @param [in]  width   the width of the terminal, 0 or less for the width
+ *                      of the current terminal.
+ * @param [in]  fd      the file descriptor, e.g. STDOUT_FILENO.
+ * @return      OPTION_OK if successful, OPTION_FILE_ERROR when writing
+ *              fails or another OPTION_x.
+ */
+PARSE_CMD_EXPORT int
+option_context_help_fd(const option_context* options, int width, int fd);
+
+/**
+ * Writes the long help to a FILE*, as option_context_help_fd().
+ */
+PARSE_CMD_EXPORT int
+option_context_help_file(const option_context* options, int width, FILE* file);
+
+/**
+ * Hands the long help in parts to a callback, as option_context_help_fd().
+ *
+ * @return      OPTION_OK if successful, the non-zero return value of the
+ *              callback or another OPTION_x.
+ */
+PARSE_CMD_EXPORT int
+option_context_help_write(
+        const option_context*   options,
+        int                     width,
+        option_output_callback  callback,
+        void*                   data
+        );
+
+/**
+ * The help of a schema rendered for one terminal width at build time.
+ */
+typedef struct option_help_rendering {
+    int             width;          ///< The width of the terminal.
+    const char*     text;           ///< The long help, '\0' terminated.
+    size_t          length;         ///< The length of text.
+    size_t          short_length;   ///< The length of the short help at the
+                                    //   start of text.
+} option_help_rendering;
+
+/**
+ * The help of a schema rendered at build time for a number of terminal
+ * widths.
+ *
+ * This is generated by the parse_cmd_prerender_help() CMake function from
+ * the source of the schema, see tools/ParseCmdPrerender.cmake.
+ */
+typedef struct option_prerendered_help {
+    const char*     prog_name;      ///< The program name of the usage line.
+    const char*     description;    ///< The description of the program
+                                    //   or NULL.
+    unsigned        n_options;      ///< The number of predefined options.
+    const option_help_rendering* renderings; ///< The help by width.
+    unsigned        n_renderings;   ///< The number of renderings.
+} option_prerendered_help;
+
+/**
+ * Uses help that is rendered at build time.
+ *
+ * When the help is asked for one of the widths of help, it is taken from
+ * help instead of being laid out. option_context_help_cached() returns
+ * the text of help itself. When the name of the program differs, only the
+ * usage line is laid out. When the description of the context differs
+ * from the one in help, the help is laid out as usual.
+ *
+ * @param [in]  options the option context of the schema of help.
+ * @param [in]  help    the generated help, it must stay valid as long as
+ *                      options. NULL stops using it.
+ * @return      OPTION_OK or OPTION_INVALID_ARGUMENT when help is made for
+ *              another number of options.
+ */
+PARSE_CMD_EXPORT int
+option_context_set_prerendered_help(
+        option_context*                 options,
+        const option_prerendered_help*  help
+        );
+
+/**
+ * Serializes a parsed context into one blob.
+ *
+ * The blob refers to its contents with offsets instead of pointers, so it
+ * can be copied or mapped anywhere, e.g. into a shared mapping that is
+ * inherited by the workers of a supervisor. Workers read it with
+ * option_blob_open() and the option_blob accessors without parsing or
+ * copying anything. The blob contains the values of all predefined
+ * options, whether they were specified and the arguments. It is meant
+ * for processes on the same machine, it isn't portable between
+ * architectures.
+ *
+ * \param[in]  options The parsed option context.
+ * \param[out] blob    Receives the blob, free it with free().
+ * \param[out] size    Receives the size of the blob in bytes.
+ *
+ * \returns OPTION_OK, OPTION_OUT_OF_MEM or OPTION_LIMIT_EXCEEDED when the
+ *          blob wouldn't fit in 4 GiB.
+ */
+PARSE_CMD_EXPORT int
+option_context_serialize(
+        const option_context*   options,
+        void**                  blob,
+        size_t*                 size
+        );
+
+/**
+ * Serializes a parsed context into an anonymous file.
+ *
+ * On Linux the file is a memfd that is sealed against modification, on
+ * other systems it is a removed temporary file. The descriptor is closed
+ * on exec; pass it to a spawned child with dup2(). A child maps it with
+ * mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) and opens the mapping
+ * with option_blob_open(), all processes then share the same pages.
+ *
+ * \param[in]  options The parsed option context.
+ * \param[out] fd      Receives the file descriptor, the caller closes it.
+ * \param[out] size    Receives the size of the blob in bytes.
+ *
+ * \returns OPTION_OK, OPTION_FILE_ERROR or an error of
+ *          option_context_serialize().
+ */
+PARSE_CMD_EXPORT int
+option_context_serialize_fd(
+        const option_context*   options,
+        int*                    fd,
+        size_t*                 size
+        );
+
+/**
+ * Opens a blob made by option_context_serialize().
+ *
+ * The blob is checked once, it isn't copied: the option_blob is data
+ * itself and valid as long as data is. The accessors never write to the
+ * blob, so a blob that is inherited over fork() stays shared.
+ *
+ * \param[out] blob The opened blob.
+ * \param[in]  data The blob, aligned to 8 bytes.
+ * \param[in]  size The number of bytes available at data.
+ *
+ * \returns OPTION_OK or OPTION_INVALID_ARGUMENT when data isn't a valid
+ *          blob.
+ */
+PARSE_CMD_EXPORT int
+option_blob_open(const option_blob** blob, const void* data, size_t size);
+
+/**
+ * Whether an option was specified, as option_context_have_option().
+ */
+PARSE_CMD_EXPORT int
+option_blob_have_option(const option_blob* blob, const char* name);
+
+/**
+ * Obtain a string value from a blob, as option_context_str_value().
+ */
+PARSE_CMD_EXPORT int
+option_blob_str_value(
+        const option_blob*      blob,
+        const char*             opt_name,
+        const char**            opt_value
+        );
+
+/**
+ * Obtain an integer value from a blob, as option_context_int_value().
+ */
+PARSE_CMD_EXPORT int
+option_blob_int_value(
+        const option_blob*      blob,
+        const char*             opt_name,
+        int*                    opt_value
+        );
+
+/**
+ * Obtain a floating point value from a blob, as
+ * option_context_float_value().
+ */
+PARSE_CMD_EXPORT int
+option_blob_float_value(
+        const option_blob*      blob,
+        const char*             opt_name,
+        double*                 opt_value
+        );
+
+/**
+ * Get the number of non option arguments in a blob.
+ */
+PARSE_CMD_EXPORT int
+option_blob_nargs(const option_blob* blob);
+
+/**
+ * Get the nth argument in a blob or NULL when it is not available.
+ */
+PARSE_CMD_EXPORT const char*
+option_blob_get_argument(const option_blob* blob, int nth);
+
+/**
+ * Retrieve the program name from a blob.
+ */
+PARSE_CMD_EXPORT const char*
+option_blob_prog_name(const option_blob* blob);
+
+/**
+ * Initializes an overlay of a parsed context without allocating.
+ *
+ * The parent must outlive the overlay and it must not be changed while
+ * the overlay is in use.
+ */
+PARSE_CMD_EXPORT void
+option_overlay_init(option_overlay* overlay, const option_context* parent);
+
+/**
+ * Allocates and initializes an overlay, free it with option_overlay_free().
+ *
+ * \returns OPTION_OK, OPTION_INVALID_ARGUMENT or OPTION_OUT_OF_MEM.
+ */
+PARSE_CMD_EXPORT int
+option_overlay_create(option_overlay** overlay, const option_context* parent);
+
+/**
+ * Frees an overlay made by option_overlay_create().
+ */
+PARSE_CMD_EXPORT void
+option_overlay_free(option_overlay* overlay);
+
+/**
+ * Overrides an option.
+ *
+ * The value is converted as on the command line, flags take NULL. String
+ * values aren't copied, they should stay valid while the overlay is used.
+ * Overriding the same option again replaces the earlier override.
+ *
+ * \param[in,out] overlay  The overlay.
+ * \param[in]     opt_name The long name of the option.
+ * \param[in]     value    The value as it would be on the command line.
+ *
+ * \returns OPTION_OK, OPTION_UNKNOWN, OPTION_MISSING_VALUE,
+ *          OPTION_PARSE_ERROR or OPTION_LIMIT_EXCEEDED when more than
+ *          OPTION_OVERLAY_CAPACITY options are overridden.
+ */
+PARSE_CMD_EXPORT int
+option_overlay_set(
+        option_overlay*         overlay,
+        const char*             opt_name,
+        const char*             value
+        );
+
+/**
+ * Hides an option of the parent, the overlay acts as if it wasn't
+ * specified.
+ *
+ * \returns As option_overlay_set().
+ */
+PARSE_CMD_EXPORT int
+option_overlay_unset(option_overlay* overlay, const char* opt_name);
+
+/**
+ * Whether an option is specified in the overlay or its parent.
+ */
+PARSE_CMD_EXPORT int
+option_overlay_have_option(const option_overlay* overlay, const char* opt_name);
+
+/**
+ * Obtain a string value, as option_context_str_value().
+ */
+PARSE_CMD_EXPORT int
+option_overlay_str_value(
+        const option_overlay*   overlay,
+        const char*             opt_name,
+        const char**            opt_value
+        );
+
+/**
+ * Obtain an integer value, as option_context_int_value().
+ */
+PARSE_CMD_EXPORT int
+option_overlay_int_value(
+        const option_overlay*   overlay,
+        const char*             opt_name,
+        int*                    opt_value
+        );
+
+/**
+ * Obtain a floating point value, as option_context_float_value().
+ */
+PARSE_CMD_EXPORT int
+option_overlay_float_value(
+        const option_overlay*   overlay,
+        const char*             opt_name,
+        double*                 opt_value
+        );
+
+/**
+ * What a token of an option_session turned out to be.
+ */
+enum OPTION_TOKEN_KIND {
+    OPTION_TOKEN_ARGUMENT = 0,  ///< An argument to the program.
+    OPTION_TOKEN_LONG,          ///< A long option, perhaps with "=value".
+    OPTION_TOKEN_SHORT,         ///< A cluster of short options.
+    OPTION_TOKEN_VALUE          ///< The value of the option in front of it.
+};
+
+/**
+ * A token of the line of an option_session.
+ */
+typedef struct option_token {
+    size_t  offset;         ///< Byte offset of the token in the line.
+    size_t  length;         ///< Length of the token in bytes.
+    int     kind;           ///< The OPTION_TOKEN_KIND of the token.
+    int     option_index;   ///< The predefined option the token names or
+                            //   is the value of, otherwise -1.
+    int     error;          ///< OPTION_OK or the OPTION_RET_VAL that
+                            //   describes what is wrong with the token.
+    int     error_offset;   ///< Byte offset of the problem in the token.
+} option_token;
+
+/**
+ * An incremental parse of a line that is being edited, e.g. in an
+ * interactive console.
+ *
+ * The line holds the items after the name of the program. It is split at
+ * blanks, quotes aren't interpreted. An edit splits only the tokens it
+ * touches again and resolves the tokens whose meaning may have changed,
+ * so the cost of an edit depends on the edit, not on the length of the line.
+ */
+typedef struct option_session option_session;
+
+/**
+ * Creates a session with an empty line.
+ *
+ * \param [out] session     The new session, free it with
+ *                          option_session_free().
+ * \param [in] predef_opts  The options the program accepts, they should
+ *                          outlive the session.
+ * \param [in] n_opts       The number of predefined options.
+ *
+ * \returns OPTION_OK, OPTION_INVALID_ARGUMENT or OPTION_OUT_OF_MEM.
+ */
+PARSE_CMD_EXPORT int
+option_session_create(
+        option_session**    session,
+        const cmd_option*   predef_opts,
+        unsigned            n_opts
+        );
+
+/**
+ * Releases a session.
+ */
+PARSE_CMD_EXPORT void
+option_session_free(option_session* session);
+
+/**
+ * Inserts length bytes of text in front of byte offset of the line.
+ *
+ * \returns OPTION_OK, OPTION_INVALID_ARGUMENT when offset is past the end
+ *          of the line or OPTION_OUT_OF_MEM, in which case the session is
+ *          unchanged.
+ */
+PARSE_CMD_EXPORT int
+option_session_insert(
+        option_session* session,
+        size_t          offset,
+        const char*     text,
+        size_t          length
+        );
+
+/**
+ * Deletes length bytes from byte offset of the line onwards.
+ *
+ * \returns As option_session_insert().
+ */
+PARSE_CMD_EXPORT int
+option_session_delete(option_session* session, size_t offset, size_t length);
+
+/**
+ * Returns the length of the line in bytes.
+ */
+PARSE_CMD_EXPORT size_t
+option_session_length(const option_session* session);
+
+/**
+ * Copies the line to buffer, truncated to size - 1 bytes and '\0'
+ * terminated.
+ *
+ * \returns The length of the line.
+ */
+PARSE_CMD_EXPORT size_t
+option_session_text(const option_session* session, char* buffer, size_t size);
+
+/**
+ * Returns the number of tokens in the line.
+ */
+PARSE_CMD_EXPORT size_t
+option_session_num_tokens(const option_session* session);
+
+/**
+ * Describes the nth token of the line.
+ *
+ * \returns OPTION_OK or OPTION_INVALID_ARGUMENT when nth is out of range.
+ */
+PARSE_CMD_EXPORT int
+option_session_token(
+        const option_session*   session,
+        size_t                  nth,
+        option_token*           token
+        );
+
+/**
+ * Finds the token under or directly in front of a byte offset, e.g. that
+ * of the cursor.
+ *
+ * \returns OPTION_OK or OPTION_NOT_SPECIFIED when offset is in between
+ *          tokens.
+ */
+PARSE_CMD_EXPORT int
+option_session_token_at(
+        const option_session*   session,
+        size_t                  offset,
+        size_t*                 nth
+        );
+
+/**
+ * Returns the number of tokens that have an error.
+ */
+PARSE_CMD_EXPORT unsigned
+option_session_num_errors(const option_session* session);
+
+/**
+ * What the word under the cursor completes to.
+ */
+enum OPTION_COMPLETION_KIND {
+    OPTION_COMPLETE_ARGUMENT = 0,   ///< An argument, or an option when the
+                                    //   word is still empty.
+    OPTION_COMPLETE_OPTION,         ///< An option.
+    OPTION_COMPLETE_VALUE           ///< The value of an option.
+};
+
+/**
+ * The answer to a completion query.
+ */
+typedef struct option_completion {
+    int     kind;           ///< The OPTION_COMPLETION_KIND.
+    int     option_index;   ///< The predefined option whose value is being
+                            //   typed, otherwise -1.
+    size_t  value_offset;   ///< Where the value starts in the current word,
+                            //   e.g. after "--name=".
+    size_t  first;          ///< The first matching candidate.
+    size_t  count;          ///< The number of matching candidates.
+} option_completion;
+
+/**
+ * Completes partially typed command lines for one set of predefined
+ * options. The spellings of the options are sorted once, a query finds
+ * the candidates that match a prefix with a binary search.
+ */
+typedef struct option_completer option_completer;
+
+/**
+ * Creates a completer.
+ *
+ * \param [out] completer   The new completer, free it with
+ *                          option_completer_free().
+ * \param [in] predef_opts  The options the program accepts, they should
+ *                          outlive the completer.
+ * \param [in] n_opts       The number of predefined options.
+ *
+ * \returns OPTION_OK, OPTION_INVALID_ARGUMENT or OPTION_OUT_OF_MEM.
+ */
+PARSE_CMD_EXPORT int
+option_completer_create(
+        option_completer**  completer,
+        const cmd_option*   predef_opts,
+        unsigned            n_opts
+        );
+
+/**
+ * Releases a completer.
+ */
+PARSE_CMD_EXPORT void
+option_completer_free(option_completer* completer);
+
+/**
+ * Finds what the last of the words typed so far completes to.
+ *
+ * The words don't include the name of the program, the last one is the
+ * word under the cursor and may be empty. The candidates are
+ * completion->first up to first + count, see option_completer_candidate().
+ *
+ * \returns OPTION_OK or OPTION_INVALID_ARGUMENT.
+ */
+PARSE_CMD_EXPORT int
+option_completer_query(
+        const option_completer* completer,
+        int                     n_words,
+        const char* const*      words,
+        option_completion*      completion
+        );
+
+/**
+ * Returns the nth candidate, e.g. "--name" or "-c", or NULL when nth is out
+ * of range. The predefined option is stored in position when it isn't NULL.
+ */
+PARSE_CMD_EXPORT const char*
+option_completer_candidate(
+        const option_completer* completer,
+        size_t                  nth,
+        int*                    position
+        );
+
+/**
+ * Writes the completion index file, one sorted "spelling<TAB>type" line
+ * per option, e.g. "--count\tint". A shell completion script can search it
+ * with look(1) without running the program, see
+ * tools/parse_cmd_completion.bash. A program with a fixed schema can have
+ * the index written at build time by parse_cmd_completion_index() of
+ * tools/ParseCmdPrerender.cmake instead.
+ *
+ * \returns OPTION_OK, OPTION_INVALID_ARGUMENT or OPTION_FILE_ERROR.
+ */
+PARSE_CMD_EXPORT int
+option_completer_write_index(
+        const option_completer* completer,
+        const char*             path
+        );
+
 #ifdef __cplusplus
 }
 #endif
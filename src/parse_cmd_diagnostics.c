@@ -0,0 +1,178 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file parse_cmd_diagnostics.c
+ *
+ * This file implements recording and formatting of the problems found
+ * while parsing a command line.
+ */
+
+#if defined(_MSC_VER)
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "parse_cmd.h"
+#include "parse_cmd_private.h"
+
+void
+option_diagnostics_add(option_diagnostics* diags, const option_diagnostic* diag)
+{
+    if (!diags)
+        return;
+    if (diags->count < diags->capacity)
+        diags->records[diags->count] = *diag;
+    diags->count++;
+}
+
+/*
+ * Returns a name for the value type of an option.
+ */
+const char*
+option_type_name(const cmd_option* option)
+{
+    switch (option->option_type) {
+        case OPT_INT:
+            return "int";
+        case OPT_FLOAT:
+            return "float";
+        case OPT_STR:
+            return "string";
+        case OPT_FILE:
+            return "file";
+        default:
+            return "flag";
+    }
+}
+
+int
+option_diagnostic_format(
+        const option_diagnostic*    diag,
+        const char* const*          argv,
+        const cmd_option*           predef_opts,
+        char*                       buf,
+        size_t                      size
+        )
+{
+    const char* token           = NULL;
+    const cmd_option* option    = NULL;
+
+    if (!diag)
+        return -1;
+
+    if (argv && diag->argv_index >= 0)
+        token = argv[diag->argv_index];
+    if (predef_opts && diag->option_index >= 0)
+        option = &predef_opts[diag->option_index];
+
+    switch (diag->error) {
+    case OPTION_UNKNOWN:
+        if (!token && diag->argv_index < 0)
+            return snprintf(buf, size, "unknown option at byte %d",
+                            diag->byte_offset
+                            );
+        if (!token)
+            break;
+        if (diag->byte_offset == 2 && strncmp(token, "--", 2) == 0)
+            return snprintf(buf, size, "Unknown option \"%.256s\"", token);
+        return snprintf(
+                buf, size, "Unknown option -%c", token[diag->byte_offset]
+                );
+    case OPTION_MISSING_VALUE:
+        if (!option)
+            break;
+        return snprintf(buf, size, "option --%.256s: takes a value.",
+                        option->long_opt
+                        );
+    case OPTION_PARSE_ERROR:
+        if (!option && diag->argv_index < 0)
+            return snprintf(buf, size,
+                            "syntax error at byte %d",
+                            diag->byte_offset
+                            );
+        if (!option)
+            break;
+        return snprintf(buf, size, "option --%.256s: expected %s argument",
+                        option->long_opt,
+                        option_type_name(option)
+                        );
+    case OPTION_LIMIT_EXCEEDED:
+        if (token)
+            return snprintf(buf, size, "argument %d exceeds a limit",
+                            diag->argv_index
+                            );
+        return snprintf(buf, size, "too many arguments");
+    case OPTION_INVALID_ENCODING:
+        if (token)
+            return snprintf(buf, size,
+                            "argument %d: invalid UTF-8 at byte %d",
+                            diag->argv_index,
+                            diag->byte_offset
+                            );
+        break;
+    case OPTION_FILE_ERROR:
+        if (token)
+            return snprintf(buf, size, "unable to read \"%.256s\"",
+                            token + diag->byte_offset
+                            );
+        break;
+    case OPTION_RECURSIVE_FILE:
+        if (token)
+            return snprintf(buf, size, "\"%.256s\" includes itself",
+                            token + diag->byte_offset
+                            );
+        break;
+    case OPTION_OUT_OF_MEM:
+        return snprintf(buf, size, "parse_options: out of memory");
+    case OPTION_INVALID_ARGUMENT:
+        return snprintf(buf, size,
+                        "parse_options: invalid argument, argc and argv "
+                        "should reflect a program name and *options "
+                        "should be NULL"
+                        );
+    default:
+        break;
+    }
+
+    if (token)
+        return snprintf(buf, size, "error %d at \"%.256s\"", diag->error, token);
+    return snprintf(buf, size, "error %d", diag->error);
+}
+
+void
+options_report(
+        const option_parse_settings*    settings,
+        const option_diagnostic*        diag,
+        const char* const*              argv,
+        const cmd_option*               predef_opts
+        )
+{
+    char message[512];
+
+    if (settings)
+        option_diagnostics_add(settings->diagnostics, diag);
+
+    if (settings && (settings->flags & OPTION_FLAG_SILENT))
+        return;
+
+    option_diagnostic_format(diag, argv, predef_opts, message, sizeof(message));
+    fprintf(stderr, "%s\n", message);
+}
@@ -23,16 +23,35 @@
  * of an option_context
  */
 
+#if !defined(_MSC_VER)
+// write and writev are POSIX.
+#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <errno.h>
 
 #include "parse_cmd.h"
+#include "parse_cmd_config.h"
+#include "parse_cmd_private.h"
+#include "atomic_utils.h"
 #include "text_buffer.h"
 #include "terminal_utils.h"
 #include "string_utils.h"
 
+#if defined(HAVE_UNISTD_H)
+#include <unistd.h>
+#endif
+
+#if defined(HAVE_SYS_UIO_H) && defined(HAVE_UNISTD_H)
+#define HELP_WRITER_USE_WRITEV
+#include <sys/uio.h>
+typedef struct iovec help_segment;
+#endif
+
 /**
  * \internal
  *
@@ -58,51 +77,219 @@ const char* SPACE       = " ";
 const char* NEW_LINE     = "\n";
 
 /**
- * \internal 
- * \brief Write a word to the output buffer.
- *
- * Writes a word from the word text buffer to buf. This function checks whether
- * the word won't be printed beyond the end of the line. Except when a word
- * is longer than one line.
- *
- * @param buf [out]         The text buffer we are writing to.
- * @param word [in]         The word we append to the buffer.
- * @param maxwidth[in]      The maximum allowable linelength.
- * @param llength[in, out]  The line length before and after writing the word.
+ * \internal
+ * The number of segments that are gathered before they are written.
+ */
+#define HELP_WRITER_SEGMENTS    64
+
+/**
+ * \internal
+ * The number of bytes for the pieces of text that are formatted while
+ * writing.
+ */
+#define HELP_WRITER_SCRATCH     4096
+
+#if !defined(HELP_WRITER_USE_WRITEV)
+/**
+ * \internal
+ * A piece of output, laid out as a struct iovec.
+ */
+typedef struct help_segment {
+    void*   iov_base;   ///< The start of the text.
+    size_t  iov_len;    ///< The length of the text.
+} help_segment;
+#endif
+
+/**
+ * \internal
+ * Writes the help into a text_buffer or to a sink.
  *
- * \returns OPTION_OK when successful another option value otherwise.
+ * The help consists for the largest part of the descriptions of the
+ * options, which are written from where they are. Only the pieces that are
+ * formatted, e.g. "[-c|--count <int>]", are copied to the scratch space.
+ * The segments are gathered and are written in one go with writev(), so
+ * the output to a sink takes a fixed amount of memory, whatever the size
+ * of the help.
+ */
+typedef struct help_writer {
+    text_buffer_ptr         buf;        ///< Renders into memory when not NULL.
+    int                     fd;         ///< The file descriptor sink.
+    FILE*                   file;       ///< The FILE* sink.
+    option_output_callback  callback;   ///< The callback sink.
+    void*                   data;       ///< Passed to callback.
+    help_segment            segments[HELP_WRITER_SEGMENTS];
+    unsigned                n_segments; ///< The number of segments in use.
+    char                    scratch[HELP_WRITER_SCRATCH];
+    size_t                  scratch_used;
+    text_buffer_t           piece;      ///< Formats one piece of the help.
+} help_writer;
+
+/*
+ * Writes segments to fd, retries when interrupted or when a part is
+ * written.
  */
 static int
-format_txt_write_word(
-        text_buffer_ptr buf,
-        text_buffer_ptr word, 
-        size_t          maxwidth,
-        size_t*         llength
-        )
+help_write_fd(int fd, help_segment* segments, unsigned n)
+{
+#if defined(HAVE_UNISTD_H)
+    while (n > 0) {
+#if defined(HELP_WRITER_USE_WRITEV)
+        ssize_t written = writev(fd, segments, (int) n);
+#else
+        ssize_t written = write(fd, segments->iov_base, segments->iov_len);
+#endif
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return OPTION_FILE_ERROR;
+        while (n > 0 && (size_t) written >= segments->iov_len) {
+            written -= (ssize_t) segments->iov_len;
+            segments++;
+            n--;
+        }
+        if (n > 0) {
+            segments->iov_base  = (char*) segments->iov_base + written;
+            segments->iov_len  -= (size_t) written;
+        }
+    }
+    return OPTION_OK;
+#else
+    (void) fd;
+    (void) segments;
+    (void) n;
+    return OPTION_FILE_ERROR;
+#endif
+}
+
+/*
+ * Writes the gathered segments to the sink and empties the scratch space.
+ */
+static int
+help_writer_flush(help_writer* w)
 {
     int ret = OPTION_OK;
-    size_t num_chars;
-    ret = num_characters(word->buffer, &num_chars);
-    if (ret)
-        return ret;
+    unsigned i;
+
+    if (w->callback) {
+        for (i = 0; i < w->n_segments && ret == 0; i++)
+            ret = w->callback(
+                    w->data, w->segments[i].iov_base, w->segments[i].iov_len
+                    );
+    }
+    else if (w->file) {
+        for (i = 0; i < w->n_segments && ret == OPTION_OK; i++)
+            if (fwrite(w->segments[i].iov_base, 1, w->segments[i].iov_len,
+                       w->file) != w->segments[i].iov_len)
+                ret = OPTION_FILE_ERROR;
+    }
+    else if (w->n_segments > 0)
+        ret = help_write_fd(w->fd, w->segments, w->n_segments);
 
-    if (num_chars + *llength >= maxwidth) {
-        ret = text_buffer_append(buf, NEW_LINE);
+    w->n_segments   = 0;
+    w->scratch_used = 0;
+    return ret;
+}
+
+/*
+ * Writes text that stays valid until the help is written completely.
+ * Text that continues the previous segment extends it.
+ */
+static int
+help_write(help_writer* w, const char* text, size_t length)
+{
+    help_segment* last;
+    int ret;
+
+    if (w->buf)
+        return text_buffer_append_size(w->buf, text, length);
+    if (length == 0)
+        return OPTION_OK;
+
+    if (w->n_segments > 0) {
+        last = &w->segments[w->n_segments - 1];
+        if ((const char*) last->iov_base + last->iov_len == text) {
+            last->iov_len += length;
+            return OPTION_OK;
+        }
+    }
+    if (w->n_segments == HELP_WRITER_SEGMENTS) {
+        ret = help_writer_flush(w);
         if (ret)
             return ret;
-        ret = text_buffer_append(buf, LINE_HEADER);
+    }
+    last = &w->segments[w->n_segments++];
+    last->iov_base  = (void*) text;
+    last->iov_len   = length;
+    return OPTION_OK;
+}
+
+/*
+ * Writes text that is only valid during the call, it is copied to the
+ * scratch space first.
+ */
+static int
+help_write_copy(help_writer* w, const char* text, size_t length)
+{
+    char* copy;
+    int ret;
+
+    if (w->buf)
+        return text_buffer_append_size(w->buf, text, length);
+
+    // The copy must stay until the flush that writes it.
+    if (w->scratch_used + length > HELP_WRITER_SCRATCH ||
+        w->n_segments == HELP_WRITER_SEGMENTS) {
+        ret = help_writer_flush(w);
         if (ret)
             return ret;
-        *llength = strlen(LINE_HEADER);
     }
+    if (length > HELP_WRITER_SCRATCH) {
+        // Too large for the scratch space, write it right away.
+        ret = help_write(w, text, length);
+        return ret ? ret : help_writer_flush(w);
+    }
+    copy = w->scratch + w->scratch_used;
+    memcpy(copy, text, length);
+    w->scratch_used += length;
+    return help_write(w, copy, length);
+}
 
-    ret = text_buffer_append(buf, word->buffer);
-    if (ret)
-        return ret;
+/*
+ * Writes the text that is formatted in the piece of the writer.
+ */
+static int
+help_write_piece(help_writer* w)
+{
+    return help_write_copy(w, w->piece.buffer, w->piece.size);
+}
 
-    text_buffer_clear(word);
+/**
+ * \internal
+ * \brief Writes the source text from *run up to end and moves *run to end.
+ *
+ * Text that is copied verbatim is gathered in runs, so a line is written
+ * in one go instead of word by word.
+ */
+static int
+format_txt_flush(help_writer* w, const char** run, const char* end)
+{
+    int ret = help_write(w, *run, (size_t)(end - *run));
+    *run = end;
+    return ret;
+}
 
-    *llength += num_chars;
+/**
+ * \internal
+ * \brief Starts a new line that begins with the line header.
+ */
+static int
+format_txt_wrap(help_writer* w, size_t* llength)
+{
+    int ret = help_write(w, NEW_LINE, strlen(NEW_LINE));
+    if (ret)
+        return ret;
+    ret = help_write(w, LINE_HEADER, strlen(LINE_HEADER));
+    *llength = strlen(LINE_HEADER);
     return ret;
 }
 
@@ -111,9 +298,17 @@ format_txt_write_word(
  * \brief formats text where every new line starts with a lineheader
  *        and words won't exceed the maximum length of a line.
  *
- * @param [in, out] buf The function takes this buffer to append to.
- * @param [in]      txt The text that should be appended in a formatted
- *                          fashion to the output buffer.
+ * The text is visited once. strcspn() finds the end of a word and the
+ * display width of the word is computed once. The words and the spaces between
+ * them are written from txt in runs, only a wrapped line or a line header
+ * after a newline interrupts a run.
+ *
+ * A word that follows a newline is prefixed with the line header and the
+ * header counts towards the width of that word.
+ *
+ * @param [in, out] w   The writer of the help.
+ * @param [in]      txt The text that should be written in a formatted
+ *                          fashion.
  * @param [in]      maxwidth The maximum number of characters on one line.
  * @param [in, out] llength The number of characters on the current line.
  *
@@ -121,400 +316,599 @@ format_txt_write_word(
  */
 static int
 format_txt(
-        text_buffer_ptr buf,
+        help_writer*    w,
         const char*     txt,
         size_t          maxwidth,
         size_t*         llength
         )
 {
     int ret;
-    const char* start       = txt;
-    const char* end         = start + strlen(start);
+    const size_t header_length = strlen(LINE_HEADER);
+    const char* run     = txt;  // start of the text not yet written
+    const char* word    = txt;
+    int         header  = 0;    // whether the word gets a line header
 
-    text_buffer_t word = {0};
-    ret = text_buffer_init(&word, 1024);
-    if (ret) {
-        free (word.buffer);
-        return ret;
-    }
+    for (;;) {
+        size_t length = strcspn(word, " \n");
+        size_t width;
 
-    while (start <= end) {
-        int c = *start++;
-        if (c == ' ') {
-            ret = format_txt_write_word(buf, &word, maxwidth, llength);
-            if (ret) {
-                free(word.buffer);
+        ret = display_width_n(word, length, &width);
+        if (ret)
+            return ret;
+        if (header)
+            width += header_length;
+
+        if (width + *llength >= maxwidth) {
+            ret = format_txt_flush(w, &run, word);
+            if (!ret)
+                ret = format_txt_wrap(w, llength);
+            if (ret)
                 return ret;
-            }
-            if ((*llength) == maxwidth) {
-                ret = text_buffer_append(buf, NEW_LINE);
-                if (ret) {
-                    free(word.buffer);
-                    return ret;
-                }
-                ret = text_buffer_append(buf, LINE_HEADER);
-                if (ret) {
-                    free(word.buffer);
-                    return ret;
-                }
-                *llength = strlen(LINE_HEADER);
-            }
-            else {
-                ret = text_buffer_append_char(buf, ' ');
-                if (ret) {
-                    free(word.buffer);
-                    return ret;
-                }
-                (*llength)++;
-            }
         }
-        else if (c == '\n') {
-            ret = format_txt_write_word(buf, &word, maxwidth, llength);
-            if (ret) {
-                free(word.buffer);
-                return ret;
-            }
-            ret = text_buffer_append(buf, NEW_LINE);
-            if (ret) {
-                free(word.buffer);
+        if (header) {
+            ret = format_txt_flush(w, &run, word);
+            if (!ret)
+                ret = help_write(w, LINE_HEADER, header_length);
+            if (ret)
                 return ret;
-            }
-            ret = text_buffer_append(&word, LINE_HEADER);
-            if (ret) {
-                free(word.buffer);
-                return ret;
-            }
-            *llength = strlen(LINE_HEADER);
+            header = 0;
         }
-        else if (c == '\0') {
-            ret = format_txt_write_word(buf, &word, maxwidth, llength);
-            if (ret) {
-                free(word.buffer);
-                return ret;
-            }
+        *llength += width;
+        word += length;
+
+        if (*word == '\0')
             break;
+        if (*word == ' ') {
+            if (*llength == maxwidth) {
+                // The space becomes the end of the line.
+                ret = format_txt_flush(w, &run, word);
+                if (!ret)
+                    ret = format_txt_wrap(w, llength);
+                if (ret)
+                    return ret;
+                run = word + 1;
+            }
+            else
+                (*llength)++;
         }
         else {
-            ret = text_buffer_append_char(&word, (char) c);
-            if (ret) {
-                free(word.buffer);
-                return ret;
-            }
+            header = 1;
+            *llength = header_length;
         }
+        word++;
     }
 
-    free(word.buffer);
+    return format_txt_flush(w, &run, word);
+}
 
-    return OPTION_OK;
+/**
+ * \internal
+ * \brief Returns how the value of an option is shown in the help, e.g.
+ *        " <int>", flags have no value.
+ */
+static const char*
+option_value_hint(const cmd_option* opt)
+{
+    switch(opt->option_type) {
+        case OPT_FLAG:
+            return "";
+        case OPT_INT:
+            return " <int>";
+        case OPT_FLOAT:
+            return " <float>";
+        case OPT_STR:
+            return " <string>";
+        case OPT_FILE:
+            return " <@file>";
+        default:
+            assert(0==1); //un inplemented option type
+            return "";
+    }
 }
 
 /**
- * Append the short documentation of one option to the current text buffer.
+ * Write the short documentation of one option.
  *
  * \Internal
  * The short option is added to the short doc. It tries to put the doc
  * of one option on one line. If there are more options than fit on one line
  * the new options are added to the new line. The new line will start with
- * 8 spaces. The documentation regarding the new option will be appended
+ * 8 spaces. The documentation regarding the new option will be written
  * after the 8 spaces. No new lines are are added after an option.
  *
- * \param buf[in,out]       The textbuffer to which we append the new option
+ * The space that separates an option from the next one is written in
+ * front of the next option, but it counts towards the width of the option
+ * it follows.
+ *
+ * \param w[in,out]         The writer of the help.
  * \param opt[in]           The option we are currently documenting
+ * \param first[in]         Whether this is the first option.
  * \param maxwidth[in]      The maximum line length.
  * \param llength[in,out]   The length of the current line before and after
- *                          this function call. 
+ *                          this function call.
  */
 static int
 format_short_opt(
-        text_buffer_ptr buf,
+        help_writer* w,
         cmd_option opt,
+        int first,
         size_t maxwidth,
         size_t* llength
         )
 {
     int ret;
-    char tempstr [512] = "";
-    size_t append_length  = 0; 
+    size_t append_length  = 0;
 
-    switch(opt.option_type) {
-        case OPT_FLAG:
-            if (opt.short_opt)
-                sprintf(tempstr, "[-%c|--%.256s] ", opt.short_opt, opt.long_opt);
-            else
-                sprintf(tempstr, "[--%.256s] ",opt.long_opt);
-
-            break;
-        case OPT_INT:
-            if (opt.short_opt)
-                sprintf(tempstr, "[-%c|--%.256s <int>] ",
-                        opt.short_opt,
-                        opt.long_opt
-                        );
-            else
-                sprintf(tempstr, "[--%.256s <int>] ",opt.long_opt);
-            break;
-        case OPT_FLOAT:
-            if (opt.short_opt)
-                sprintf(tempstr, "[-%c|--%.256s <float>] ",
-                        opt.short_opt,
-                        opt.long_opt
-                        );
-            else
-                sprintf(tempstr, "[--%.256s <float>] ", opt.long_opt);
-            break;
-        case OPT_STR:
-            if (opt.short_opt)
-                sprintf(tempstr, "[-%c|--%.256s <string>] ",
-                        opt.short_opt,
-                        opt.long_opt
-                        );
-            else
-                sprintf(tempstr, "[--%.256s <string>] ", opt.long_opt);
-            break;
-        default:
-            tempstr[0] = '\0'; // empty tempstring
-            assert(0==1); //un inplemented option type
+    if (!first) {
+        ret = help_write(w, SPACE, strlen(SPACE));
+        if (ret)
+            return ret;
     }
 
-    ret = num_characters(tempstr, &append_length);
+    text_buffer_clear(&w->piece);
+    if (opt.short_opt)
+        ret = text_buffer_append_fmt(&w->piece, "[-%c|--%.256s%s]",
+                                     opt.short_opt,
+                                     opt.long_opt,
+                                     option_value_hint(&opt)
+                                     );
+    else
+        ret = text_buffer_append_fmt(&w->piece, "[--%.256s%s]",
+                                     opt.long_opt,
+                                     option_value_hint(&opt)
+                                     );
+    if (ret)
+        return OPTION_OUT_OF_MEM;
+
+    ret = display_width(w->piece.buffer, &append_length);
     if (ret)
         return ret;
+    append_length++;    // the space after the option
 
     // Handle the case that the new option doc would overflow the maximum
     // line length.
     if (*llength + append_length >= maxwidth) {
-        ret = text_buffer_append(buf, "\n        ");
+        ret = help_write(w, "\n        ", 9);
         if (ret)
             return ret;
         *llength = 8;
     }
 
-    ret = text_buffer_append(buf, tempstr);
+    ret = help_write_piece(w);
     *llength += append_length;
     return ret;
 }
 
-int option_context_short_help(const option_context* options, char **help)
+/**
+ * \internal
+ * \brief Returns the help rendered at build time for a width or NULL.
+ *
+ * The help can only be used when it describes the current description.
+ */
+static const option_help_rendering*
+help_prerendered(const option_context* options, size_t width)
+{
+    const option_prerendered_help* pre = options->prerendered;
+    const char* description = option_context_get_description(options);
+
+    if (!pre)
+        return NULL;
+    if (description != pre->description &&
+        (!description || !pre->description ||
+         strcmp(description, pre->description) != 0))
+        return NULL;
+
+    for (unsigned i = 0; i < pre->n_renderings; i++)
+        if (pre->renderings[i].width > 0 &&
+            (size_t) pre->renderings[i].width == width)
+            return &pre->renderings[i];
+    return NULL;
+}
+
+/**
+ * \internal
+ * \brief Whether the usage line of the help rendered at build time names
+ *        the program.
+ */
+static int
+help_prerendered_prog(const option_context* options)
+{
+    const char* prog_name = option_context_prog_name(options);
+    return prog_name && strcmp(prog_name, options->prerendered->prog_name) == 0;
+}
+
+/**
+ * \internal
+ * \brief Writes the short help, the usage line.
+ */
+static int
+help_write_short(
+        help_writer*            w,
+        const option_context*   options,
+        size_t                  maxlength
+        )
 {
     int ret;
-    text_buffer_t buffer;
     size_t linelength       = 0;
-    const size_t maxlength  = get_terminal_width();
     size_t num_chars        = 0;
+    const option_help_rendering* pre = help_prerendered(options, maxlength);
 
-    if (options == NULL || help == NULL)
-        return OPTION_INVALID_ARGUMENT;
-    if (*help != NULL)
-        return OPTION_INVALID_ARGUMENT;
+    if (pre && help_prerendered_prog(options))
+        return help_write(w, pre->text, pre->short_length);
 
-    if (text_buffer_init(&buffer, 1024) != 0)
+    text_buffer_clear(&w->piece);
+    if (text_buffer_append_fmt(&w->piece, "Usage %.100s: ",
+                               option_context_prog_name(options)
+                               ) != 0)
         return OPTION_OUT_OF_MEM;
-
-    const char* header_fmt = "Usage %.100s: ";
-    char tempstr[BUFSIZ];
-    sprintf(tempstr, header_fmt, option_context_prog_name(options));
-
-    if (text_buffer_append(&buffer, tempstr) != 0) {
-        free(buffer.buffer);
-        return OPTION_OUT_OF_MEM;
-    }
-    ret = num_characters(tempstr, &num_chars);
-    if (ret) {
-        free(buffer.buffer);
+    ret = display_width(w->piece.buffer, &num_chars);
+    if (ret)
         return ret;
-    }
     linelength += num_chars;
+    ret = help_write_piece(w);
+    if (ret)
+        return ret;
 
     const cmd_option* predef_opts = option_context_get_predef_options(options);
 
     for (size_t i = 0; i < option_context_num_predef_options(options); i++) {
-        ret = format_short_opt(&buffer, predef_opts[i], maxlength, &linelength);
-        if (ret) {
-            free(buffer.buffer);
+        ret = format_short_opt(
+                w, predef_opts[i], i == 0, maxlength, &linelength
+                );
+        if (ret)
             return ret;
-        }
     }
-
-    if (option_context_num_predef_options(options) > 0) {
-        // eat last printed space.
-        text_buffer_shrink(&buffer, 1);
-    }
-
-    text_buffer_shrink_to_size(&buffer);
-    *help = buffer.buffer;
     return OPTION_OK;
 }
 
-int
-option_context_help(const option_context* options, char **help)
+/**
+ * \internal
+ * \brief Writes the long help, which starts with the short help.
+ */
+static int
+help_write_long(
+        help_writer*            w,
+        const option_context*   options,
+        size_t                  term_width
+        )
 {
     int         ret;                // Variable for (un-)successful function call
-    text_buffer_t buffer;           // Store the generated help is stored here
-    char        tempstr[BUFSIZ];
-    char*       short_help  = NULL; // The short help will be stored here.
-    const int   term_width = get_terminal_width();
     size_t      line_length = 0;
     const char* description_header = "description:\n";
+    const char* options_header = "\n\noptions:\n";
+    const option_help_rendering* pre = help_prerendered(options, term_width);
 
-    if (options == NULL || help == NULL || *help != NULL)
-        return OPTION_INVALID_ARGUMENT;
-
-    if (text_buffer_init(&buffer, 1024) != 0)
-        return OPTION_OUT_OF_MEM;
-    
-    // obtain the short help to store inside of the current text buffer.
-    ret = option_context_short_help(options, &short_help);
-    if (ret) {
-        return OPTION_OUT_OF_MEM;
-    }
-    ret = text_buffer_append(&buffer, short_help);
+    ret = help_write_short(w, options, term_width);
     if (ret)
-        return OPTION_OUT_OF_MEM;
+        return ret;
 
-    // clean up temporary variables.
-    free(short_help);
-    short_help = NULL;
+    // What follows the usage line doesn't depend on the program name.
+    if (pre)
+        return help_write(
+                w, pre->text + pre->short_length,
+                pre->length - pre->short_length
+                );
+
+    // Write two newlines
+    ret = help_write(w, "\n\n", 2);
+    if (ret)
+        return ret;
 
-    // Append two newlines
-    for (size_t i = 0; i < 2; i++) {
-        ret = text_buffer_append_char(&buffer, '\n');
-        if (ret) {
-            free(buffer.buffer);
-            return ret;
-        }
-    }
-    
     const char* description = option_context_get_description(options);
     if (description) {
 
-        ret = text_buffer_append(&buffer, description_header);
-        if (ret) {
-            free(buffer.buffer);
-            return OPTION_OUT_OF_MEM;
-        }
+        ret = help_write(w, description_header, strlen(description_header));
+        if (ret)
+            return ret;
 
-        ret = text_buffer_append(&buffer, LINE_HEADER);
-        if (ret) {
-            free(buffer.buffer);
-            return OPTION_OUT_OF_MEM;
-        }
+        ret = help_write(w, LINE_HEADER, strlen(LINE_HEADER));
+        if (ret)
+            return ret;
         line_length = strlen(LINE_HEADER);
-        ret = format_txt(&buffer, description, term_width, &line_length);
-        if (ret) {
-            free(buffer.buffer);
+        ret = format_txt(w, description, term_width, &line_length);
+        if (ret)
             return ret;
-        }
     }
 
-    ret = text_buffer_append(&buffer, "\n\noptions:\n");
-    if (ret) {
-        free(buffer.buffer);
-        return OPTION_OUT_OF_MEM;
-    }
+    ret = help_write(w, options_header, strlen(options_header));
+    if (ret)
+        return ret;
     line_length = 0;
 
     const cmd_option* predef_opts = option_context_get_predef_options(options);
 
     for (size_t i = 0; i < option_context_num_predef_options(options); i++) {
-        if (predef_opts[i].short_opt != '\0') {
-           const char* fmt       = "";
-           const char* fmt_flag  = "    [-%c|--%.256s]";
-           const char* fmt_int   = "    [-%c|--%.256s <int>]";
-           const char* fmt_float = "    [-%c|--%.256s <float>]";
-           const char* fmt_str   = "    [-%c|--%.256s <string>]";
-           switch(predef_opts[i].option_type) {
-               case OPT_FLAG:
-                   fmt = fmt_flag;
-                   break;
-               case OPT_INT:
-                   fmt = fmt_int;
-                   break;
-               case OPT_FLOAT:
-                   fmt = fmt_float;
-                   break;
-               case OPT_STR:
-                   fmt = fmt_str;
-                   break;
-               default:
-                   tempstr[0] = '\0';   // empty tempstring
-                   assert(0==1);        // unimplemented option type
-           }
-           sprintf(tempstr, fmt,
-                   predef_opts[i].short_opt,
-                   predef_opts[i].long_opt
-                   );
-        }
-        else {
-           const char* fmt       = "";
-           const char* fmt_flag  = "    [--%.256s]\n";
-           const char* fmt_int   = "    [--%.256s <int>]\n";
-           const char* fmt_float = "    [--%.256s <float>]\n";
-           const char* fmt_str   = "    [--%.256s <string>]\n";
-           switch(predef_opts[i].option_type) {
-               case OPT_FLAG:
-                   fmt = fmt_flag;
-                   break;
-               case OPT_INT:
-                   fmt = fmt_int;
-                   break;
-               case OPT_FLOAT:
-                   fmt = fmt_float;
-                   break;
-               case OPT_STR:
-                   fmt = fmt_str;
-                   break;
-               default:
-                   tempstr[0] = '\0'; // empty temp string
-                   assert(0==1); //unimplemented option type
-           }
-           sprintf(tempstr, fmt,
-                   predef_opts[i].long_opt
-                   );
-        }
-
-        int ret = text_buffer_append(&buffer, tempstr);
-        if (ret) {
-            free(buffer.buffer);
+        text_buffer_clear(&w->piece);
+        // An option without short variant ends with a new line.
+        if (predef_opts[i].short_opt != '\0')
+            ret = text_buffer_append_fmt(&w->piece, "    [-%c|--%.256s%s]",
+                                         predef_opts[i].short_opt,
+                                         predef_opts[i].long_opt,
+                                         option_value_hint(&predef_opts[i])
+                                         );
+        else
+            ret = text_buffer_append_fmt(&w->piece, "    [--%.256s%s]\n",
+                                         predef_opts[i].long_opt,
+                                         option_value_hint(&predef_opts[i])
+                                         );
+        if (ret)
+            return OPTION_OUT_OF_MEM;
+        ret = help_write_piece(w);
+        if (ret)
             return ret;
-        }
         line_length = strlen(LINE_HEADER);
 
         if (predef_opts[i].help) {
 
-            ret = text_buffer_append(&buffer, NEW_LINE);
-            if (ret) {
-                free(buffer.buffer);
+            ret = help_write(w, NEW_LINE, strlen(NEW_LINE));
+            if (ret)
                 return ret;
-            }
 
-            ret = text_buffer_append(&buffer, LINE_HEADER);
-            if (ret) {
-                free(buffer.buffer);
+            ret = help_write(w, LINE_HEADER, strlen(LINE_HEADER));
+            if (ret)
                 return ret;
-            }
             line_length = strlen(LINE_HEADER);
 
             ret = format_txt(
-                    &buffer,
+                    w,
                     predef_opts[i].help,
                     term_width,
                     &line_length
                     );
-            if (ret) {
-                free (buffer.buffer);
+            if (ret)
                 return ret;
-            }
         }
-        ret = text_buffer_append(&buffer, NEW_LINE);
-        if (ret) {
-            free(buffer.buffer);
+        ret = help_write(w, NEW_LINE, strlen(NEW_LINE));
+        if (ret)
             return ret;
-        }
         line_length = 0;
     }
-    
-    text_buffer_shrink_to_size(&buffer);
-    *help = buffer.buffer;
     return OPTION_OK;
 }
 
+/**
+ * \internal
+ * \brief Renders the short or long help for a terminal width.
+ */
+static int
+help_render(const option_context* options, size_t width, int full, char** help)
+{
+    int ret;
+    text_buffer_t buffer;
+    help_writer w;
+
+    if (text_buffer_init(&buffer, 1024) != 0)
+        return OPTION_OUT_OF_MEM;
+    w.buf = &buffer;
+    text_buffer_init(&w.piece, 0);
+
+    if (full)
+        ret = help_write_long(&w, options, width);
+    else
+        ret = help_write_short(&w, options, width);
+
+    if (ret == OPTION_OK && text_buffer_release(&buffer, help) != 0)
+        ret = OPTION_OUT_OF_MEM;
+    text_buffer_destroy(&w.piece);
+    text_buffer_destroy(&buffer);
+    return ret;
+}
+
+/**
+ * \internal
+ * \brief Writes the long help to the sink of w and flushes it.
+ */
+static int
+help_stream(const option_context* options, int width, help_writer* w)
+{
+    int ret;
+    size_t columns = width > 0 ? (size_t) width : (size_t) get_terminal_width();
+
+    w->buf          = NULL;
+    w->n_segments   = 0;
+    w->scratch_used = 0;
+    text_buffer_init(&w->piece, 0);
+
+    ret = help_write_long(w, options, columns);
+    if (ret == OPTION_OK)
+        ret = help_writer_flush(w);
+    text_buffer_destroy(&w->piece);
+    return ret;
+}
+
+int
+option_context_help_fd(const option_context* options, int width, int fd)
+{
+    help_writer w;
+
+    if (options == NULL || fd < 0)
+        return OPTION_INVALID_ARGUMENT;
+    w.fd        = fd;
+    w.file      = NULL;
+    w.callback  = NULL;
+    w.data      = NULL;
+    return help_stream(options, width, &w);
+}
+
+int
+option_context_help_file(const option_context* options, int width, FILE* file)
+{
+    help_writer w;
+
+    if (options == NULL || file == NULL)
+        return OPTION_INVALID_ARGUMENT;
+    w.fd        = -1;
+    w.file      = file;
+    w.callback  = NULL;
+    w.data      = NULL;
+    return help_stream(options, width, &w);
+}
+
+int
+option_context_help_write(
+        const option_context*   options,
+        int                     width,
+        option_output_callback  callback,
+        void*                   data
+        )
+{
+    help_writer w;
+
+    if (options == NULL || callback == NULL)
+        return OPTION_INVALID_ARGUMENT;
+    w.fd        = -1;
+    w.file      = NULL;
+    w.callback  = callback;
+    w.data      = data;
+    return help_stream(options, width, &w);
+}
+
+int option_context_short_help(const option_context* options, char **help)
+{
+    if (options == NULL || help == NULL)
+        return OPTION_INVALID_ARGUMENT;
+    if (*help != NULL)
+        return OPTION_INVALID_ARGUMENT;
+
+    return help_render(options, get_terminal_width(), 0, help);
+}
+
+int
+option_context_help(const option_context* options, char **help)
+{
+    if (options == NULL || help == NULL || *help != NULL)
+        return OPTION_INVALID_ARGUMENT;
+
+    return help_render(options, get_terminal_width(), 1, help);
+}
+
+/*
+ * Finds a rendered help in the cache.
+ */
+static const help_cache_entry*
+help_cache_find(const help_cache_entry* entry, size_t width, int full)
+{
+    for (; entry; entry = entry->next)
+        if (entry->width == width && entry->full == full)
+            return entry;
+    return NULL;
+}
+
+/*
+ * Returns the help from the cache, renders it when it isn't there.
+ *
+ * The cache is a list to which entries are only prepended with a compare
+ * and swap, so readers don't need a lock. When two threads render the
+ * same help, the one that loses the race uses the entry of the other.
+ */
+static int
+help_cached(const option_context* options, int width, int full, const char** help)
+{
+    help_cache_entry** cache;
+    help_cache_entry* head;
+    help_cache_entry* fresh;
+    const help_cache_entry* found;
+    size_t columns;
+    int ret;
+
+    if (options == NULL || help == NULL)
+        return OPTION_INVALID_ARGUMENT;
+    // The cache doesn't change what the context describes.
+    cache = (help_cache_entry**) &options->help_cache;
+    columns = width > 0 ? (size_t) width : (size_t) get_terminal_width();
+
+    if (full) {
+        const option_help_rendering* pre = help_prerendered(options, columns);
+        if (pre && help_prerendered_prog(options)) {
+            *help = pre->text;
+            return OPTION_OK;
+        }
+    }
+
+    head = atomic_load_ptr(cache);
+    found = help_cache_find(head, columns, full);
+    if (found) {
+        *help = found->text;
+        return OPTION_OK;
+    }
+
+    fresh = malloc(sizeof(help_cache_entry));
+    if (!fresh)
+        return OPTION_OUT_OF_MEM;
+    fresh->width    = columns;
+    fresh->full     = full;
+    fresh->text     = NULL;
+    ret = help_render(options, columns, full, &fresh->text);
+    if (ret) {
+        free(fresh);
+        return ret;
+    }
+
+    for (;;) {
+        fresh->next = head;
+        if (atomic_cas_ptr(cache, head, fresh))
+            break;
+        head = atomic_load_ptr(cache);
+        found = help_cache_find(head, columns, full);
+        if (found) {
+            free(fresh->text);
+            free(fresh);
+            *help = found->text;
+            return OPTION_OK;
+        }
+    }
+    *help = fresh->text;
+    return OPTION_OK;
+}
+
+int
+option_context_help_cached(
+        const option_context*   options,
+        int                     width,
+        const char**            help
+        )
+{
+    return help_cached(options, width, 1, help);
+}
+
+int
+option_context_short_help_cached(
+        const option_context*   options,
+        int                     width,
+        const char**            help
+        )
+{
+    return help_cached(options, width, 0, help);
+}
+
+void
+option_context_help_invalidate(option_context* options)
+{
+    help_cache_entry* entry;
+
+    if (!options)
+        return;
+    entry = atomic_exchange_ptr(&options->help_cache, NULL);
+    while (entry) {
+        help_cache_entry* next = entry->next;
+        free(entry->text);
+        free(entry);
+        entry = next;
+    }
+}
+
+int
+option_context_set_prerendered_help(
+        option_context*                 options,
+        const option_prerendered_help*  help
+        )
+{
+    if (!options)
+        return OPTION_INVALID_ARGUMENT;
+    if (help && help->n_options !=
+            (unsigned) option_context_num_predef_options(options))
+        return OPTION_INVALID_ARGUMENT;
+    options->prerendered = help;
+    option_context_help_invalidate(options);
+    return OPTION_OK;
+}
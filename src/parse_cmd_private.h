@@ -0,0 +1,242 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef PARSE_CMD_PRIVATE_H
+#define PARSE_CMD_PRIVATE_H
+
+/**
+ * \internal
+ * \file parse_cmd_private.h
+ *
+ * Definitions of the opaque structures of parse_cmd.h that are shared
+ * between the translation units of the library.
+ */
+
+#include "parse_cmd.h"
+#include "option_index.h"
+#include "response_file.h"
+#include "cmd_string.h"
+
+/**
+ * \internal
+ * A rendered help, see option_context_help_cached().
+ */
+typedef struct help_cache_entry {
+    struct help_cache_entry* next;      ///< The entry rendered before.
+    size_t          width;              ///< The terminal width.
+    int             full;               ///< The long or the short help.
+    char*           text;               ///< The help.
+} help_cache_entry;
+
+/**
+ * Stores the encountered options and arguments.
+ * \internal
+ */
+struct option_context {
+    const char*     program_name;       ///< Stores the name of the program.
+    const char*     program_description;///< A description of the program.
+    cmd_option**    options;            ///< The options specified by the user
+                                        //   on the command line.
+    const cmd_option* predef_options;   ///< The predefined options that
+                                        //   the program accepts.
+    int             n_predef_options;   ///< number of predefined options
+    const char**    args;               ///< The arguments specified on the
+                                        //   command line
+    int             n_options;          ///< Number of options specified
+                                        //   on the command line.
+    int             options_capacity;   ///< Capacity of options storage.
+    int             n_args;             ///< Number of arguments specified.
+    int             arguments_capacity; ///< Capacity of the arguments.
+    const option_index* index;          ///< Finds the predefined options.
+    option_index*   owned_index;        ///< Index owned by this context.
+    const char* const* argv;            ///< The command line parsed.
+    int             argc;               ///< Number of items in argv.
+    response_files  responses;          ///< The expanded response files.
+    cmd_string      split;              ///< The items of a command line that
+                                        //   was given as one string.
+    unsigned char*  sources;            ///< The OPTION_SOURCE of the value
+                                        //   of each predefined option or
+                                        //   NULL while argv is scanned.
+    file_map*       configs;            ///< The mapped configuration files.
+    int             n_configs;          ///< Number of mapped configs.
+    int             configs_capacity;   ///< Capacity of configs.
+    cmd_option*     owned_predef;       ///< A copy of the predefined options
+                                        //   owned by a snapshot of an
+                                        //   option_reloader.
+    unsigned        generation;         ///< The generation of a snapshot.
+    unsigned*       changed;            ///< The generation in which each
+                                        //   predefined option last changed.
+    file_map**      file_values;        ///< The mapped files of the OPT_FILE
+                                        //   options by predefined option,
+                                        //   created on first access.
+    help_cache_entry* help_cache;       ///< The help rendered so far.
+    const option_prerendered_help* prerendered;
+                                        ///< The help rendered at build time
+                                        //   or NULL.
+};
+
+/**
+ * \internal
+ * Where the value of an option came from, a source overrides the values
+ * of the sources before it.
+ */
+enum OPTION_SOURCE {
+    OPTION_SOURCE_NONE = 0,     ///< The option has its default value.
+    OPTION_SOURCE_FILE,         ///< The value came from a config file.
+    OPTION_SOURCE_ENV,          ///< The value came from the environment.
+    OPTION_SOURCE_ARGV,         ///< The value came from the command line.
+    /**
+     * Or'ed with the source of a flag that the source switched off, the
+     * flag isn't specified and less important sources can't switch it on.
+     */
+    OPTION_SOURCE_CLEARED = 1 << 7
+};
+
+/**
+ * Holds the options of all registered groups.
+ * \internal
+ */
+struct option_registry {
+    option_index    index;              ///< Finds the registered options.
+    cmd_option*     options;            ///< Copies of the registered options
+                                        //   with their namespaced names.
+    int             n_options;          ///< Number of registered options.
+    int             capacity;           ///< Capacity of options.
+};
+
+/**
+ * \internal
+ * \brief Adds all predefined options to an index that is initialized here.
+ *
+ * \returns OPTION_OK or OPTION_OUT_OF_MEM.
+ */
+int
+options_build_index(option_index* index, const cmd_option* opts, unsigned nopts);
+
+/**
+ * \internal
+ * \brief Finds the option of which the value is the item after token,
+ *        e.g. for "--name" or "-vc" when name and c take a value.
+ *
+ * \returns the position of the option or -1 when the next item isn't
+ *          a value.
+ */
+int
+options_value_follows(
+        const option_index* index,
+        const cmd_option*   predef_opts,
+        const char*         token
+        );
+
+/**
+ * \internal
+ * \brief Converts the value of an option as it appears on the command line.
+ *
+ * \returns OPTION_OK, OPTION_MISSING_VALUE when value is NULL but required
+ *          or OPTION_PARSE_ERROR.
+ */
+int
+option_convert_value(const cmd_option*  option,
+                     const char*        value,
+                     option_value*      out
+                     );
+
+/**
+ * \internal
+ * \brief Sets a predefined option from a source.
+ *
+ * The value is converted as a value from the command line. When a more
+ * important source already set the option, nothing happens. The same or a
+ * less important source is overridden in O(1). A false value, see
+ * option_value_is_false(), switches a flag off.
+ *
+ * \returns OPTION_OK or the error of converting the value.
+ */
+int
+options_merge_option(option_context*    options,
+                     int                position,
+                     const char*        value,
+                     int                source
+                     );
+
+/**
+ * \internal
+ * \brief Sets the options from environment variables.
+ *
+ * Walks the environment once, see option_parse_settings::env_prefix.
+ *
+ * \returns OPTION_OK or the first error, which is also reported.
+ */
+int
+options_merge_environment(option_context*               options,
+                          const option_parse_settings*  settings
+                          );
+
+/**
+ * \internal
+ * \brief Loads a configuration file as option_context_load_config().
+ *
+ * \param map_flags FILE_MAP_FLAGS in addition to FILE_MAP_WRITABLE and
+ *                  FILE_MAP_TERMINATED.
+ */
+int
+options_load_config(
+        option_context*                 options,
+        const char*                     path,
+        const option_parse_settings*    settings,
+        int                             map_flags
+        );
+
+/**
+ * \internal
+ * \brief Whether a value from the environment or a config file switches
+ * a flag off: "", "0", "false", "no" and "off" do.
+ */
+int
+option_value_is_false(const char* value);
+
+/**
+ * \internal
+ * \brief Returns the name of the value type of an option, e.g. "int".
+ */
+const char*
+option_type_name(const cmd_option* option);
+
+/**
+ * \internal
+ * \brief Stores a diagnostic if there is room and counts it.
+ */
+void
+option_diagnostics_add(option_diagnostics* diags, const option_diagnostic* diag);
+
+/**
+ * \internal
+ * \brief Reports a problem according to the settings.
+ *
+ * The diagnostic is recorded in settings->diagnostics when present and
+ * written to stderr unless OPTION_FLAG_SILENT is set. settings may be NULL.
+ */
+void
+options_report(
+        const option_parse_settings*    settings,
+        const option_diagnostic*        diag,
+        const char* const*              argv,
+        const cmd_option*               predef_opts
+        );
+
+#endif
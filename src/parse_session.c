@@ -0,0 +1,572 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file parse_session.c
+ *
+ * This file implements incremental parsing of a line that is being edited.
+ *
+ * The text of the line lives in a gap buffer and so do the tokens. The gap
+ * of both buffers follows the edits, so typing at the cursor moves nothing.
+ * Tokens in front of the gap store their offset from the start of the line,
+ * tokens after the gap store their distance to the end of the line; hence
+ * an edit doesn't need to touch the offsets of the tokens after it.
+ *
+ * An edit splits the tokens it touches again. The new tokens are resolved
+ * and so is the token in front of them, the tokens after them are resolved
+ * again only as long as the previous token changed whether they are the
+ * value of an option.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "parse_cmd.h"
+#include "parse_cmd_private.h"
+
+/**
+ * \internal
+ * A token of the line and what it was resolved to.
+ */
+typedef struct session_token {
+    size_t  offset;         ///< From the start of the line in front of the
+                            //   gap, from the end of the line after it.
+    size_t  length;         ///< Length of the token in bytes.
+    int     kind;           ///< OPTION_TOKEN_KIND
+    int     position;       ///< The predefined option or -1.
+    int     error;          ///< What is wrong with the token.
+    int     error_offset;   ///< Where it is wrong.
+    int     value_of;       ///< The option whose value this token is or -1.
+    int     wants_value;    ///< The option that takes the next token as
+                            //   value or -1.
+} session_token;
+
+/**
+ * \internal
+ * The state of an incremental parse.
+ */
+struct option_session {
+    option_index        index;      ///< Finds the predefined options.
+    const cmd_option*   predef;     ///< The predefined options.
+    char*               text;       ///< The line with a gap.
+    size_t              text_size;  ///< Capacity of text.
+    size_t              text_gap;   ///< Start of the gap in text.
+    size_t              text_gap_end;///< End of the gap in text.
+    session_token*      tokens;     ///< The tokens with a gap.
+    size_t              tokens_size;///< Capacity of tokens.
+    size_t              token_gap;  ///< Start of the gap in tokens.
+    size_t              token_gap_end;///< End of the gap in tokens.
+    char*               scratch;    ///< A '\0' terminated copy of a token.
+    size_t              scratch_size;///< Capacity of scratch.
+    unsigned            n_errors;   ///< Number of tokens with an error.
+};
+
+static int is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+           c == '\v' || c == '\f';
+}
+
+static size_t line_length(const option_session* s)
+{
+    return s->text_size - (s->text_gap_end - s->text_gap);
+}
+
+static size_t num_tokens(const option_session* s)
+{
+    return s->tokens_size - (s->token_gap_end - s->token_gap);
+}
+
+static session_token* token_ptr(const option_session* s, size_t i)
+{
+    if (i >= s->token_gap)
+        i += s->token_gap_end - s->token_gap;
+    return &s->tokens[i];
+}
+
+static size_t token_start(const option_session* s, size_t i)
+{
+    const session_token* t = token_ptr(s, i);
+    return i < s->token_gap ? t->offset : line_length(s) - t->offset;
+}
+
+static size_t token_end(const option_session* s, size_t i)
+{
+    return token_start(s, i) + token_ptr(s, i)->length;
+}
+
+static char char_at(const option_session* s, size_t pos)
+{
+    if (pos >= s->text_gap)
+        pos += s->text_gap_end - s->text_gap;
+    return s->text[pos];
+}
+
+/*
+ * Copies length bytes from pos onwards to out, the copy may span the gap.
+ */
+static void copy_text(const option_session* s, size_t pos, size_t length, char* out)
+{
+    if (pos < s->text_gap) {
+        size_t n = s->text_gap - pos;
+        if (n > length)
+            n = length;
+        memcpy(out, s->text + pos, n);
+        out += n;
+        pos += n;
+        length -= n;
+    }
+    if (length)
+        memcpy(out, s->text + pos + (s->text_gap_end - s->text_gap), length);
+}
+
+/*
+ * Makes sure the gaps have room for extra bytes and tokens.
+ */
+static int reserve_text(option_session* s, size_t extra)
+{
+    size_t tail = s->text_size - s->text_gap_end;
+    size_t size;
+    char* text;
+
+    if (s->text_gap_end - s->text_gap >= extra)
+        return OPTION_OK;
+    size = s->text_size * 2 + extra + 64;
+    text = realloc(s->text, size);
+    if (!text)
+        return OPTION_OUT_OF_MEM;
+    memmove(text + size - tail, text + s->text_gap_end, tail);
+    s->text         = text;
+    s->text_gap_end = size - tail;
+    s->text_size    = size;
+    return OPTION_OK;
+}
+
+static int reserve_tokens(option_session* s, size_t extra)
+{
+    size_t tail = s->tokens_size - s->token_gap_end;
+    size_t size;
+    session_token* tokens;
+
+    if (s->token_gap_end - s->token_gap >= extra)
+        return OPTION_OK;
+    size = s->tokens_size * 2 + extra + 16;
+    tokens = realloc(s->tokens, size * sizeof(session_token));
+    if (!tokens)
+        return OPTION_OUT_OF_MEM;
+    memmove(tokens + size - tail,
+            tokens + s->token_gap_end,
+            tail * sizeof(session_token)
+            );
+    s->tokens       = tokens;
+    s->token_gap_end= size - tail;
+    s->tokens_size  = size;
+    return OPTION_OK;
+}
+
+static int reserve_scratch(option_session* s, size_t size)
+{
+    char* scratch;
+    if (s->scratch_size >= size)
+        return OPTION_OK;
+    scratch = realloc(s->scratch, size);
+    if (!scratch)
+        return OPTION_OUT_OF_MEM;
+    s->scratch      = scratch;
+    s->scratch_size = size;
+    return OPTION_OK;
+}
+
+static void move_text_gap(option_session* s, size_t pos)
+{
+    size_t width = s->text_gap_end - s->text_gap;
+    if (pos < s->text_gap)
+        memmove(s->text + pos + width, s->text + pos, s->text_gap - pos);
+    else if (pos > s->text_gap)
+        memmove(s->text + s->text_gap, s->text_gap_end + s->text,
+                pos - s->text_gap);
+    s->text_gap     = pos;
+    s->text_gap_end = pos + width;
+}
+
+/*
+ * Moves the gap in front of token i. A token that crosses the gap changes
+ * from an offset to a distance from the end or back, both are length
+ * minus the other.
+ */
+static void move_token_gap(option_session* s, size_t i)
+{
+    size_t length = line_length(s);
+    while (s->token_gap > i) {
+        session_token* t = &s->tokens[--s->token_gap_end];
+        *t = s->tokens[--s->token_gap];
+        t->offset = length - t->offset;
+    }
+    while (s->token_gap < i) {
+        session_token* t = &s->tokens[s->token_gap++];
+        *t = s->tokens[s->token_gap_end++];
+        t->offset = length - t->offset;
+    }
+}
+
+/*
+ * The first token that ends at or after pos.
+ */
+static size_t find_token_ending(const option_session* s, size_t pos)
+{
+    size_t lo = 0, hi = num_tokens(s);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (token_end(s, mid) < pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * The first token that starts after pos.
+ */
+static size_t find_token_after(const option_session* s, size_t pos)
+{
+    size_t lo = 0, hi = num_tokens(s);
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (token_start(s, mid) <= pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void token_error(session_token* t, int error, int offset)
+{
+    t->error        = error;
+    t->error_offset = offset;
+}
+
+/*
+ * Interprets a token like options_scan() would, given the option whose
+ * value it is, if any, and whether a token follows it.
+ */
+static void
+resolve_token(const option_session* s,
+              session_token*        t,
+              const char*           str,
+              int                   value_of,
+              int                   has_next
+              )
+{
+    int n;
+
+    t->kind         = OPTION_TOKEN_ARGUMENT;
+    t->position     = -1;
+    t->value_of     = value_of;
+    t->wants_value  = -1;
+    token_error(t, OPTION_OK, 0);
+
+    if (value_of >= 0) {
+        option_value value;
+        t->kind     = OPTION_TOKEN_VALUE;
+        t->position = value_of;
+        if (option_convert_value(&s->predef[value_of], str, &value))
+            token_error(t, OPTION_PARSE_ERROR, 0);
+    }
+    else if (str[0] == '-' && str[1] == '-') {
+        const char* name = str + 2;
+        const char* equals = strchr(name, '=');
+        size_t name_length = equals ? (size_t)(equals - name) : strlen(name);
+
+        t->kind = OPTION_TOKEN_LONG;
+        n = option_index_find(&s->index, name, name_length);
+        if (n < 0) {
+            token_error(t, OPTION_UNKNOWN, 2);
+            return;
+        }
+        t->position = n;
+        if (equals) {
+            option_value value;
+            if (option_convert_value(&s->predef[n], equals + 1, &value))
+                token_error(t, OPTION_PARSE_ERROR, (int)(equals + 1 - str));
+        }
+        else if (s->predef[n].option_type != OPT_FLAG) {
+            if (has_next)
+                t->wants_value = n;
+            else
+                token_error(t, OPTION_MISSING_VALUE, 2);
+        }
+    }
+    else if (str[0] == '-' && str[1] != '\0') {
+        const char* c;
+
+        t->kind = OPTION_TOKEN_SHORT;
+        for (c = str + 1; *c != '\0' && *c != '='; c++) {
+            n = option_index_find_short(&s->index, *c);
+            if (n < 0) {
+                token_error(t, OPTION_UNKNOWN, (int)(c - str));
+                return;
+            }
+            t->position = n;
+            if (s->predef[n].option_type != OPT_FLAG) {
+                const char* rest = c + 1;
+                option_value value;
+                if (*rest == '\0') {
+                    if (has_next)
+                        t->wants_value = n;
+                    else
+                        token_error(t, OPTION_MISSING_VALUE, (int)(c - str));
+                    return;
+                }
+                if (*rest == '=')
+                    rest++;
+                if (option_convert_value(&s->predef[n], rest, &value))
+                    token_error(t, OPTION_PARSE_ERROR, (int)(rest - str));
+                return;
+            }
+        }
+    }
+}
+
+/*
+ * Resolves token i again and keeps the count of errors up to date.
+ */
+static int session_resolve(option_session* s, size_t i, int value_of)
+{
+    session_token* t = token_ptr(s, i);
+    int ret = reserve_scratch(s, t->length + 1);
+    if (ret)
+        return ret;
+
+    copy_text(s, token_start(s, i), t->length, s->scratch);
+    s->scratch[t->length] = '\0';
+
+    if (t->error)
+        s->n_errors--;
+    resolve_token(s, t, s->scratch, value_of, i + 1 < num_tokens(s));
+    if (t->error)
+        s->n_errors++;
+    return OPTION_OK;
+}
+
+/*
+ * Replaces remove bytes at offset by length bytes of text.
+ */
+static int
+session_edit(option_session*    s,
+             size_t             offset,
+             size_t             remove,
+             const char*        text,
+             size_t             length
+             )
+{
+    size_t old_length, first, last, start, end, i, n_new;
+    int ret;
+
+    if (!s || (length && !text))
+        return OPTION_INVALID_ARGUMENT;
+    old_length = line_length(s);
+    if (offset > old_length || remove > old_length - offset)
+        return OPTION_INVALID_ARGUMENT;
+
+    /* The tokens that touch the edited range are split again, together
+     * with the edit itself. The tokens around them are separated from the
+     * range by a blank that isn't edited.
+     */
+    first   = find_token_ending(s, offset);
+    last    = find_token_after(s, offset + remove);
+    start   = offset;
+    end     = offset + remove;
+    if (first < last) {
+        if (token_start(s, first) < start)
+            start = token_start(s, first);
+        if (token_end(s, last - 1) > end)
+            end = token_end(s, last - 1);
+    }
+    end = end - remove + length;
+
+    // Reserve everything up front, so a failure leaves the session intact.
+    ret = reserve_text(s, length);
+    if (!ret)
+        ret = reserve_tokens(s, (end - start + 1) / 2);
+    if (ret)
+        return ret;
+
+    move_token_gap(s, first);
+    for (i = first; i < last; i++)
+        if (s->tokens[s->token_gap_end++].error)
+            s->n_errors--;
+
+    move_text_gap(s, offset);
+    s->text_gap_end += remove;
+    if (length)
+        memcpy(s->text + s->text_gap, text, length);
+    s->text_gap += length;
+
+    for (i = start; i < end; i++) {
+        session_token* t;
+        if (is_blank(char_at(s, i)))
+            continue;
+        t = &s->tokens[s->token_gap++];
+        memset(t, 0, sizeof(session_token));
+        t->offset = i;
+        while (i < end && !is_blank(char_at(s, i)))
+            i++;
+        t->length = i - t->offset;
+    }
+    n_new = s->token_gap - first;
+
+    /* The token in front of the new ones may have lost or gained the token
+     * after it. After the new tokens, stop as soon as a token would
+     * be resolved in the same way as before.
+     */
+    for (i = first ? first - 1 : 0; i < num_tokens(s); i++) {
+        int value_of = i ? token_ptr(s, i - 1)->wants_value : -1;
+        if (i >= first + n_new && token_ptr(s, i)->value_of == value_of)
+            break;
+        ret = session_resolve(s, i, value_of);
+        if (ret)
+            return ret;
+    }
+    return OPTION_OK;
+}
+
+int
+option_session_create(
+        option_session**    session,
+        const cmd_option*   predef_opts,
+        unsigned            n_opts
+        )
+{
+    int ret;
+
+    if (!session || (n_opts && !predef_opts))
+        return OPTION_INVALID_ARGUMENT;
+    *session = calloc(1, sizeof(option_session));
+    if (!*session)
+        return OPTION_OUT_OF_MEM;
+    ret = options_build_index(&(*session)->index, predef_opts, n_opts);
+    if (ret) {
+        free(*session);
+        *session = NULL;
+        return ret;
+    }
+    (*session)->predef = predef_opts;
+    return OPTION_OK;
+}
+
+void
+option_session_free(option_session* session)
+{
+    if (!session)
+        return;
+    option_index_destroy(&session->index);
+    free(session->text);
+    free(session->tokens);
+    free(session->scratch);
+    free(session);
+}
+
+int
+option_session_insert(
+        option_session* session,
+        size_t          offset,
+        const char*     text,
+        size_t          length
+        )
+{
+    return session_edit(session, offset, 0, text, length);
+}
+
+int
+option_session_delete(option_session* session, size_t offset, size_t length)
+{
+    return session_edit(session, offset, length, NULL, 0);
+}
+
+size_t
+option_session_length(const option_session* session)
+{
+    return line_length(session);
+}
+
+size_t
+option_session_text(const option_session* session, char* buffer, size_t size)
+{
+    size_t length = line_length(session);
+    if (size) {
+        size_t n = length < size ? length : size - 1;
+        copy_text(session, 0, n, buffer);
+        buffer[n] = '\0';
+    }
+    return length;
+}
+
+size_t
+option_session_num_tokens(const option_session* session)
+{
+    return num_tokens(session);
+}
+
+int
+option_session_token(
+        const option_session*   session,
+        size_t                  nth,
+        option_token*           token
+        )
+{
+    const session_token* t;
+
+    if (!session || !token || nth >= num_tokens(session))
+        return OPTION_INVALID_ARGUMENT;
+
+    t = token_ptr(session, nth);
+    token->offset       = token_start(session, nth);
+    token->length       = t->length;
+    token->kind         = t->kind;
+    token->option_index = t->position;
+    token->error        = t->error;
+    token->error_offset = t->error_offset;
+    return OPTION_OK;
+}
+
+int
+option_session_token_at(
+        const option_session*   session,
+        size_t                  offset,
+        size_t*                 nth
+        )
+{
+    size_t i;
+
+    if (!session || !nth)
+        return OPTION_INVALID_ARGUMENT;
+    i = find_token_ending(session, offset);
+    if (i == num_tokens(session) || token_start(session, i) > offset)
+        return OPTION_NOT_SPECIFIED;
+    *nth = i;
+    return OPTION_OK;
+}
+
+unsigned
+option_session_num_errors(const option_session* session)
+{
+    return session->n_errors;
+}
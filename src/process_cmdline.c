@@ -0,0 +1,206 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file process_cmdline.c
+ *
+ * This file implements parsing the command line of the process from code
+ * that never sees the argv of main, e.g. a shared library. On Linux the
+ * command line is in /proc/self/cmdline as items that are terminated by
+ * '\0'. It is read once into one buffer and the items are pointed to in
+ * place; every parse in the process shares that argv.
+ */
+
+#if !defined(_MSC_VER)
+// open, read and the pthreads are POSIX.
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "parse_cmd.h"
+#include "parse_cmd_config.h"
+#include "parse_cmd_private.h"
+
+#if defined(HAVE_UNISTD_H) && defined(HAVE_FCNTL_H)
+#define PROCESS_CMDLINE_USE_PROC
+#include <unistd.h>
+#include <fcntl.h>
+#endif
+
+#if defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#endif
+
+/**
+ * \internal
+ * The command line of the process, it lives until the process exits.
+ */
+typedef struct process_cmdline {
+    char*           buffer;     ///< The items, each terminated by '\0'.
+    const char**    argv;       ///< Points into buffer.
+    int             argc;       ///< The number of items in argv.
+    int             error;      ///< OPTION_OK when the items are read.
+} process_cmdline;
+
+static process_cmdline g_cmdline;
+
+#if defined(PROCESS_CMDLINE_USE_PROC)
+
+/*
+ * Reads the whole file, the size of files in /proc is unknown in advance.
+ */
+static int
+read_cmdline(const char* path, char** buffer, size_t* size)
+{
+    size_t capacity = 4096, n = 0;
+    char* data = malloc(capacity);
+    int fd;
+
+    if (!data)
+        return OPTION_OUT_OF_MEM;
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        free(data);
+        return OPTION_FILE_ERROR;
+    }
+    for (;;) {
+        ssize_t r;
+        if (n + 1 == capacity) {
+            char* grown = realloc(data, capacity * 2);
+            if (!grown) {
+                free(data);
+                close(fd);
+                return OPTION_OUT_OF_MEM;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+        // Keep room for a '\0' after an unterminated last item.
+        r = read(fd, data + n, capacity - n - 1);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r < 0) {
+            free(data);
+            close(fd);
+            return OPTION_FILE_ERROR;
+        }
+        if (r == 0)
+            break;
+        n += (size_t) r;
+    }
+    close(fd);
+    data[n] = '\0';
+    *buffer = data;
+    *size = n;
+    return OPTION_OK;
+}
+
+static void
+process_cmdline_load(void)
+{
+    char* buffer = NULL;
+    size_t size = 0, i;
+    int argc = 0;
+    const char** argv;
+
+    g_cmdline.error = read_cmdline("/proc/self/cmdline", &buffer, &size);
+    if (g_cmdline.error)
+        return;
+
+    for (i = 0; i < size; i++)
+        if (buffer[i] == '\0')
+            argc++;
+    if (size > 0 && buffer[size - 1] != '\0')
+        argc++;     // a process may have overwritten its last '\0'
+    if (argc == 0) {
+        free(buffer);
+        g_cmdline.error = OPTION_FILE_ERROR;
+        return;
+    }
+
+    argv = malloc((size_t) argc * sizeof(const char*));
+    if (!argv) {
+        free(buffer);
+        g_cmdline.error = OPTION_OUT_OF_MEM;
+        return;
+    }
+    argc = 0;
+    for (i = 0; i < size; i += strlen(buffer + i) + 1)
+        argv[argc++] = buffer + i;
+
+    g_cmdline.buffer    = buffer;
+    g_cmdline.argv      = argv;
+    g_cmdline.argc      = argc;
+}
+
+#else
+
+static void
+process_cmdline_load(void)
+{
+    g_cmdline.error = OPTION_FILE_ERROR;
+}
+
+#endif
+
+/*
+ * Loads the command line on the first call.
+ */
+static const process_cmdline*
+process_cmdline_get(void)
+{
+#if defined(HAVE_PTHREAD_H)
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, process_cmdline_load);
+#else
+    static int loaded = 0;
+    if (!loaded) {
+        process_cmdline_load();
+        loaded = 1;
+    }
+#endif
+    return &g_cmdline;
+}
+
+int
+options_parse_process(
+        option_context**                options,
+        cmd_option*                     predef_opts,
+        unsigned                        nopts,
+        const option_parse_settings*    settings
+        )
+{
+    const process_cmdline* cmdline = process_cmdline_get();
+
+    if (cmdline->error) {
+        option_diagnostic diag = {cmdline->error, -1, 0, -1};
+        options_report(settings, &diag, NULL, NULL);
+        return cmdline->error;
+    }
+    return options_parse_ex(
+            options,
+            cmdline->argc,
+            cmdline->argv,
+            predef_opts,
+            nopts,
+            settings
+            );
+}
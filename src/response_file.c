@@ -0,0 +1,282 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \internal
+ * \file response_file.c
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "response_file.h"
+#include "parse_cmd_private.h"
+
+/**
+ * \internal
+ * Response files may include other response files up to this depth.
+ */
+#define RESPONSE_FILE_MAX_DEPTH 32
+
+/**
+ * \internal
+ * Identifies the response files that are being expanded, to detect
+ * files that (indirectly) include themselves.
+ */
+typedef struct response_file_stack {
+    unsigned long long  device[RESPONSE_FILE_MAX_DEPTH];
+    unsigned long long  inode[RESPONSE_FILE_MAX_DEPTH];
+    int                 depth;
+} response_file_stack;
+
+static int
+response_files_push_arg(response_files* files, const char* arg)
+{
+    if (files->argc == files->argv_capacity) {
+        int new_cap = files->argv_capacity ? files->argv_capacity * 2 : 64;
+        const char** new_argv = realloc(
+                (void*) files->argv, new_cap * sizeof(const char*)
+                );
+        if (!new_argv)
+            return OPTION_OUT_OF_MEM;
+        files->argv = new_argv;
+        files->argv_capacity = new_cap;
+    }
+    files->argv[files->argc++] = arg;
+
+    // An item after an option that takes a value is that value.
+    if (files->pending >= 0)
+        files->pending = -1;
+    else
+        files->pending = options_value_follows(files->index, files->predef, arg);
+    return OPTION_OK;
+}
+
+/*
+ * Whether an item names a response file, the value of an OPT_FILE option
+ * names the file of the value instead.
+ */
+static int
+response_files_is_file(const response_files* files, const char* item)
+{
+    if (item[0] != '@' || item[1] == '\0')
+        return 0;
+    return files->pending < 0 ||
+           files->predef[files->pending].option_type != OPT_FILE;
+}
+
+static int
+response_files_push_map(response_files* files, const file_map* map)
+{
+    if (files->n_maps == files->maps_capacity) {
+        int new_cap = files->maps_capacity ? files->maps_capacity * 2 : 4;
+        file_map* new_maps = realloc(files->maps, new_cap * sizeof(file_map));
+        if (!new_maps)
+            return OPTION_OUT_OF_MEM;
+        files->maps = new_maps;
+        files->maps_capacity = new_cap;
+    }
+    files->maps[files->n_maps++] = *map;
+    return OPTION_OK;
+}
+
+static int
+is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+           c == '\v' || c == '\f';
+}
+
+static int
+response_file_expand(
+        response_files*         files,
+        const char*             path,
+        response_file_stack*    stack
+        );
+
+/*
+ * Splits the contents of a response file into items. The items are
+ * unquoted in place, the write position never passes the read position
+ * so each item can be terminated by overwriting a byte already read.
+ * The byte after the contents of the file is a '\0' that terminates the
+ * last item.
+ */
+static int
+response_file_tokenize(
+        response_files*         files,
+        char*                   data,
+        size_t                  size,
+        response_file_stack*    stack
+        )
+{
+    const char* end = data + size;
+    const char* r   = data;
+    char*       w   = data;
+    int ret;
+
+    for (;;) {
+        char* item;
+        int quoted = 0;
+
+        while (r < end && is_space(*r))
+            r++;
+        if (r >= end)
+            break;
+
+        item = w;
+        while (r < end && !is_space(*r)) {
+            char c = *r++;
+            if (c == '\'') {
+                quoted = 1;
+                while (r < end && *r != '\'')
+                    *w++ = *r++;
+                if (r >= end)
+                    return OPTION_PARSE_ERROR; // unterminated quote
+                r++;
+            }
+            else if (c == '"') {
+                quoted = 1;
+                while (r < end && *r != '"') {
+                    if (*r == '\\' && r + 1 < end)
+                        r++;
+                    *w++ = *r++;
+                }
+                if (r >= end)
+                    return OPTION_PARSE_ERROR; // unterminated quote
+                r++;
+            }
+            else if (c == '\\' && r < end) {
+                *w++ = *r++;
+            }
+            else {
+                *w++ = c;
+            }
+        }
+        // r points past the separator or at the terminating '\0'.
+        if (r < end)
+            r++;
+        *w++ = '\0';
+
+        if (!quoted && response_files_is_file(files, item))
+            ret = response_file_expand(files, item + 1, stack);
+        else
+            ret = response_files_push_arg(files, item);
+        if (ret)
+            return ret;
+    }
+    return OPTION_OK;
+}
+
+static int
+response_file_expand(
+        response_files*         files,
+        const char*             path,
+        response_file_stack*    stack
+        )
+{
+    file_map map;
+    int i, ret;
+
+    ret = file_map_open(
+            &map,
+            path,
+            FILE_MAP_WRITABLE | FILE_MAP_TERMINATED | FILE_MAP_SEQUENTIAL
+            );
+    if (ret)
+        return ret;
+
+    for (i = 0; i < stack->depth; i++) {
+        if (map.inode != 0 &&
+            stack->device[i] == map.device && stack->inode[i] == map.inode) {
+            file_map_close(&map);
+            return OPTION_RECURSIVE_FILE;
+        }
+    }
+    if (stack->depth == RESPONSE_FILE_MAX_DEPTH) {
+        file_map_close(&map);
+        return OPTION_RECURSIVE_FILE;
+    }
+
+    ret = response_files_push_map(files, &map);
+    if (ret) {
+        file_map_close(&map);
+        return ret;
+    }
+
+    stack->device[stack->depth] = map.device;
+    stack->inode[stack->depth]  = map.inode;
+    stack->depth++;
+    ret = response_file_tokenize(files, map.data, map.size, stack);
+    stack->depth--;
+
+    return ret;
+}
+
+int
+response_files_expand(
+        response_files*     files,
+        int                 argc,
+        const char* const*  argv,
+        const option_index* index,
+        const cmd_option*   predef,
+        option_diagnostic*  diag
+        )
+{
+    int i, ret = OPTION_OK;
+    response_file_stack stack;
+
+    assert(files && argv && argc > 0 && index);
+
+    files->index    = index;
+    files->predef   = predef;
+    files->pending  = -1;
+    ret = response_files_push_arg(files, argv[0]);
+    // The name of the program isn't an option.
+    files->pending  = -1;
+    for (i = 1; i < argc && ret == OPTION_OK; i++) {
+        if (response_files_is_file(files, argv[i])) {
+            stack.depth = 0;
+            ret = response_file_expand(files, argv[i] + 1, &stack);
+        }
+        else {
+            ret = response_files_push_arg(files, argv[i]);
+        }
+    }
+
+    if (ret) {
+        diag->error         = ret;
+        diag->argv_index    = ret == OPTION_OUT_OF_MEM ? -1 : i - 1;
+        diag->byte_offset   = 1;
+        diag->option_index  = -1;
+    }
+    return ret;
+}
+
+void
+response_files_free(response_files* files)
+{
+    int i;
+    if (!files)
+        return;
+    for (i = 0; i < files->n_maps; i++)
+        file_map_close(&files->maps[i]);
+    free(files->maps);
+    free((void*) files->argv);
+    memset(files, 0, sizeof(response_files));
+}
@@ -0,0 +1,94 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef RESPONSE_FILE_H
+#define RESPONSE_FILE_H
+
+#include "parse_cmd.h"
+#include "file_map.h"
+#include "option_index.h"
+
+/**
+ * \internal
+ * \file response_file.h
+ *
+ * Expands "@file" items of a command line into the items stored in the
+ * file. The files are mapped into memory and split into items in place,
+ * the items of the expanded command line point into the mappings.
+ *
+ * Items in a response file are separated by white space. Text between
+ * single quotes is taken literally. Between double quotes and outside of
+ * quotes a backslash takes the next character literally. An item that
+ * starts with '@' is another response file.
+ *
+ * An item that is the value of an OPT_FILE option, as in "--rules @path",
+ * isn't expanded, "@path" names the file of the value.
+ */
+
+/**
+ * \internal
+ * The expanded command line and the mappings it points into.
+ */
+typedef struct response_files {
+    file_map*       maps;           ///< The mapped response files.
+    int             n_maps;         ///< Number of mapped files.
+    int             maps_capacity;  ///< Capacity of maps.
+    const char**    argv;           ///< The expanded command line.
+    int             argc;           ///< Number of items in argv.
+    int             argv_capacity;  ///< Capacity of argv.
+    const option_index* index;      ///< Finds the options of the schema.
+    const cmd_option*   predef;     ///< The options of the schema.
+    int             pending;        ///< The option of which the next item
+                                    //   is the value or -1.
+} response_files;
+
+/**
+ * \internal
+ * \brief Expands the response files in argv.
+ *
+ * @param [out] files The expanded command line, it should be zero
+ *                    initialized. It should be freed with
+ *                    response_files_free() even when this function fails.
+ * @param [in]  argc  Matches argc of main function.
+ * @param [in]  argv  Matches argv of main function.
+ * @param [in]  index Finds the options in predef.
+ * @param [in]  predef The options of the schema, the values of OPT_FILE
+ *                    options aren't expanded.
+ * @param [out] diag  Describes the problem when not successful, the
+ *                    argv_index refers to argv.
+ *
+ * \returns OPTION_OK when successful.
+ */
+int
+response_files_expand(
+        response_files*     files,
+        int                 argc,
+        const char* const*  argv,
+        const option_index* index,
+        const cmd_option*   predef,
+        option_diagnostic*  diag
+        );
+
+/**
+ * \internal
+ * \brief Frees the expanded command line and unmaps the files.
+ */
+void
+response_files_free(response_files* files);
+
+#endif
@@ -16,38 +16,194 @@
  * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA 
  */
 
-#include <wchar.h>
 #include <assert.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTF8_SSE2
+#endif
+
 #include "parse_cmd.h"
 #include "string_utils.h"
+#include "display_width_table.h"
 
-int num_characters(const char* mb_string, size_t* count)
+/*
+ * Returns the length of the UTF-8 sequence that starts with the lead byte c
+ * or 0 when c can't start one.
+ */
+static size_t utf8_sequence_length(unsigned char c)
 {
-    size_t cnt = 0;
-    mbstate_t state = {0};
-    const char* begin = mb_string;
-    const char* end = mb_string + strlen(mb_string);
-    size_t nbytes = end - begin;
+    if (c >= 0xC2 && c <= 0xDF)
+        return 2;
+    if (c >= 0xE0 && c <= 0xEF)
+        return 3;
+    if (c >= 0xF0 && c <= 0xF4)
+        return 4;
+    return 0;
+}
 
-    if (mb_string == NULL || count == NULL)
+/*
+ * Checks the continuation bytes of a sequence, the second byte excludes
+ * overlong forms, surrogates and code points above U+10FFFF.
+ */
+static int utf8_sequence_valid(const unsigned char* p, size_t n)
+{
+    unsigned char low = 0x80, high = 0xBF;
+    size_t i;
+
+    switch (p[0]) {
+        case 0xE0: low  = 0xA0; break;
+        case 0xED: high = 0x9F; break;
+        case 0xF0: low  = 0x90; break;
+        case 0xF4: high = 0x8F; break;
+        default: break;
+    }
+    if (p[1] < low || p[1] > high)
+        return 0;
+    for (i = 2; i < n; i++)
+        if (p[i] < 0x80 || p[i] > 0xBF)
+            return 0;
+    return 1;
+}
+
+/*
+ * Returns the number of bytes from the start of str that are ASCII, the
+ * bytes are tested 32 bytes at a time with SSE2, otherwise 8 at a time.
+ */
+static size_t ascii_prefix(const unsigned char* str, size_t length)
+{
+    size_t i = 0;
+#if defined(UTF8_SSE2)
+    for (; i + 32 <= length; i += 32) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (str + i));
+        __m128i b = _mm_loadu_si128((const __m128i*) (str + i + 16));
+        if (_mm_movemask_epi8(_mm_or_si128(a, b)))
+            break;
+    }
+    for (; i + 16 <= length; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*) (str + i));
+        int mask = _mm_movemask_epi8(a);
+        if (mask) {
+            // The lowest set bit is the first byte that isn't ASCII.
+            while (!(mask & 1)) {
+                mask >>= 1;
+                i++;
+            }
+            return i;
+        }
+    }
+#else
+    const uint64_t high_bits = UINT64_C(0x8080808080808080);
+    uint64_t word;
+    for (; i + sizeof(word) <= length; i += sizeof(word)) {
+        memcpy(&word, str + i, sizeof(word));
+        if (word & high_bits)
+            break;
+    }
+#endif
+    while (i < length && str[i] < 0x80)
+        i++;
+    return i;
+}
+
+int utf8_count(const char* str, size_t length, size_t* count, size_t* offset)
+{
+    const unsigned char* p = (const unsigned char*) str;
+    size_t i = 0, cnt = 0;
+
+    if (str == NULL && length)
         return OPTION_INVALID_ARGUMENT;
 
-    while(begin < end) {
-        size_t width = mbrlen(begin, nbytes, &state);
-        if (width == (size_t) - 1)
+    while (i < length) {
+        size_t ascii = ascii_prefix(p + i, length - i);
+        size_t n;
+
+        i   += ascii;
+        cnt += ascii;
+        if (i == length)
+            break;
+
+        n = utf8_sequence_length(p[i]);
+        if (n == 0 || n > length - i || !utf8_sequence_valid(p + i, n)) {
+            if (offset)
+                *offset = i;
             return OPTION_INVALID_ENCODING;
+        }
+        i += n;
         cnt++;
-        nbytes-= width;
-        begin += width;
     }
-    assert(end == begin);
-    *count = cnt;
+    if (count)
+        *count = cnt;
+    return OPTION_OK;
+}
+
+int num_characters_n(const char* str, size_t length, size_t* count)
+{
+    if (str == NULL || count == NULL)
+        return OPTION_INVALID_ARGUMENT;
+    return utf8_count(str, length, count, NULL);
+}
+
+/*
+ * Returns the number of columns a terminal uses for a code point.
+ */
+static unsigned code_point_width(unsigned long cp)
+{
+    unsigned block = display_width_blocks[cp >> DISPLAY_WIDTH_BLOCK_SHIFT];
+    unsigned low = cp & ((1u << DISPLAY_WIDTH_BLOCK_SHIFT) - 1);
+    return (display_width_bits[block][low >> 2] >> (2 * (low & 3))) & 3;
+}
+
+int display_width_n(const char* str, size_t length, size_t* width)
+{
+    const unsigned char* p = (const unsigned char*) str;
+    size_t i = 0, columns = 0;
+
+    if (str == NULL || width == NULL)
+        return OPTION_INVALID_ARGUMENT;
 
+    while (i < length) {
+        size_t ascii = ascii_prefix(p + i, length - i);
+        unsigned long cp;
+        size_t n, j;
+
+        // ASCII takes one column and never needs the table.
+        i       += ascii;
+        columns += ascii;
+        if (i == length)
+            break;
+
+        n = utf8_sequence_length(p[i]);
+        if (n == 0 || n > length - i || !utf8_sequence_valid(p + i, n))
+            return OPTION_INVALID_ENCODING;
+        cp = p[i] & (0xFF >> (n + 1));
+        for (j = 1; j < n; j++)
+            cp = (cp << 6) | (p[i + j] & 0x3F);
+        columns += code_point_width(cp);
+        i += n;
+    }
+    *width = columns;
     return OPTION_OK;
 }
 
+int display_width(const char* str, size_t* width)
+{
+    if (str == NULL || width == NULL)
+        return OPTION_INVALID_ARGUMENT;
+    return display_width_n(str, strlen(str), width);
+}
+
+int num_characters(const char* mb_string, size_t* count)
+{
+    if (mb_string == NULL || count == NULL)
+        return OPTION_INVALID_ARGUMENT;
+    return num_characters_n(mb_string, strlen(mb_string), count);
+}
+
 const char* 
 find_token(const char* haystack, const char* needle)
 {
@@ -30,11 +30,12 @@
 
 /**
  * \internal
- * \brief Counts the number of characters in a (multi) byte '\0' terminated
- *        string.
+ * \brief Counts the number of characters in a UTF-8 encoded '\0'
+ *        terminated string.
  *
  * This function can help with outlining multi byte characters. In contrast
- * to strlen, it will return a error when the string is NULL.
+ * to strlen, it will return a error when the string is NULL. The text is
+ * taken to be UTF-8 whatever the locale.
  *
  * \returns OPTION_OK when the number of characters in the string can be 
  *          OPTION_INVALID_ENCODING when the mb_str isn't encoded correctly.
@@ -42,6 +43,53 @@
 int
 num_characters(const char* mb_str, size_t* character_count);
 
+/**
+ * \internal
+ * \brief Counts the number of characters in length bytes of a UTF-8
+ *        encoded string, as num_characters().
+ */
+int
+num_characters_n(const char* mb_str, size_t length, size_t* character_count);
+
+/**
+ * \internal
+ * \brief Validates and counts the code points of length bytes of UTF-8.
+ *
+ * Runs of ASCII are skipped 16 or 32 bytes at a time with SSE2 when it's
+ * available, only the other bytes are decoded. Overlong forms, surrogates
+ * and code points beyond U+10FFFF are invalid.
+ *
+ * \param [in]  str     The text to inspect.
+ * \param [in]  length  The number of bytes of str.
+ * \param [out] count   The number of code points, may be NULL.
+ * \param [out] offset  The offset of the first invalid sequence, may be
+ *                      NULL.
+ *
+ * \returns OPTION_OK or OPTION_INVALID_ENCODING.
+ */
+int
+utf8_count(const char* str, size_t length, size_t* count, size_t* offset);
+
+/**
+ * \internal
+ * \brief Computes the number of terminal columns of length bytes of UTF-8.
+ *
+ * ASCII takes one column each and is skipped in runs, other code points
+ * are looked up in the table generated by tools/gen_display_width.py:
+ * combining marks take none, wide and fullwidth characters take two.
+ *
+ * \returns OPTION_OK, OPTION_INVALID_ARGUMENT or OPTION_INVALID_ENCODING.
+ */
+int
+display_width_n(const char* str, size_t length, size_t* width);
+
+/**
+ * \internal
+ * \brief Computes the number of terminal columns of a '\0' terminated UTF-8
+ *        string, as display_width_n().
+ */
+int
+display_width(const char* str, size_t* width);
 
 /**
  * Find a token in a string
@@ -22,10 +22,23 @@
  * \file terminal_utils.c
  *
  * Implements some utilities to obtain information about the terminal.
+ *
+ * The width is queried once and kept in an atomic, so the help functions
+ * get it with a single load. It is queried again after it is marked
+ * stale by option_terminal_invalidate() or by the SIGWINCH handler of
+ * option_terminal_watch_resize().
  */
 
+#if !defined(_MSC_VER)
+// isatty, ioctl and sigaction are POSIX.
+#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
+#include <signal.h>
+#include "parse_cmd.h"
 #include "terminal_utils.h"
+#include "atomic_utils.h"
 #include "parse_cmd_config.h"
 
 #if defined (HAVE_UNISTD_H)
@@ -36,19 +49,43 @@
 #include <sys/ioctl.h>
 #endif
 
+#if defined(HAVE_SIGACTION) && defined(SIGWINCH)
+#define TERMINAL_WATCH_RESIZE
+#endif
+
+/**
+ * \internal
+ * The cached width of the terminal, 0 when it is stale.
+ */
+static long terminal_width = 0;
+
+/**
+ * \internal
+ * Counts how often the width is marked stale, a query that overlaps with
+ * a resize doesn't keep its result.
+ */
+static long terminal_resizes = 0;
+
 #if defined(HAVE_IOCTL) && defined(HAVE_UNISTD_H) && defined(HAVE_SYS_IOCTL_H)
 static int
 get_term_width_via_ioctl()
 {
     struct winsize w;
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
-    return w.ws_col;    
+
+    // Output that is redirected has no size.
+    if (!isatty(STDOUT_FILENO))
+        return 0;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) != 0)
+        return 0;
+    return w.ws_col;
 }
 #endif
 
-
-int
-get_terminal_width()
+/*
+ * Obtains the width from COLUMNS, the terminal or the default of 80.
+ */
+static int
+query_terminal_width()
 {
     int ret_width = 0;
     char* char_width = getenv("COLUMNS");
@@ -66,3 +103,96 @@ get_terminal_width()
 
     return 80;
 }
+
+int
+get_terminal_width()
+{
+    long width = atomic_load_long(&terminal_width);
+    long resizes;
+
+    if (width > 0)
+        return (int) width;
+
+    resizes = atomic_load_long(&terminal_resizes);
+    width = query_terminal_width();
+    atomic_store_long(&terminal_width, width);
+    // The terminal was resized during the query, query it next time again.
+    if (atomic_load_long(&terminal_resizes) != resizes)
+        atomic_store_long(&terminal_width, 0);
+    return (int) width;
+}
+
+int
+option_terminal_width(void)
+{
+    return get_terminal_width();
+}
+
+void
+option_terminal_invalidate(void)
+{
+    // Only atomics, this runs in a signal handler.
+    atomic_increment(&terminal_resizes);
+    atomic_store_long(&terminal_width, 0);
+}
+
+#if defined(TERMINAL_WATCH_RESIZE)
+
+/**
+ * \internal
+ * The action for SIGWINCH before option_terminal_watch_resize().
+ */
+static struct sigaction terminal_old_action;
+
+/**
+ * \internal
+ * Whether the handler is installed.
+ */
+static int terminal_watching = 0;
+
+/*
+ * Marks the width stale and passes the signal on to the handler that
+ * was installed before.
+ */
+static void
+terminal_resized(int sig, siginfo_t* info, void* context)
+{
+    option_terminal_invalidate();
+    if (terminal_old_action.sa_flags & SA_SIGINFO) {
+        if (terminal_old_action.sa_sigaction)
+            terminal_old_action.sa_sigaction(sig, info, context);
+    }
+    else if (terminal_old_action.sa_handler != SIG_DFL &&
+             terminal_old_action.sa_handler != SIG_IGN)
+        terminal_old_action.sa_handler(sig);
+}
+
+#endif
+
+int
+option_terminal_watch_resize(int enable)
+{
+#if defined(TERMINAL_WATCH_RESIZE)
+    struct sigaction action;
+
+    if (enable && !terminal_watching) {
+        action.sa_sigaction = terminal_resized;
+        action.sa_flags     = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGWINCH, &action, &terminal_old_action) != 0)
+            return OPTION_INVALID_ARGUMENT;
+        terminal_watching = 1;
+    }
+    else if (!enable && terminal_watching) {
+        if (sigaction(SIGWINCH, &terminal_old_action, NULL) != 0)
+            return OPTION_INVALID_ARGUMENT;
+        terminal_watching = 0;
+    }
+    // The size may have changed while nobody watched.
+    option_terminal_invalidate();
+    return OPTION_OK;
+#else
+    (void) enable;
+    return OPTION_INVALID_ARGUMENT;
+#endif
+}
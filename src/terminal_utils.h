@@ -31,6 +31,9 @@
  * \internal
  * Try to deduce the terminal size.
  *
+ * The width is taken from COLUMNS or from the terminal on stdout once,
+ * after that it is a single atomic load until the width is marked stale.
+ *
  * \returns the obtained width of the terminal. If it can't be obtained
  *          a default of 80 is assumed.
  */
@@ -23,6 +23,8 @@
 
 #include "parse_cmd_config.h"
 #include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
 #include <assert.h>
 
 #if defined(HAVE_WCHAR_H)
@@ -33,6 +35,28 @@
 
 #include "text_buffer.h"
 
+static int
+text_buffer_is_inline(const text_buffer_t* buf)
+{
+    return buf->buffer == buf->inline_buffer;
+}
+
+/*
+ * Makes room for extra bytes and a terminating '\0', the capacity at
+ * least doubles.
+ */
+static int
+text_buffer_reserve(text_buffer_ptr buf, size_t extra)
+{
+    size_t new_cap;
+
+    if (buf->size + extra + 1 <= buf->capacity)
+        return 0;
+    new_cap = buf->size + extra + 1;
+    if (new_cap < buf->capacity * 2)
+        new_cap = buf->capacity * 2;
+    return text_buffer_new_capacity(buf, new_cap);
+}
 
 int
 text_buffer_init(text_buffer_ptr buf, size_t desired_capacity)
@@ -40,65 +64,155 @@ text_buffer_init(text_buffer_ptr buf, size_t desired_capacity)
     if (!buf)
         return -1;
 
-    if (desired_capacity < 2)
-        desired_capacity = 2;
-    
-    buf->buffer = calloc(desired_capacity, sizeof(char));
-    buf->size   = 0;
-    buf->capacity = desired_capacity;
+    buf->size = 0;
+    if (desired_capacity <= TEXT_BUFFER_INLINE_SIZE) {
+        buf->buffer     = buf->inline_buffer;
+        buf->capacity   = TEXT_BUFFER_INLINE_SIZE;
+    }
+    else {
+        buf->buffer     = malloc(desired_capacity);
+        buf->capacity   = desired_capacity;
+        if (!buf->buffer)
+            return -2;
+    }
+    buf->buffer[0] = '\0';
+    return 0;
+}
 
-    return buf->buffer != 0 ? 0 : -2;
+void
+text_buffer_destroy(text_buffer_ptr buf)
+{
+    if (!buf || !buf->buffer)
+        return;
+    if (!text_buffer_is_inline(buf))
+        free(buf->buffer);
+    buf->buffer     = NULL;
+    buf->size       = 0;
+    buf->capacity   = 0;
 }
 
 int
-text_buffer_append(text_buffer_ptr buf, const char* txt)
+text_buffer_release(text_buffer_ptr buf, char** out)
 {
-    size_t length;
-    int ret;
+    char* str;
 
+    if (!buf || !out)
+        return -1;
+
+    if (text_buffer_is_inline(buf)) {
+        str = malloc(buf->size + 1);
+        if (!str)
+            return -2;
+        memcpy(str, buf->buffer, buf->size + 1);
+    }
+    else {
+        str = realloc(buf->buffer, buf->size + 1);
+        if (!str)
+            str = buf->buffer;
+    }
+    *out = str;
+    buf->buffer = NULL;
+    text_buffer_init(buf, 0);
+    return 0;
+}
+
+int
+text_buffer_append(text_buffer_ptr buf, const char* txt)
+{
     if (!buf || !txt)
         return -1;
+    return text_buffer_append_size(buf, txt, strlen(txt));
+}
+
+int
+text_buffer_append_size(text_buffer_ptr buf, const char* txt, size_t size)
+{
+    int ret;
 
-    length = strlen(txt);
+    if (!buf || (!txt && size))
+        return -1;
 
     // Make sure that we have enough space in the buffer to store the old string
     // + the new + a terminating '\0'.
-    if(buf->size + length + 1 > buf->capacity) {
-        size_t new_cap = buf->size + length + 1;
-        if (new_cap < buf->capacity * 2)
-            new_cap = buf->capacity * 2;
+    ret = text_buffer_reserve(buf, size);
+    if (ret)
+        return ret;
 
-        ret = text_buffer_new_capacity(buf, new_cap);
-        if (ret)
-            return ret;
-    }
-
-    strcat(buf->buffer + buf->size, txt);
-    buf->size += length;
+    if (size)
+        memcpy(buf->buffer + buf->size, txt, size);
+    buf->size += size;
+    buf->buffer[buf->size] = '\0';
     return 0;
 }
 
 int
 text_buffer_append_char(text_buffer_ptr buf, char c)
 {
-    char tempstr[2] = {c,'\0'};
-    return text_buffer_append(buf, tempstr);
+    int ret;
+
+    if (!buf)
+        return -1;
+    ret = text_buffer_reserve(buf, 1);
+    if (ret)
+        return ret;
+    buf->buffer[buf->size++] = c;
+    buf->buffer[buf->size] = '\0';
+    return 0;
+}
+
+int
+text_buffer_append_fmt(text_buffer_ptr buf, const char* fmt, ...)
+{
+    va_list args;
+    int n, ret;
+
+    if (!buf || !fmt)
+        return -1;
+
+    va_start(args, fmt);
+    n = vsnprintf(buf->buffer + buf->size, buf->capacity - buf->size, fmt, args);
+    va_end(args);
+    if (n < 0) {
+        buf->buffer[buf->size] = '\0';
+        return -1;
+    }
+
+    if ((size_t) n >= buf->capacity - buf->size) {
+        ret = text_buffer_reserve(buf, (size_t) n);
+        if (ret) {
+            buf->buffer[buf->size] = '\0';
+            return ret;
+        }
+        va_start(args, fmt);
+        vsnprintf(buf->buffer + buf->size, buf->capacity - buf->size, fmt, args);
+        va_end(args);
+    }
+    buf->size += (size_t) n;
+    return 0;
 }
 
 int
 text_buffer_new_capacity(text_buffer_ptr buf, size_t cap)
 {
-    if (!buf)
+    char* newptr;
+
+    if (!buf || cap <= buf->size)
         return -1;
 
-    char* oldptr = buf->buffer;
-    buf->buffer = realloc(buf->buffer, cap);
+    if (text_buffer_is_inline(buf)) {
+        if (cap <= TEXT_BUFFER_INLINE_SIZE)
+            return 0;
+        newptr = malloc(cap);
+        if (newptr)
+            memcpy(newptr, buf->buffer, buf->size + 1);
+    }
+    else
+        newptr = realloc(buf->buffer, cap);
 
-    if (!buf->buffer) {
-        buf->buffer = oldptr;
+    if (!newptr)
         return -2;
-    }
-    buf->capacity = cap;
+    buf->buffer     = newptr;
+    buf->capacity   = cap;
     return 0;
 }
 
@@ -119,21 +233,3 @@ text_buffer_clear(text_buffer_ptr buf)
     buf->size = 0;
     buf->buffer[0] = '\0';
 }
-
-int
-text_buffer_shrink_to_size(text_buffer_ptr buf)
-{
-    size_t desired_cap = buf->size + 1;
-    if (buf->capacity > desired_cap) {
-        char* old = buf->buffer;
-        buf->buffer = realloc(buf->buffer, desired_cap);
-        assert(buf->buffer[buf->size] == '\0');
-        if (!buf->buffer) {
-            buf->buffer = old;
-            return -1;
-        }
-        buf->capacity = desired_cap;
-    }
-    return 0;
-}
-
@@ -34,14 +34,21 @@
  * which the length is yet unknown.
  */
 
+/**
+ * \internal
+ * The number of bytes a text_buffer_t stores without allocating memory.
+ */
+#define TEXT_BUFFER_INLINE_SIZE 64
+
 /**
  * A text buffer is used to build some strings.
  *
  * TextBuffer are typically created on the stack. Then the user should
  * call text_buffer_init() on them to initialize the variable.
- * They have a buffer that can be used as a return value for a function that
- * builds a string as an output value. The user/caller is then responsible
- * to free the buffer.
+ * Short strings are stored inside the text buffer itself, longer ones on
+ * the heap. Hence a text buffer must not be copied and must be released
+ * with text_buffer_destroy(). text_buffer_release() hands the string over
+ * to a caller that should free it.
  *
  * \internal
  */
@@ -49,6 +56,8 @@ typedef struct text_buffer {
     char*   buffer;      ///< the '\0' delimited text buffer.
     size_t  size;        ///< size of the text buffer.
     size_t  capacity;    ///< capacity of the buffer.
+    char    inline_buffer[TEXT_BUFFER_INLINE_SIZE]; ///< storage for short
+                                                    //   strings.
 } text_buffer_t;
 
 /**
@@ -62,7 +71,8 @@ typedef text_buffer_t* text_buffer_ptr;
  * Initialize a text buffer .
  *
  * Text buffer init initializes a text_buffer_t instance. The struct
- * is initialized in such way that a members have a valid value.
+ * is initialized in such way that a members have a valid value. No memory
+ * is allocated when desired_capacity is at most TEXT_BUFFER_INLINE_SIZE.
  *
  * @param buf               the buffer you want to initialize
  * @param desired_capacity  the desired capacity of the buffer buf->buffer.
@@ -73,11 +83,31 @@ typedef text_buffer_t* text_buffer_ptr;
 int
 text_buffer_init(text_buffer_ptr buf, size_t desired_capacity);
 
+/**
+ * \internal
+ * \brief Releases the memory of a text buffer.
+ */
+void
+text_buffer_destroy(text_buffer_ptr buf);
+
+/**
+ * \internal
+ * \brief Hands the string over to the caller.
+ *
+ * The string is moved to the heap if it was stored inline and trimmed to
+ * its size. The caller should free() *out, buf is empty afterwards.
+ *
+ * \returns 0 when successful
+ */
+int
+text_buffer_release(text_buffer_ptr buf, char** out);
+
 /**
  * Append a new '\0' delimited string to the buffer
  *
  * Appends a new string. If the string would overflow the current buffer size
- * the text_buffer will try to update it's capacity. 
+ * the text_buffer will try to update it's capacity. The capacity at least
+ * doubles, so appending is amortized linear in the length of txt.
  *
  * @param [in, out] buf the buffer you want to append to
  * @param [in]      txt the '\0' delimited string to append to the current buffer.
@@ -99,10 +129,29 @@ text_buffer_append(text_buffer_ptr buf, const char* txt);
  * @param [in]     txt  A string to write to the buffer
  * @param [in]     size Size number of bytes (including '\0' bytes
  *                      will be written tot the output.
+ *
+ * \returns 0 when successful
+ * \internal
  */
 int
 text_buffer_append_size(text_buffer_ptr buf, const char* txt, size_t size);
 
+/**
+ * \internal
+ * \brief Appends printf style formatted text to the buffer.
+ *
+ * The text is formatted in place, only when it doesn't fit is the buffer
+ * grown and the text formatted once more.
+ *
+ * \returns 0 when successful
+ */
+int
+text_buffer_append_fmt(text_buffer_ptr buf, const char* fmt, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
 /**
  * \internal
  * \brief Append a character to the current buffer.
@@ -155,16 +204,4 @@ text_buffer_shrink(text_buffer_ptr buf, size_t size);
 void
 text_buffer_clear(text_buffer_ptr buf);
 
-/**
- * \internal
- * \brief Minimalize the capacity of the buffer
- *
- * Calling this function on a text_buffer_t in
- * reduces the buffer in such a way that the buffer is a valid
- * C '\0' terminated string. The string should than only use precisely enough
- * bytes to match the string length plus the terminating null byte.
- */
-int
-text_buffer_shrink_to_size(text_buffer_ptr buf);
-
 #endif
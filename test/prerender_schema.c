@@ -0,0 +1,39 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * The schema of which the help is rendered at build time for the unit
+ * tests, see parse_cmd_prerender_help() in test/CMakeLists.txt.
+ */
+
+#include <stddef.h>
+#include "../src/parse_cmd.h"
+
+cmd_option prerender_opts[] = {
+    {'c', "count",      OPT_INT,    {0}, "The number of times to do it."},
+    {'v', "verbose",    OPT_FLAG,   {0}, "Tells what happens, this help is "
+                                         "long enough to be wrapped at 80 "
+                                         "columns."},
+    {'\0',"name",       OPT_STR,    {0}, NULL},
+    {'i', "input",      OPT_FILE,   {0}, "Reads the input from a file."}
+};
+
+size_t prerender_opts_sz = sizeof(prerender_opts)/sizeof(prerender_opts[0]);
+
+const char prerender_description[] =
+    "Tests the help that is rendered at build time.";
@@ -15,9 +15,16 @@
  * along with c-lib.  If not, see <http://www.gnu.org/licenses/>
  */
 
+// setenv() and strdup() for the tests that depend on the terminal width.
+#define _POSIX_C_SOURCE 200809L
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <CUnit/CUnit.h>
 #include <CUnit/Basic.h>
 #include "../src/parse_cmd.h"
@@ -369,6 +376,8 @@ void short_help_test()
     option_context* options = NULL;
     int argc, ret;
     char* help = NULL;
+    const char* columns;
+    char* saved;
     cmd_option predef_opts[] = {
         {'i', "int",        OPT_INT,    },
         {'f', "float",      OPT_FLOAT,  },
@@ -408,6 +417,12 @@ void short_help_test()
         return;
     }
 
+    // The usage line fits on one line of a wide terminal, whatever stdout is.
+    columns = getenv("COLUMNS");
+    saved = columns ? strdup(columns) : NULL;
+    setenv("COLUMNS", "200", 1);
+    option_terminal_invalidate();
+
     option_context_short_help(options, &help);
     CU_ASSERT_STRING_EQUAL(help, expected_output);
     if (strcmp(help, expected_output) != 0) {
@@ -418,10 +433,1547 @@ void short_help_test()
                         );
     }
 
-    free(help);
+    if (saved)
+        setenv("COLUMNS", saved, 1);
+    else
+        unsetenv("COLUMNS");
+    option_terminal_invalidate();
+    free(saved);
+    free(help);
+
+    option_context_free(options);
+    options = NULL;
+}
+
+cmd_option plugin_opts[] = {
+    {'t', "threads",    OPT_INT},
+    {'o', "output",     OPT_STR}
+};
+
+cmd_option host_opts[] = {
+    {'v', "verbose",    OPT_FLAG},
+    {'t', "threads",    OPT_INT}
+};
+
+void registry_test()
+{
+    option_registry* registry = NULL;
+    option_context* options = NULL;
+    option_diagnostic records[4];
+    option_diagnostics diags = {records, 4, 0};
+    option_parse_settings settings = {OPTION_FLAG_SILENT, &diags};
+    const char* bad_args[] = {
+        "registry-test", "--output", "--plugin.threads=many"
+    };
+    int argc, ret, val;
+    const char* str = NULL;
+
+    ret = option_registry_create(&registry);
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+
+    ret = option_registry_add(registry, NULL, host_opts, 2);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    ret = option_registry_add(registry, "plugin", plugin_opts, 2);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    CU_ASSERT_EQUAL(option_registry_num_options(registry), 4);
+
+    // the group already exists, the registry should remain unmodified.
+    ret = option_registry_add(registry, "plugin", plugin_opts, 2);
+    CU_ASSERT_EQUAL(ret, OPTION_DUPLICATE);
+    CU_ASSERT_EQUAL(option_registry_num_options(registry), 4);
+
+    CU_ASSERT_PTR_NOT_NULL(option_registry_find(registry, "plugin.output"));
+    CU_ASSERT_PTR_NULL(option_registry_find(registry, "output"));
+
+    const char* args[] = {
+        "registry-test",
+        "-v",
+        "-t", "4",
+        "--plugin.threads=8",
+        "--plugin.output", "out.txt"
+    };
+    argc = sizeof(args)/sizeof(args[0]);
+
+    ret = options_parse_registry(&options, argc, args, registry);
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+
+    CU_ASSERT(option_context_have_option(options, "verbose"));
+    option_context_int_value(options, "threads", &val);
+    CU_ASSERT_EQUAL(val, 4);
+    option_context_int_value(options, "plugin.threads", &val);
+    CU_ASSERT_EQUAL(val, 8);
+    option_context_str_value(options, "plugin.output", &str);
+    CU_ASSERT_STRING_EQUAL(str, "out.txt");
+
+    // Validating uses the index of the registry.
+    ret = options_validate_registry(argc, args, registry, &settings);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    CU_ASSERT_EQUAL(diags.count, 0);
+    ret = options_validate_registry(3, bad_args, registry, &settings);
+    CU_ASSERT_EQUAL(ret, OPTION_UNKNOWN);
+    CU_ASSERT_EQUAL_FATAL(diags.count, 2);
+    CU_ASSERT_EQUAL(records[0].argv_index, 1);
+    CU_ASSERT_EQUAL(records[1].error, OPTION_PARSE_ERROR);
+    CU_ASSERT_EQUAL(records[1].argv_index, 2);
+    CU_ASSERT_EQUAL(
+            options_validate_registry(argc, args, NULL, &settings),
+            OPTION_INVALID_ARGUMENT
+            );
+
+    option_context_free(options);
+    option_registry_free(registry);
+}
+
+void validate_test()
+{
+    int argc, ret;
+    unsigned n = 0;
+    option_diagnostic diags[8];
+
+    const char* good[] = {
+        "validate-test",
+        "-c", "gcc",
+        "-vx3",
+        "--y-coor=2.5",
+        "an-argument"
+    };
+    argc = sizeof(good)/sizeof(good[0]);
+    ret = options_validate(argc, good, failure_opts, failure_opts_sz,
+                           diags, 8, &n);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    CU_ASSERT_EQUAL(n, 0);
+
+    const char* bad[] = {
+        "validate-test",
+        "--unknown",
+        "-x", "3.14",
+        "-q",
+        "--y-coor"
+    };
+    argc = sizeof(bad)/sizeof(bad[0]);
+    ret = options_validate(argc, bad, failure_opts, failure_opts_sz,
+                           diags, 8, &n);
+    CU_ASSERT_EQUAL(ret, OPTION_UNKNOWN);
+    CU_ASSERT_EQUAL_FATAL(n, 4);
+
+    CU_ASSERT_EQUAL(diags[0].error, OPTION_UNKNOWN);
+    CU_ASSERT_EQUAL(diags[0].argv_index, 1);
+    CU_ASSERT_EQUAL(diags[0].option_index, -1);
+    CU_ASSERT_EQUAL(diags[1].error, OPTION_PARSE_ERROR);
+    CU_ASSERT_EQUAL(diags[1].argv_index, 3); // points at the value
+    CU_ASSERT_EQUAL(diags[1].byte_offset, 0);
+    CU_ASSERT_EQUAL(diags[1].option_index, 2);
+    CU_ASSERT_EQUAL(diags[2].error, OPTION_UNKNOWN);
+    CU_ASSERT_EQUAL(diags[2].argv_index, 4);
+    CU_ASSERT_EQUAL(diags[2].byte_offset, 1);
+    CU_ASSERT_EQUAL(diags[3].error, OPTION_MISSING_VALUE);
+    CU_ASSERT_EQUAL(diags[3].argv_index, 5);
+    CU_ASSERT_EQUAL(diags[3].option_index, 3);
+
+    // Only count when there is no room.
+    ret = options_validate(argc, bad, failure_opts, failure_opts_sz,
+                           NULL, 0, &n);
+    CU_ASSERT_EQUAL(ret, OPTION_PARSE_ERROR);
+    CU_ASSERT_EQUAL(n, 4);
+}
+
+void diagnostics_test()
+{
+    option_context* options = NULL;
+    option_diagnostic records[4];
+    option_diagnostics diags = {records, 4, 0};
+    option_parse_settings settings = {OPTION_FLAG_SILENT, &diags};
+    char message[128];
+    int argc, ret;
+
+    const char* args[] = {
+        "diagnostics-test",
+        "-vx=12a"
+    };
+    argc = sizeof(args)/sizeof(args[0]);
+
+    ret = options_parse_ex(
+            &options, argc, args, failure_opts, failure_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL(ret, OPTION_PARSE_ERROR);
+    CU_ASSERT_PTR_NULL(options);
+    CU_ASSERT_EQUAL_FATAL(diags.count, 1);
+    CU_ASSERT_EQUAL(records[0].error, OPTION_PARSE_ERROR);
+    CU_ASSERT_EQUAL(records[0].argv_index, 1);
+    CU_ASSERT_EQUAL(records[0].byte_offset, 4);
+    CU_ASSERT_EQUAL(records[0].option_index, 2);
+
+    option_diagnostic_format(
+            &records[0], args, failure_opts, message, sizeof(message)
+            );
+    CU_ASSERT_STRING_EQUAL(message, "option --x-coor: expected int argument");
+}
+
+void encoding_test()
+{
+    option_context* options = NULL;
+    option_diagnostic records[4];
+    option_diagnostics diags = {records, 4, 0};
+    option_parse_settings settings = {
+        OPTION_FLAG_SILENT | OPTION_FLAG_VALIDATE_UTF8, &diags
+    };
+    const char* str = NULL;
+    char* help = NULL;
+    int argc, ret;
+
+    const char* valid[] = {
+        "encoding-test",
+        "-c", "g\xc3\xbc\xe6\xbc\xa2\xf0\x9f\x98\x80",
+        "an argument that is longer than thirty two bytes of ASCII"
+    };
+    const char* invalid[] = {
+        "encoding-test",
+        "-v",
+        "-c", "0123456789abcdef0123456789abcdef\xed\xa0\x80"
+    };
+
+    argc = sizeof(valid)/sizeof(valid[0]);
+    ret = options_parse_ex(
+            &options, argc, valid, failure_opts, failure_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+    option_context_str_value(options, "compiler", &str);
+    CU_ASSERT_STRING_EQUAL(str, valid[2]);
+    option_context_free(options);
+    options = NULL;
+
+    // A surrogate in the value of an option, after a run of ASCII.
+    argc = sizeof(invalid)/sizeof(invalid[0]);
+    ret = options_parse_ex(
+            &options, argc, invalid, failure_opts, failure_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL(ret, OPTION_INVALID_ENCODING);
+    CU_ASSERT_PTR_NULL(options);
+    CU_ASSERT_EQUAL_FATAL(diags.count, 1);
+    CU_ASSERT_EQUAL(records[0].argv_index, 3);
+    CU_ASSERT_EQUAL(records[0].byte_offset, 32);
+
+    // Without the flag anything goes.
+    ret = options_parse(&options, argc, invalid, failure_opts, failure_opts_sz);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    option_context_free(options);
+    options = NULL;
+
+    // The help is measured as UTF-8, whatever the locale.
+    cmd_option described[] = {
+        {'u', "unicode", OPT_FLAG, {0}, "\xc3\xbc\xc3\xbc \xc3\xbc\xc3\xbc"}
+    };
+    ret = options_parse(&options, 1, valid, described, 1);
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+    CU_ASSERT_EQUAL(option_context_help(options, &help), OPTION_OK);
+    CU_ASSERT_PTR_NOT_NULL(help);
+    free(help);
+    option_context_free(options);
+}
+
+void wide_help_test()
+{
+    option_context* options = NULL;
+    char* help = NULL;
+    const char* columns = getenv("COLUMNS");
+    char* saved = columns ? strdup(columns) : NULL;
+    const char* args[] = {"wide-help-test"};
+    // Three words of four ideographs, that is eight columns each.
+    cmd_option wide[] = {
+        {'w', "wide", OPT_FLAG, {0},
+         "\xe6\xbc\xa2\xe5\xad\x97\xe6\xbc\xa2\xe5\xad\x97 "
+         "\xe6\xbc\xa2\xe5\xad\x97\xe6\xbc\xa2\xe5\xad\x97 "
+         "\xe6\xbc\xa2\xe5\xad\x97\xe6\xbc\xa2\xe5\xad\x97"}
+    };
+
+    setenv("COLUMNS", "30", 1);
+    option_terminal_invalidate();
+    CU_ASSERT_EQUAL_FATAL(options_parse(&options, 1, args, wide, 1), OPTION_OK);
+    CU_ASSERT_EQUAL(option_context_help(options, &help), OPTION_OK);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(help);
+    // 8 columns of indentation and two words leave no room for the third.
+    CU_ASSERT_PTR_NOT_NULL(
+            strstr(help, "\xe5\xad\x97 \n        \xe6\xbc\xa2")
+            );
+    free(help);
+    option_context_free(options);
+
+    if (saved)
+        setenv("COLUMNS", saved, 1);
+    else
+        unsetenv("COLUMNS");
+    option_terminal_invalidate();
+    free(saved);
+}
+
+void terminal_width_test()
+{
+    const char* columns = getenv("COLUMNS");
+    char* saved = columns ? strdup(columns) : NULL;
+
+    setenv("COLUMNS", "77", 1);
+    option_terminal_invalidate();
+    CU_ASSERT_EQUAL(option_terminal_width(), 77);
+
+    // The width is kept until it is marked stale.
+    setenv("COLUMNS", "55", 1);
+    CU_ASSERT_EQUAL(option_terminal_width(), 77);
+    option_terminal_invalidate();
+    CU_ASSERT_EQUAL(option_terminal_width(), 55);
+
+#if defined(SIGWINCH)
+    CU_ASSERT_EQUAL_FATAL(option_terminal_watch_resize(1), OPTION_OK);
+    CU_ASSERT_EQUAL(option_terminal_width(), 55);
+    setenv("COLUMNS", "66", 1);
+    CU_ASSERT_EQUAL(option_terminal_width(), 55);
+    raise(SIGWINCH);
+    CU_ASSERT_EQUAL(option_terminal_width(), 66);
+    CU_ASSERT_EQUAL(option_terminal_watch_resize(0), OPTION_OK);
+#endif
+
+    if (saved)
+        setenv("COLUMNS", saved, 1);
+    else
+        unsetenv("COLUMNS");
+    option_terminal_invalidate();
+    free(saved);
+}
+
+void help_cache_test()
+{
+    option_context* options = NULL;
+    const char* narrow = NULL;
+    const char* wide = NULL;
+    const char* again = NULL;
+    const char* usage = NULL;
+    const char* args[] = {"help-cache-test"};
+
+    CU_ASSERT_EQUAL_FATAL(
+            options_parse(&options, 1, args, failure_opts, failure_opts_sz),
+            OPTION_OK
+            );
+
+    CU_ASSERT_EQUAL(option_context_help_cached(options, 40, &narrow),
+                    OPTION_OK);
+    CU_ASSERT_EQUAL(option_context_help_cached(options, 120, &wide),
+                    OPTION_OK);
+    CU_ASSERT_EQUAL(option_context_help_cached(options, 40, &again),
+                    OPTION_OK);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(narrow);
+    CU_ASSERT_PTR_EQUAL(narrow, again);
+    CU_ASSERT(narrow != wide);
+    // The usage line wraps at 40 columns, not at 120.
+    CU_ASSERT(strchr(narrow, '\n') - narrow < strchr(wide, '\n') - wide);
+
+    CU_ASSERT_EQUAL(option_context_short_help_cached(options, 120, &usage),
+                    OPTION_OK);
+    CU_ASSERT_NSTRING_EQUAL(usage, wide, strlen(usage));
+
+    // A new description renders the help again.
+    option_context_set_description(options, "Tests the cache.");
+    CU_ASSERT_EQUAL(option_context_help_cached(options, 40, &again),
+                    OPTION_OK);
+    CU_ASSERT_PTR_NOT_NULL(strstr(again, "Tests the cache."));
+
+    option_context_free(options);
+}
+
+/*
+ * Collects the help written by option_context_help_write().
+ */
+typedef struct help_sink {
+    char    text[8192];
+    size_t  size;
+    int     calls;
+    int     stop_after;
+} help_sink;
+
+static int collect_help(void* data, const char* text, size_t length)
+{
+    help_sink* sink = data;
+    if (sink->size + length >= sizeof(sink->text))
+        return -1;
+    memcpy(sink->text + sink->size, text, length);
+    sink->size += length;
+    sink->text[sink->size] = '\0';
+    if (++sink->calls == sink->stop_after)
+        return 42;
+    return 0;
+}
+
+void help_sink_test()
+{
+    option_context* options = NULL;
+    const char* help = NULL;
+    const char* args[] = {"help-sink-test"};
+    char description[1024] = "";
+    static help_sink sink;
+    char file_text[8192];
+    FILE* file;
+    size_t n;
+    int i;
+
+    CU_ASSERT_EQUAL_FATAL(
+            options_parse(&options, 1, args, failure_opts, failure_opts_sz),
+            OPTION_OK
+            );
+    // Every line of the description is a few segments.
+    for (i = 0; i < 100; i++)
+        strcat(description, "line\n");
+    option_context_set_description(options, description);
+    CU_ASSERT_EQUAL_FATAL(option_context_help_cached(options, 40, &help),
+                          OPTION_OK);
+
+    CU_ASSERT_EQUAL(option_context_help_write(options, 40, collect_help, &sink),
+                    OPTION_OK);
+    CU_ASSERT_STRING_EQUAL(sink.text, help);
+    CU_ASSERT(sink.calls > 1);
+
+    // The callback stops the output.
+    memset(&sink, 0, sizeof(sink));
+    sink.stop_after = 1;
+    CU_ASSERT_EQUAL(option_context_help_write(options, 40, collect_help, &sink),
+                    42);
+    CU_ASSERT_EQUAL(sink.calls, 1);
+
+    file = tmpfile();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(file);
+    CU_ASSERT_EQUAL(option_context_help_file(options, 40, file), OPTION_OK);
+    rewind(file);
+    n = fread(file_text, 1, sizeof(file_text) - 1, file);
+    file_text[n] = '\0';
+    CU_ASSERT_STRING_EQUAL(file_text, help);
+
+    rewind(file);
+    CU_ASSERT_EQUAL(ftruncate(fileno(file), 0), 0);
+    CU_ASSERT_EQUAL(option_context_help_fd(options, 40, fileno(file)),
+                    OPTION_OK);
+    rewind(file);
+    n = fread(file_text, 1, sizeof(file_text) - 1, file);
+    file_text[n] = '\0';
+    CU_ASSERT_STRING_EQUAL(file_text, help);
+    fclose(file);
+
+    CU_ASSERT_EQUAL(option_context_help_fd(options, 40, -1),
+                    OPTION_INVALID_ARGUMENT);
+    option_context_free(options);
+}
+
+extern cmd_option prerender_opts[];
+extern size_t prerender_opts_sz;
+extern const char prerender_description[];
+extern const option_prerendered_help prerendered_help;
+
+void prerender_test()
+{
+    option_context* options = NULL;
+    option_context* plain = NULL;
+    option_context* renamed = NULL;
+    const char* help = NULL;
+    const char* expected = NULL;
+    const char* args[] = {"prerender-test"};
+    const char* other[] = {"other-name"};
+    const int widths[] = {80, 100, 120, 160, 90};
+    static help_sink sink;
+    option_prerendered_help wrong;
+    const char* index_lines[] = {
+        "--count\tint\n", "--input\tfile\n", "--name\tstring\n",
+        "--verbose\tflag\n", "-c\tint\n", "-i\tfile\n", "-v\tflag\n"
+    };
+    FILE* index;
+    char line[64];
+    char* copy;
+    size_t i;
+
+    CU_ASSERT_EQUAL_FATAL(
+            options_parse(&options, 1, args, prerender_opts, prerender_opts_sz),
+            OPTION_OK
+            );
+    CU_ASSERT_EQUAL_FATAL(
+            options_parse(&plain, 1, args, prerender_opts, prerender_opts_sz),
+            OPTION_OK
+            );
+    CU_ASSERT_EQUAL_FATAL(
+            options_parse(&renamed, 1, other, prerender_opts, prerender_opts_sz),
+            OPTION_OK
+            );
+    option_context_set_description(options, prerender_description);
+    option_context_set_description(plain, prerender_description);
+    option_context_set_description(renamed, prerender_description);
+    CU_ASSERT_EQUAL(
+            option_context_set_prerendered_help(options, &prerendered_help),
+            OPTION_OK
+            );
+    CU_ASSERT_EQUAL(
+            option_context_set_prerendered_help(renamed, &prerendered_help),
+            OPTION_OK
+            );
+
+    // The generated help is the help that is laid out at runtime.
+    for (i = 0; i < sizeof(widths) / sizeof(widths[0]); i++) {
+        CU_ASSERT_EQUAL(option_context_help_cached(options, widths[i], &help),
+                        OPTION_OK);
+        CU_ASSERT_EQUAL(option_context_help_cached(plain, widths[i], &expected),
+                        OPTION_OK);
+        CU_ASSERT_STRING_EQUAL(help, expected);
+        CU_ASSERT_EQUAL(
+                option_context_short_help_cached(options, widths[i], &help),
+                OPTION_OK
+                );
+        CU_ASSERT_EQUAL(
+                option_context_short_help_cached(plain, widths[i], &expected),
+                OPTION_OK
+                );
+        CU_ASSERT_STRING_EQUAL(help, expected);
+    }
+    option_context_help_cached(options, 80, &help);
+    CU_ASSERT_PTR_EQUAL(help, prerendered_help.renderings[0].text);
+
+    option_context_help_cached(plain, 100, &expected);
+    CU_ASSERT_EQUAL(option_context_help_write(options, 100, collect_help, &sink),
+                    OPTION_OK);
+    CU_ASSERT_STRING_EQUAL(sink.text, expected);
+
+    // Another program name only lays out the usage line.
+    CU_ASSERT_EQUAL(option_context_help_cached(renamed, 80, &help), OPTION_OK);
+    copy = strdup(help);
+    CU_ASSERT_EQUAL(option_context_set_prerendered_help(renamed, NULL),
+                    OPTION_OK);
+    CU_ASSERT_EQUAL(option_context_help_cached(renamed, 80, &help), OPTION_OK);
+    CU_ASSERT_STRING_EQUAL(copy, help);
+    free(copy);
+
+    // Another description isn't in the generated help.
+    option_context_set_description(options, "Another description.");
+    option_context_set_description(plain, "Another description.");
+    option_context_help_cached(options, 80, &help);
+    option_context_help_cached(plain, 80, &expected);
+    CU_ASSERT_STRING_EQUAL(help, expected);
+    CU_ASSERT(help != prerendered_help.renderings[0].text);
+
+    // The help is made for another schema.
+    wrong = prerendered_help;
+    wrong.n_options++;
+    CU_ASSERT_EQUAL(option_context_set_prerendered_help(renamed, &wrong),
+                    OPTION_INVALID_ARGUMENT);
+    CU_ASSERT_EQUAL(option_context_set_prerendered_help(NULL, NULL),
+                    OPTION_INVALID_ARGUMENT);
+
+    // The completion index of the schema is also written at build time.
+    index = fopen(COMPLETION_INDEX, "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(index);
+    for (i = 0; i < sizeof(index_lines) / sizeof(index_lines[0]); i++) {
+        CU_ASSERT_PTR_NOT_NULL(fgets(line, sizeof(line), index));
+        CU_ASSERT_STRING_EQUAL(line, index_lines[i]);
+    }
+    CU_ASSERT_PTR_NULL(fgets(line, sizeof(line), index));
+    fclose(index);
+
+    option_context_free(renamed);
+    option_context_free(plain);
+    option_context_free(options);
+}
+
+void limits_test()
+{
+    option_diagnostic records[4];
+    option_diagnostics diags = {records, 4, 0};
+    option_parse_settings settings = {OPTION_FLAG_SILENT, &diags, {8, 16, 2}};
+    char long_token[64];
+    int argc, ret;
+
+    memset(long_token, 'a', sizeof(long_token) - 1);
+    long_token[sizeof(long_token) - 1] = '\0';
+
+    const char* args[] = {
+        "limits-test",
+        long_token,
+        "-vvv",
+        "-c", long_token,
+        "-v"
+    };
+    argc = sizeof(args)/sizeof(args[0]);
+
+    ret = options_validate_ex(
+            argc, args, failure_opts, failure_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL(ret, OPTION_LIMIT_EXCEEDED);
+    CU_ASSERT_EQUAL_FATAL(diags.count, 3);
+    CU_ASSERT_EQUAL(records[0].argv_index, 1);
+    CU_ASSERT_EQUAL(records[1].argv_index, 2);
+    CU_ASSERT_EQUAL(records[1].byte_offset, 3);
+    CU_ASSERT_EQUAL(records[2].argv_index, 4);
+
+    // too many arguments
+    settings.limits.max_argc = 3;
+    ret = options_validate_ex(
+            argc, args, failure_opts, failure_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL(ret, OPTION_LIMIT_EXCEEDED);
+    CU_ASSERT_EQUAL(diags.count, 1);
+    CU_ASSERT_EQUAL(records[0].argv_index, -1);
+}
+
+/*
+ * Writes contents to a file named path.
+ */
+static int write_file(const char* path, const char* contents)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return -1;
+    fputs(contents, file);
+    fclose(file);
+    return 0;
+}
+
+void response_file_test()
+{
+    option_context* options = NULL;
+    option_parse_settings settings = {
+        OPTION_FLAG_SILENT | OPTION_FLAG_RESPONSE_FILES
+    };
+    int argc, ret;
+    const char* str = NULL;
+
+    CU_ASSERT_EQUAL_FATAL(
+        write_file("response_outer.rsp",
+                   "-c 'gnu C compiler'\n"
+                   "--virtual-machine=\"ll\\\"vm\" @response_inner.rsp"
+                   ),
+        0);
+    CU_ASSERT_EQUAL_FATAL(
+        write_file("response_inner.rsp", "first\\ argument second"), 0
+        );
+
+    const char* args[] = {
+        "response-file-test",
+        "@response_outer.rsp",
+        "-p", "cpp"
+    };
+    argc = sizeof(args)/sizeof(args[0]);
+
+    ret = options_parse_ex(
+            &options, argc, args, string_opts, string_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+
+    option_context_str_value(options, "compiler", &str);
+    CU_ASSERT_STRING_EQUAL(str, "gnu C compiler");
+    option_context_str_value(options, "virtual-machine", &str);
+    CU_ASSERT_STRING_EQUAL(str, "ll\"vm");
+    option_context_str_value(options, "preprocessor", &str);
+    CU_ASSERT_STRING_EQUAL(str, "cpp");
+    CU_ASSERT_EQUAL(option_context_nargs(options), 2);
+    CU_ASSERT_STRING_EQUAL(option_context_get_argument(options, 0),
+                           "first argument"
+                           );
+    CU_ASSERT_STRING_EQUAL(option_context_get_argument(options, 1), "second");
+    option_context_free(options);
+    options = NULL;
+
+    // A response file that includes itself.
+    CU_ASSERT_EQUAL_FATAL(
+        write_file("response_inner.rsp", "@response_outer.rsp"), 0
+        );
+    ret = options_parse_ex(
+            &options, argc, args, string_opts, string_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL(ret, OPTION_RECURSIVE_FILE);
+    CU_ASSERT_PTR_NULL(options);
+
+    remove("response_outer.rsp");
+    remove("response_inner.rsp");
+
+    ret = options_parse_ex(
+            &options, argc, args, string_opts, string_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL(ret, OPTION_FILE_ERROR);
+}
+
+void parse_string_test()
+{
+    option_context* options = NULL;
+    option_diagnostic records[2];
+    option_diagnostics diags = {records, 2, 0};
+    option_parse_settings settings = {OPTION_FLAG_SILENT, &diags};
+    const char* str = NULL;
+    int ret;
+    // Longer than 16 bytes between the quotes to exercise the block scan.
+    char command[] =
+        "  -c 'gnu C compiler'\t--linker=\"ld \\\"gold\\\" \\x\"\n"
+        "-p a\\ b\\\n  first ''  \"a long double quoted argument\"";
+    char unterminated[] = "-p 'cpp";
+
+    ret = options_parse_string(
+            &options, "parse-string-test", command,
+            string_opts, string_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+
+    option_context_str_value(options, "compiler", &str);
+    CU_ASSERT_STRING_EQUAL(str, "gnu C compiler");
+    option_context_str_value(options, "linker", &str);
+    CU_ASSERT_STRING_EQUAL(str, "ld \"gold\" \\x");
+    option_context_str_value(options, "preprocessor", &str);
+    CU_ASSERT_STRING_EQUAL(str, "a b");
+    CU_ASSERT_EQUAL_FATAL(option_context_nargs(options), 3);
+    CU_ASSERT_STRING_EQUAL(option_context_get_argument(options, 0), "first");
+    CU_ASSERT_STRING_EQUAL(option_context_get_argument(options, 1), "");
+    CU_ASSERT_STRING_EQUAL(option_context_get_argument(options, 2),
+                           "a long double quoted argument"
+                           );
+    option_context_free(options);
+    options = NULL;
+
+    ret = options_parse_string(
+            &options, "parse-string-test", unterminated,
+            string_opts, string_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL(ret, OPTION_PARSE_ERROR);
+    CU_ASSERT_PTR_NULL(options);
+    CU_ASSERT_EQUAL(diags.count, 1);
+    CU_ASSERT_EQUAL(records[0].argv_index, -1);
+    CU_ASSERT_EQUAL(records[0].byte_offset, 3);
+}
+
+void environment_test()
+{
+    option_context* options = NULL;
+    option_diagnostic records[2];
+    option_diagnostics diags = {records, 2, 0};
+    option_parse_settings settings = {OPTION_FLAG_SILENT, &diags};
+    const char* str = NULL;
+    int x = 0, ret;
+    double y = 0;
+    const char* environment[] = {
+        "OTHER_X_COOR=1",
+        "TOOL_X_COOR=7",
+        "TOOL_Y_COOR=2.5",
+        "TOOL_COMPILER=gcc",
+        "TOOL_VIRTUAL_MACHINE=0",
+        "TOOL_UNKNOWN=3",
+        NULL
+    };
+    const char* bad_environment[] = {"TOOL_X_COOR=seven", NULL};
+    const char* args[] = {
+        "environment-test",
+        "-c", "clang"
+    };
+    int argc = sizeof(args)/sizeof(args[0]);
+
+    settings.env_prefix     = "TOOL_";
+    settings.environment    = environment;
+    ret = options_parse_ex(
+            &options, argc, args, failure_opts, failure_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+
+    // The command line takes precedence.
+    option_context_str_value(options, "compiler", &str);
+    CU_ASSERT_STRING_EQUAL(str, "clang");
+    CU_ASSERT_EQUAL(option_context_int_value(options, "x-coor", &x), OPTION_OK);
+    CU_ASSERT_EQUAL(x, 7);
+    CU_ASSERT_EQUAL(
+            option_context_float_value(options, "y-coor", &y), OPTION_OK
+            );
+    CU_ASSERT_DOUBLE_EQUAL(y, 2.5, 1e-9);
+    CU_ASSERT(!option_context_have_option(options, "virtual-machine"));
+    CU_ASSERT_EQUAL(option_context_num_options(options), 3);
+    option_context_free(options);
+    options = NULL;
+
+    settings.environment = bad_environment;
+    ret = options_parse_ex(
+            &options, argc, args, failure_opts, failure_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL(ret, OPTION_PARSE_ERROR);
+    CU_ASSERT_PTR_NULL(options);
+    CU_ASSERT_EQUAL_FATAL(diags.count, 1);
+    CU_ASSERT_EQUAL(records[0].argv_index, -1);
+    CU_ASSERT_EQUAL(records[0].option_index, 2);
+}
+
+void config_file_test()
+{
+    option_context* options = NULL;
+    option_diagnostic records[2];
+    option_diagnostics diags = {records, 2, 0};
+    option_parse_settings settings = {OPTION_FLAG_SILENT, &diags};
+    const char* environment[] = {"TOOL_Y_COOR=1.5", NULL};
+    const char* flag_off[] = {"TOOL_VIRTUAL_MACHINE=0", NULL};
+    const char* flag_args[] = {"config-file-test", "-v"};
+    const char* str = NULL;
+    int x = 0, ret;
+    double y = 0;
+    const char* args[] = {
+        "config-file-test",
+        "-x", "5"
+    };
+    int argc = sizeof(args)/sizeof(args[0]);
+
+    CU_ASSERT_EQUAL_FATAL(
+        write_file("config_test.ini",
+                   "# defaults\n"
+                   "compiler = \"gnu cc\"  \r\n"
+                   "x-coor=3\n"
+                   "  y-coor = 9\n"
+                   "; switched off\n"
+                   "virtual-machine = off"
+                   ),
+        0);
+    CU_ASSERT_EQUAL_FATAL(
+        write_file("config_bad.ini", "compiler = cc\n[x]\ncoor = 1\n"), 0
+        );
+
+    settings.env_prefix     = "TOOL_";
+    settings.environment    = environment;
+    ret = options_parse_ex(
+            &options, argc, args, failure_opts, failure_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+    ret = option_context_load_config(options, "config_test.ini", &settings);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+
+    // defaults < file < env < argv
+    option_context_str_value(options, "compiler", &str);
+    CU_ASSERT_STRING_EQUAL(str, "gnu cc");
+    option_context_int_value(options, "x-coor", &x);
+    CU_ASSERT_EQUAL(x, 5);
+    option_context_float_value(options, "y-coor", &y);
+    CU_ASSERT_DOUBLE_EQUAL(y, 1.5, 1e-9);
+    CU_ASSERT(!option_context_have_option(options, "virtual-machine"));
+
+    // A later file overrides an earlier one, [x] makes the key "x.coor".
+    ret = option_context_load_config(options, "config_bad.ini", &settings);
+    CU_ASSERT_EQUAL(ret, OPTION_UNKNOWN);
+    CU_ASSERT_EQUAL_FATAL(diags.count, 1);
+    CU_ASSERT_EQUAL(records[0].argv_index, -1);
+    CU_ASSERT_EQUAL(records[0].byte_offset, 18);
+    option_context_str_value(options, "compiler", &str);
+    CU_ASSERT_STRING_EQUAL(str, "cc");
+
+    CU_ASSERT_EQUAL(
+            option_context_load_config(options, "missing.ini", &settings),
+            OPTION_FILE_ERROR
+            );
+    option_context_free(options);
+    options = NULL;
+
+    // A later file switches off a flag that an earlier one set.
+    CU_ASSERT_EQUAL_FATAL(
+        write_file("config_on.ini", "virtual-machine = yes\n"), 0
+        );
+    CU_ASSERT_EQUAL_FATAL(
+        write_file("config_off.ini", "virtual-machine = no\n"), 0
+        );
+    settings.env_prefix = NULL;
+    ret = options_parse_ex(
+            &options, 1, args, failure_opts, failure_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+    ret = option_context_load_config(options, "config_on.ini", &settings);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    CU_ASSERT(option_context_have_option(options, "virtual-machine"));
+    CU_ASSERT_EQUAL(option_context_num_options(options), 1);
+    ret = option_context_load_config(options, "config_off.ini", &settings);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    CU_ASSERT(!option_context_have_option(options, "virtual-machine"));
+    CU_ASSERT_EQUAL(option_context_num_options(options), 0);
+    ret = option_context_load_config(options, "config_on.ini", &settings);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    CU_ASSERT(option_context_have_option(options, "virtual-machine"));
+    CU_ASSERT_EQUAL(option_context_num_options(options), 1);
+    option_context_free(options);
+    options = NULL;
+
+    // The environment switches off a flag of a file, argv switches it on.
+    settings.env_prefix     = "TOOL_";
+    settings.environment    = flag_off;
+    ret = options_parse_ex(
+            &options, 1, args, failure_opts, failure_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+    ret = option_context_load_config(options, "config_on.ini", &settings);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    CU_ASSERT(!option_context_have_option(options, "virtual-machine"));
+    CU_ASSERT_EQUAL(option_context_num_options(options), 0);
+    option_context_free(options);
+    options = NULL;
+
+    ret = options_parse_ex(
+            &options, 2, flag_args, failure_opts, failure_opts_sz, &settings
+            );
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+    CU_ASSERT(option_context_have_option(options, "virtual-machine"));
+    ret = option_context_load_config(options, "config_off.ini", &settings);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    CU_ASSERT(option_context_have_option(options, "virtual-machine"));
+    option_context_free(options);
+
+    remove("config_test.ini");
+    remove("config_bad.ini");
+    remove("config_on.ini");
+    remove("config_off.ini");
+}
+
+void reloader_test()
+{
+    option_reloader* reloader = NULL;
+    const option_context* old_snapshot;
+    const option_context* snapshot;
+    option_parse_settings settings = {OPTION_FLAG_SILENT};
+    const char* str = NULL;
+    long old_ticket, ticket;
+    unsigned generation;
+    int x = 0, reloaded = 0, ret;
+    const char* args[] = {
+        "reloader-test",
+        "-c", "clang"
+    };
+    int argc = sizeof(args)/sizeof(args[0]);
+
+    CU_ASSERT_EQUAL_FATAL(
+        write_file("reload_test.ini", "x-coor = 1\ny-coor = 2.0\n"), 0
+        );
+    ret = option_reloader_create(
+            &reloader, argc, args, failure_opts, failure_opts_sz,
+            "reload_test.ini", &settings
+            );
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+
+    old_snapshot = option_reloader_acquire(reloader, &old_ticket);
+    generation = option_context_generation(old_snapshot);
+    CU_ASSERT_EQUAL(generation, 1);
+    option_context_int_value(old_snapshot, "x-coor", &x);
+    CU_ASSERT_EQUAL(x, 1);
+
+    CU_ASSERT_EQUAL(option_reloader_check(reloader, &reloaded), OPTION_OK);
+    CU_ASSERT_EQUAL(reloaded, 0);
+
+    CU_ASSERT_EQUAL_FATAL(
+        write_file("reload_test.ini", "x-coor = 3\ny-coor = 2.0\n"), 0
+        );
+    if (option_reloader_fd(reloader) < 0)
+        ret = option_reloader_reload(reloader); // no change notification
+    else
+        ret = option_reloader_check(reloader, &reloaded);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+
+    snapshot = option_reloader_acquire(reloader, &ticket);
+    CU_ASSERT_EQUAL(option_context_generation(snapshot), 2);
+    option_context_int_value(snapshot, "x-coor", &x);
+    CU_ASSERT_EQUAL(x, 3);
+    option_context_str_value(snapshot, "compiler", &str);
+    CU_ASSERT_STRING_EQUAL(str, "clang");
+    CU_ASSERT(option_context_changed_since(snapshot, "x-coor", generation));
+    CU_ASSERT(!option_context_changed_since(snapshot, "y-coor", generation));
+    CU_ASSERT(!option_context_changed_since(snapshot, "compiler", generation));
+
+    // The old snapshot stays intact while it is held.
+    option_context_int_value(old_snapshot, "x-coor", &x);
+    CU_ASSERT_EQUAL(x, 1);
+    option_reloader_release(reloader, old_ticket);
+    option_reloader_release(reloader, ticket);
+
+    // A broken file keeps the current snapshot.
+    CU_ASSERT_EQUAL_FATAL(write_file("reload_test.ini", "x-coor = x\n"), 0);
+    CU_ASSERT_EQUAL(option_reloader_reload(reloader), OPTION_PARSE_ERROR);
+    snapshot = option_reloader_acquire(reloader, &ticket);
+    CU_ASSERT_EQUAL(option_context_generation(snapshot), 2);
+    option_reloader_release(reloader, ticket);
+
+    option_reloader_free(reloader);
+    remove("reload_test.ini");
+}
+
+void file_value_test()
+{
+    cmd_option file_opts[] = {
+        {'k', "key",    OPT_FILE},
+        {'m', "motd",   OPT_FILE},
+        {'x', "x-coor", OPT_INT},
+        {'p', "pem",    OPT_FILE}
+    };
+    option_context* options = NULL;
+    const void* data = NULL;
+    size_t size = 0;
+    int ret;
+    const char* args[] = {
+        "file-value-test",
+        "--key", "@file_value.pem",
+        "-m", "@@home",
+        "-x", "2",
+        "--pem", "@missing.pem"
+    };
+    int argc = sizeof(args)/sizeof(args[0]);
+
+    ret = options_parse(&options, argc, args, file_opts, 4);
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+
+    // Nothing is opened while parsing, the file may appear afterwards.
+    CU_ASSERT_EQUAL_FATAL(write_file("file_value.pem", "-----KEY-----\n"), 0);
+    ret = option_context_file_value(options, "key", &data, &size);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    CU_ASSERT_EQUAL(size, 14);
+    CU_ASSERT(memcmp(data, "-----KEY-----\n", 14) == 0);
+    {
+        const void* again = NULL;
+        option_context_file_value(options, "key", &again, &size);
+        CU_ASSERT_PTR_EQUAL(again, data);
+    }
+
+    ret = option_context_file_value(options, "motd", &data, &size);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    CU_ASSERT_EQUAL(size, 5);
+    CU_ASSERT(memcmp(data, "@home", 5) == 0);
+
+    CU_ASSERT_EQUAL(
+            option_context_file_value(options, "pem", &data, &size),
+            OPTION_FILE_ERROR
+            );
+    CU_ASSERT_EQUAL(
+            option_context_file_value(options, "x-coor", &data, &size),
+            OPTION_WRONG_OPTION_TYPE
+            );
+    option_context_free(options);
+    remove("file_value.pem");
+
+    options = NULL;
+    args[2] = "@";
+    ret = options_parse(&options, 3, args, file_opts, 4);
+    CU_ASSERT_EQUAL(ret, OPTION_PARSE_ERROR);
+    CU_ASSERT_PTR_NULL(options);
+
+    // The value of a file option isn't a response file, also not inside
+    // a response file.
+    {
+        option_parse_settings settings = {
+            OPTION_FLAG_SILENT | OPTION_FLAG_RESPONSE_FILES
+        };
+        const char* rules = "allow all\ndeny none\n";
+        const char* rsp_args[] = {
+            "file-value-test",
+            "--key", "@file_value_rules.txt",
+            "@file_value.rsp"
+        };
+
+        CU_ASSERT_EQUAL_FATAL(write_file("file_value_rules.txt", rules), 0);
+        CU_ASSERT_EQUAL_FATAL(
+                write_file("file_value.rsp",
+                           "-x 3 -m @file_value_rules.txt first"), 0
+                );
+        ret = options_parse_ex(&options, 4, rsp_args, file_opts, 4, &settings);
+        CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+        CU_ASSERT_EQUAL(option_context_nargs(options), 1);
+        CU_ASSERT_STRING_EQUAL(option_context_get_argument(options, 0),
+                               "first");
+        ret = option_context_file_value(options, "key", &data, &size);
+        CU_ASSERT_EQUAL(ret, OPTION_OK);
+        CU_ASSERT_EQUAL(size, strlen(rules));
+        CU_ASSERT(memcmp(data, rules, size) == 0);
+        ret = option_context_file_value(options, "motd", &data, &size);
+        CU_ASSERT_EQUAL(ret, OPTION_OK);
+        CU_ASSERT_EQUAL(size, strlen(rules));
+        option_context_free(options);
+        options = NULL;
+
+        remove("file_value.rsp");
+        remove("file_value_rules.txt");
+    }
+}
+
+void process_cmdline_test()
+{
+    cmd_option lib_opts[] = {
+        {'\0', "mylib-trace", OPT_FLAG}
+    };
+    option_context* options = NULL;
+    option_context* other = NULL;
+    option_parse_settings settings = {
+        OPTION_FLAG_SILENT | OPTION_FLAG_IGNORE_UNKNOWN
+    };
+    const char* const* argv1 = NULL;
+    const char* const* argv2 = NULL;
+    int argc1 = 0, argc2 = 0, ret;
+    const char* args[] = {
+        "process-cmdline-test",
+        "--verbose",
+        "-qv",
+        "--mylib-trace"
+    };
+    int argc = sizeof(args)/sizeof(args[0]);
+
+    // Options of the program are skipped.
+    ret = options_parse_ex(&options, argc, args, lib_opts, 1, &settings);
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+    CU_ASSERT(option_context_have_option(options, "mylib-trace"));
+    option_context_free(options);
+    options = NULL;
+
+    settings.flags = OPTION_FLAG_SILENT;
+    ret = options_parse_ex(&options, argc, args, lib_opts, 1, &settings);
+    CU_ASSERT_EQUAL(ret, OPTION_UNKNOWN);
+
+    // The command line is read once and shared.
+    settings.flags = OPTION_FLAG_SILENT | OPTION_FLAG_IGNORE_UNKNOWN;
+    ret = options_parse_process(&options, lib_opts, 1, &settings);
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+    ret = options_parse_process(&other, lib_opts, 1, &settings);
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+    argv1 = option_context_argv(options, &argc1);
+    argv2 = option_context_argv(other, &argc2);
+    CU_ASSERT(argc1 >= 1);
+    CU_ASSERT_EQUAL(argc1, argc2);
+    CU_ASSERT_PTR_EQUAL(argv1, argv2);
+    CU_ASSERT(!option_context_have_option(options, "mylib-trace"));
+    option_context_free(options);
+    option_context_free(other);
+}
+
+void serialize_test()
+{
+    option_context* options = NULL;
+    const option_blob* blob = NULL;
+    void* data = NULL;
+    void* moved = NULL;
+    void* mapped = NULL;
+    size_t size = 0;
+    const char* str = NULL;
+    double y = 0;
+    int x = 0, fd = -1, ret;
+    const char* args[] = {
+        "serialize-test",
+        "-c", "gcc",
+        "input.c",
+        "--y-coor=2.5",
+        "output.o"
+    };
+    int argc = sizeof(args)/sizeof(args[0]);
+
+    ret = options_parse(&options, argc, args, failure_opts, failure_opts_sz);
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+    ret = option_context_serialize(options, &data, &size);
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+
+    // The blob works at any address.
+    moved = malloc(size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(moved);
+    memcpy(moved, data, size);
+    memset(data, 0, size);
+    free(data);
+    ret = option_blob_open(&blob, moved, size);
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+
+    CU_ASSERT_STRING_EQUAL(option_blob_prog_name(blob), "serialize-test");
+    CU_ASSERT_EQUAL(option_blob_str_value(blob, "compiler", &str), OPTION_OK);
+    CU_ASSERT_STRING_EQUAL(str, "gcc");
+    CU_ASSERT_EQUAL(option_blob_float_value(blob, "y-coor", &y), OPTION_OK);
+    CU_ASSERT_DOUBLE_EQUAL(y, 2.5, 1e-9);
+    CU_ASSERT_EQUAL(
+            option_blob_int_value(blob, "x-coor", &x), OPTION_NOT_SPECIFIED
+            );
+    CU_ASSERT_EQUAL(
+            option_blob_int_value(blob, "compiler", &x),
+            OPTION_WRONG_OPTION_TYPE
+            );
+    CU_ASSERT(option_blob_have_option(blob, "compiler"));
+    CU_ASSERT(!option_blob_have_option(blob, "virtual-machine"));
+    CU_ASSERT(!option_blob_have_option(blob, "unknown"));
+    CU_ASSERT_EQUAL(option_blob_nargs(blob), 2);
+    CU_ASSERT_STRING_EQUAL(option_blob_get_argument(blob, 1), "output.o");
+    CU_ASSERT_PTR_NULL(option_blob_get_argument(blob, 2));
+
+    // A damaged or truncated blob is refused.
+    CU_ASSERT_EQUAL(
+            option_blob_open(&blob, moved, size / 2), OPTION_INVALID_ARGUMENT
+            );
+    ((unsigned char*) moved)[0] ^= 0xff;
+    CU_ASSERT_EQUAL(
+            option_blob_open(&blob, moved, size), OPTION_INVALID_ARGUMENT
+            );
+    free(moved);
+
+    ret = option_context_serialize_fd(options, &fd, &size);
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+    mapped = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    CU_ASSERT_FATAL(mapped != MAP_FAILED);
+    ret = option_blob_open(&blob, mapped, size);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    if (ret == OPTION_OK)
+        CU_ASSERT_STRING_EQUAL(option_blob_get_argument(blob, 0), "input.c");
+    munmap(mapped, size);
+    close(fd);
+    option_context_free(options);
+}
+
+void overlay_test()
+{
+    option_context* options = NULL;
+    option_overlay overlay;
+    option_overlay* heap = NULL;
+    const char* str = NULL;
+    int x = 0, ret;
+    double y = 0;
+    const char* args[] = {
+        "overlay-test",
+        "-c", "gcc",
+        "-x", "3",
+        "-v"
+    };
+    int argc = sizeof(args)/sizeof(args[0]);
+
+    ret = options_parse(&options, argc, args, failure_opts, failure_opts_sz);
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+
+    option_overlay_init(&overlay, options);
+    CU_ASSERT_EQUAL(option_overlay_set(&overlay, "x-coor", "7"), OPTION_OK);
+    CU_ASSERT_EQUAL(option_overlay_set(&overlay, "y-coor", "0.5"), OPTION_OK);
+    CU_ASSERT_EQUAL(option_overlay_unset(&overlay, "virtual-machine"), OPTION_OK);
+    CU_ASSERT_EQUAL(option_overlay_set(&overlay, "x-coor", "abc"),
+                    OPTION_PARSE_ERROR);
+    CU_ASSERT_EQUAL(option_overlay_set(&overlay, "z-coor", "1"), OPTION_UNKNOWN);
+
+    // Overridden, hidden and inherited options.
+    option_overlay_int_value(&overlay, "x-coor", &x);
+    CU_ASSERT_EQUAL(x, 7);
+    option_overlay_float_value(&overlay, "y-coor", &y);
+    CU_ASSERT_DOUBLE_EQUAL(y, 0.5, 1e-9);
+    CU_ASSERT(!option_overlay_have_option(&overlay, "virtual-machine"));
+    CU_ASSERT_EQUAL(option_overlay_str_value(&overlay, "compiler", &str),
+                    OPTION_OK);
+    CU_ASSERT_STRING_EQUAL(str, "gcc");
+    CU_ASSERT_EQUAL(option_overlay_int_value(&overlay, "compiler", &x),
+                    OPTION_WRONG_OPTION_TYPE);
+
+    // The parent is untouched.
+    option_context_int_value(options, "x-coor", &x);
+    CU_ASSERT_EQUAL(x, 3);
+    CU_ASSERT(option_context_have_option(options, "virtual-machine"));
+    CU_ASSERT(!option_context_have_option(options, "y-coor"));
+
+    CU_ASSERT_EQUAL_FATAL(option_overlay_create(&heap, options), OPTION_OK);
+    CU_ASSERT_EQUAL(option_overlay_set(heap, "compiler", "clang"), OPTION_OK);
+    option_overlay_str_value(heap, "compiler", &str);
+    CU_ASSERT_STRING_EQUAL(str, "clang");
+    option_overlay_int_value(heap, "x-coor", &x);
+    CU_ASSERT_EQUAL(x, 3);
+    option_overlay_free(heap);
+    option_context_free(options);
+}
+
+/*
+ * Collects the streamed arguments, stops when the argument is "stop".
+ */
+typedef struct stream_result {
+    char    args[8][16];
+    int     n;
+} stream_result;
+
+static int collect_argument(void* data, const char* arg, size_t length)
+{
+    stream_result* result = data;
+    CU_ASSERT_EQUAL(strlen(arg), length);
+    if (strcmp(arg, "stop") == 0)
+        return 42;
+    if (result->n < 8 && length < 16)
+        strcpy(result->args[result->n], arg);
+    result->n++;
+    return 0;
+}
+
+static int stream_file(const char* contents, size_t size, size_t buffer_size,
+                       stream_result* result)
+{
+    FILE* file = fopen("stream.args", "wb");
+    int fd, ret;
+    if (!file)
+        return -1;
+    fwrite(contents, 1, size, file);
+    fclose(file);
+
+    memset(result, 0, sizeof(stream_result));
+    fd = open("stream.args", O_RDONLY);
+    if (fd < 0)
+        return -1;
+    ret = options_stream_arguments(
+            fd, '\0', buffer_size, collect_argument, result
+            );
+    close(fd);
+    remove("stream.args");
+    return ret;
+}
+
+void stream_arguments_test()
+{
+    // The buffers of 8 bytes split "twotwo" and "last".
+    const char input[] = "one\0twotwo\0ab\0last";
+    const char too_long[] = "one\0a-long-argument\0";
+    const char stopped[] = "one\0stop\0two";
+    stream_result result;
+    int ret;
+
+    ret = stream_file(input, sizeof(input) - 1, 8, &result);
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    CU_ASSERT_EQUAL_FATAL(result.n, 4);
+    CU_ASSERT_STRING_EQUAL(result.args[0], "one");
+    CU_ASSERT_STRING_EQUAL(result.args[1], "twotwo");
+    CU_ASSERT_STRING_EQUAL(result.args[2], "ab");
+    CU_ASSERT_STRING_EQUAL(result.args[3], "last");
+
+    ret = stream_file(too_long, sizeof(too_long) - 1, 8, &result);
+    CU_ASSERT_EQUAL(ret, OPTION_LIMIT_EXCEEDED);
+    CU_ASSERT_EQUAL(result.n, 1);
+
+    ret = stream_file(stopped, sizeof(stopped) - 1, 0, &result);
+    CU_ASSERT_EQUAL(ret, 42);
+    CU_ASSERT_EQUAL(result.n, 1);
+}
+
+/*
+ * Parses args with the arguments in input streamed in place of "-".
+ */
+static int stream_parse(const char* input, size_t size, char delimiter,
+                        option_parse_settings* settings, int argc,
+                        const char** args, option_context** options,
+                        stream_result* result)
+{
+    int fds[2], ret;
+    option_argument_stream stream = {0, delimiter, 0, collect_argument};
+
+    if (pipe(fds) != 0)
+        return -1;
+    if (write(fds[1], input, size) != (ssize_t) size)
+        return -1;
+    close(fds[1]);
+
+    memset(result, 0, sizeof(stream_result));
+    stream.fd   = fds[0];
+    stream.data = result;
+    settings->stream = &stream;
+    ret = options_parse_ex(
+            options, argc, args, failure_opts, failure_opts_sz, settings
+            );
+    settings->stream = NULL;
+    close(fds[0]);
+    return ret;
+}
+
+void stream_parse_test()
+{
+    const char crlf[] = "first\r\nsecond\r\nlast";
+    const char invalid[] = "good\0bad\xff\0";
+    option_diagnostic records[2];
+    option_diagnostics diags = {records, 2, 0};
+    option_parse_settings settings = {OPTION_FLAG_SILENT, &diags};
+    option_context* options = NULL;
+    stream_result result;
+    const char* str = NULL;
+    const char* args[] = {
+        "stream-parse-test", "-c", "gcc", "-", "after"
+    };
+    int ret;
+
+    ret = stream_parse(crlf, sizeof(crlf) - 1, '\n', &settings, 5, args,
+                       &options, &result);
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+    CU_ASSERT_EQUAL_FATAL(result.n, 3);
+    CU_ASSERT_STRING_EQUAL(result.args[0], "first");
+    CU_ASSERT_STRING_EQUAL(result.args[1], "second");
+    CU_ASSERT_STRING_EQUAL(result.args[2], "last");
+    // The "-" is replaced, the other arguments are kept.
+    CU_ASSERT_EQUAL(option_context_nargs(options), 1);
+    CU_ASSERT_STRING_EQUAL(option_context_get_argument(options, 0), "after");
+    option_context_str_value(options, "compiler", &str);
+    CU_ASSERT_STRING_EQUAL(str, "gcc");
+    option_context_free(options);
+    options = NULL;
 
+    // The value of an option isn't replaced.
+    args[2] = "-";
+    ret = stream_parse(crlf, sizeof(crlf) - 1, '\n', &settings, 3, args,
+                       &options, &result);
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+    CU_ASSERT_EQUAL(result.n, 0);
+    option_context_str_value(options, "compiler", &str);
+    CU_ASSERT_STRING_EQUAL(str, "-");
     option_context_free(options);
     options = NULL;
+    args[2] = "gcc";
+
+    // Streamed arguments are checked as the command line.
+    settings.flags |= OPTION_FLAG_VALIDATE_UTF8;
+    ret = stream_parse(invalid, sizeof(invalid) - 1, '\0', &settings, 5, args,
+                       &options, &result);
+    CU_ASSERT_EQUAL(ret, OPTION_INVALID_ENCODING);
+    CU_ASSERT_PTR_NULL(options);
+    CU_ASSERT_EQUAL(result.n, 1);
+    CU_ASSERT_EQUAL_FATAL(diags.count, 1);
+    CU_ASSERT_EQUAL(records[0].argv_index, 3);
+
+    settings.flags = OPTION_FLAG_SILENT;
+    settings.limits.max_token_length = 5;
+    diags.count = 0;
+    ret = stream_parse(crlf, sizeof(crlf) - 1, '\n', &settings, 5, args,
+                       &options, &result);
+    CU_ASSERT_EQUAL(ret, OPTION_LIMIT_EXCEEDED);
+    CU_ASSERT_EQUAL(result.n, 1);
+    CU_ASSERT_PTR_NULL(options);
+}
+
+/*
+ * Checks that a session that was edited has the tokens of a session that
+ * got the same line at once.
+ */
+static void assert_same_tokens(const option_session* edited)
+{
+    option_session* fresh = NULL;
+    option_token a, b;
+    char line[128];
+    size_t i;
+
+    option_session_text(edited, line, sizeof(line));
+    CU_ASSERT_EQUAL_FATAL(
+            option_session_create(&fresh, failure_opts, failure_opts_sz),
+            OPTION_OK
+            );
+    option_session_insert(fresh, 0, line, strlen(line));
+    CU_ASSERT_EQUAL_FATAL(option_session_num_tokens(edited),
+                          option_session_num_tokens(fresh));
+    for (i = 0; i < option_session_num_tokens(fresh); i++) {
+        option_session_token(edited, i, &a);
+        option_session_token(fresh, i, &b);
+        CU_ASSERT_EQUAL(a.offset, b.offset);
+        CU_ASSERT_EQUAL(a.length, b.length);
+        CU_ASSERT_EQUAL(a.kind, b.kind);
+        CU_ASSERT_EQUAL(a.option_index, b.option_index);
+        CU_ASSERT_EQUAL(a.error, b.error);
+        CU_ASSERT_EQUAL(a.error_offset, b.error_offset);
+    }
+    CU_ASSERT_EQUAL(option_session_num_errors(edited),
+                    option_session_num_errors(fresh));
+    option_session_free(fresh);
+}
+
+void session_test()
+{
+    const char line[] = "-c gcc --x-coor 3 -v file";
+    option_session* session = NULL;
+    option_token token;
+    size_t i, nth;
+
+    CU_ASSERT_EQUAL_FATAL(
+            option_session_create(&session, failure_opts, failure_opts_sz),
+            OPTION_OK
+            );
+
+    // Typed one key at a time.
+    for (i = 0; i < sizeof(line) - 1; i++)
+        CU_ASSERT_EQUAL(option_session_insert(session, i, &line[i], 1),
+                        OPTION_OK);
+    CU_ASSERT_EQUAL_FATAL(option_session_num_tokens(session), 6);
+    CU_ASSERT_EQUAL(option_session_num_errors(session), 0);
+    option_session_token(session, 1, &token);
+    CU_ASSERT_EQUAL(token.kind, OPTION_TOKEN_VALUE);
+    CU_ASSERT_EQUAL(token.option_index, 0);
+    option_session_token(session, 2, &token);
+    CU_ASSERT_EQUAL(token.kind, OPTION_TOKEN_LONG);
+    CU_ASSERT_EQUAL(token.offset, 7);
+    option_session_token(session, 5, &token);
+    CU_ASSERT_EQUAL(token.kind, OPTION_TOKEN_ARGUMENT);
+    assert_same_tokens(session);
+
+    // "3" becomes "3x", which isn't an integer.
+    CU_ASSERT_EQUAL(option_session_insert(session, 17, "x", 1), OPTION_OK);
+    CU_ASSERT_EQUAL(option_session_num_errors(session), 1);
+    CU_ASSERT_EQUAL(option_session_token_at(session, 17, &nth), OPTION_OK);
+    CU_ASSERT_EQUAL(nth, 3);
+    option_session_token(session, nth, &token);
+    CU_ASSERT_EQUAL(token.error, OPTION_PARSE_ERROR);
+    assert_same_tokens(session);
+
+    // Removing "-c " turns "gcc" into an argument.
+    CU_ASSERT_EQUAL(option_session_delete(session, 0, 3), OPTION_OK);
+    option_session_token(session, 0, &token);
+    CU_ASSERT_EQUAL(token.kind, OPTION_TOKEN_ARGUMENT);
+    assert_same_tokens(session);
+
+    // Joining tokens and an option that lost its value.
+    CU_ASSERT_EQUAL(option_session_delete(session, 3, 1), OPTION_OK);
+    assert_same_tokens(session);
+    CU_ASSERT_EQUAL(option_session_delete(session, 0, 0), OPTION_OK);
+    i = option_session_length(session);
+    CU_ASSERT_EQUAL(option_session_insert(session, i, " -x", 3), OPTION_OK);
+    CU_ASSERT_EQUAL(option_session_num_errors(session), 1);
+    assert_same_tokens(session);
+    CU_ASSERT_EQUAL(option_session_insert(session, i + 3, " 4", 2), OPTION_OK);
+    CU_ASSERT_EQUAL(option_session_num_errors(session), 0);
+    assert_same_tokens(session);
+    CU_ASSERT_EQUAL(option_session_insert(session, 0, "--bogus ", 8),
+                    OPTION_OK);
+    assert_same_tokens(session);
+    CU_ASSERT_EQUAL(option_session_delete(session, 2, 100),
+                    OPTION_INVALID_ARGUMENT);
+
+    option_session_free(session);
+}
+
+void completion_test()
+{
+    option_completer* completer = NULL;
+    option_completion completion;
+    const char* dashes[] = {"--"};
+    const char* x_prefix[] = {"--x"};
+    const char* value[] = {"-c", ""};
+    const char* after_value[] = {"-c", "-v", ""};
+    const char* inline_value[] = {"--x-coor=1"};
+    char line[64];
+    int position = -1;
+    FILE* index;
+
+    CU_ASSERT_EQUAL_FATAL(
+            option_completer_create(&completer, failure_opts, failure_opts_sz),
+            OPTION_OK
+            );
+
+    option_completer_query(completer, 1, dashes, &completion);
+    CU_ASSERT_EQUAL(completion.kind, OPTION_COMPLETE_OPTION);
+    CU_ASSERT_EQUAL(completion.first, 0);
+    CU_ASSERT_EQUAL(completion.count, 4);
+
+    option_completer_query(completer, 1, x_prefix, &completion);
+    CU_ASSERT_EQUAL_FATAL(completion.count, 1);
+    CU_ASSERT_STRING_EQUAL(
+            option_completer_candidate(completer, completion.first, &position),
+            "--x-coor"
+            );
+    CU_ASSERT_EQUAL(position, 2);
+
+    option_completer_query(completer, 2, value, &completion);
+    CU_ASSERT_EQUAL(completion.kind, OPTION_COMPLETE_VALUE);
+    CU_ASSERT_EQUAL(completion.option_index, 0);
+    CU_ASSERT_EQUAL(completion.count, 0);
+
+    // "-v" is the value of "-c", the empty word may be anything.
+    option_completer_query(completer, 3, after_value, &completion);
+    CU_ASSERT_EQUAL(completion.kind, OPTION_COMPLETE_ARGUMENT);
+    CU_ASSERT_EQUAL(completion.count, 8);
+
+    option_completer_query(completer, 1, inline_value, &completion);
+    CU_ASSERT_EQUAL(completion.kind, OPTION_COMPLETE_VALUE);
+    CU_ASSERT_EQUAL(completion.option_index, 2);
+    CU_ASSERT_EQUAL(completion.value_offset, 9);
+
+    CU_ASSERT_EQUAL(option_completer_write_index(completer, "completion.idx"),
+                    OPTION_OK);
+    index = fopen("completion.idx", "r");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(index);
+    CU_ASSERT_PTR_NOT_NULL(fgets(line, sizeof(line), index));
+    CU_ASSERT_STRING_EQUAL(line, "--compiler\tstring\n");
+    fclose(index);
+    remove("completion.idx");
+
+    option_completer_free(completer);
 }
 
 
@@ -504,6 +2056,259 @@ int add_suites()
         return CU_get_error();
     }
 
+    test = CU_add_test(
+            suite, "registry-test", registry_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "validate-test", validate_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "diagnostics-test", diagnostics_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "encoding-test", encoding_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "wide-help-test", wide_help_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "terminal-width-test", terminal_width_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "help-cache-test", help_cache_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "help-sink-test", help_sink_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "prerender-test", prerender_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "limits-test", limits_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "response-file-test", response_file_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "stream-arguments-test", stream_arguments_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "stream-parse-test", stream_parse_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "parse-string-test", parse_string_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "environment-test", environment_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "config-file-test", config_file_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "reloader-test", reloader_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "file-value-test", file_value_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "process-cmdline-test", process_cmdline_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "serialize-test", serialize_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "overlay-test", overlay_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "session-test", session_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(
+            suite, "completion-test", completion_test
+            );
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
     return 0;
 }
 
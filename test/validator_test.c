@@ -0,0 +1,421 @@
+/*
+ * This file is part of the parse-cmd library
+ *
+ * parse-cmd is free software: you can redistribute it and/or modify
+ * it under the terms of the Lesser General Public License as published by
+ * the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * parse-cmd is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the Lesser General Public License
+ * along with c-lib.  If not, see <http://www.gnu.org/licenses/>
+ */
+
+/*
+ * Tests parse-cmd-validatord through the client library. The daemon that
+ * is built with the tests, VALIDATORD, is started for the run.
+ */
+
+// fork(), kill() and nanosleep().
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <CUnit/CUnit.h>
+#include <CUnit/Basic.h>
+#include "../src/parse_cmd.h"
+#include "../tools/validator_client.h"
+
+static const char g_schema_path[] = "validator_test_schema.txt";
+static char g_socket_path[64];
+static pid_t g_daemon = -1;
+
+static const char g_schema[] =
+    "# short  long        type\n"
+    "c        compiler    string\n"
+    "-        jobs        int\n"
+    "v        verbose     flag\n";
+
+/*
+ * Starts the daemon and waits until it accepts connections.
+ */
+static int
+start_daemon(void)
+{
+    struct timespec pause = {0, 10 * 1000 * 1000};
+    FILE* file = fopen(g_schema_path, "w");
+    int i;
+
+    if (!file || fputs(g_schema, file) == EOF || fclose(file) != 0)
+        return -1;
+    snprintf(g_socket_path, sizeof(g_socket_path),
+             "/tmp/parse-cmd-validator-test-%ld.sock", (long) getpid());
+
+    g_daemon = fork();
+    if (g_daemon < 0)
+        return -1;
+    if (g_daemon == 0) {
+        execl(VALIDATORD, VALIDATORD, "-s", g_socket_path, g_schema_path,
+              (char*) NULL);
+        _exit(127);
+    }
+    for (i = 0; i < 500; i++) {
+        validator_client* client = NULL;
+        if (validator_client_connect(&client, g_socket_path) == OPTION_OK) {
+            validator_client_close(client);
+            return 0;
+        }
+        nanosleep(&pause, NULL);
+    }
+    return -1;
+}
+
+/*
+ * Connects without the client library, for frames it won't send.
+ */
+static int
+raw_connect(void)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, g_socket_path);
+    if (fd >= 0 && connect(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Sends a request header with argc and the first size bytes of payload.
+ */
+static int
+raw_send(int fd, uint32_t length, uint32_t argc,
+         const char* payload, size_t size)
+{
+    validator_request_header header;
+    char frame[256];
+
+    header.length       = length;
+    header.id           = 7;
+    header.operation    = VALIDATOR_VALIDATE;
+    header.schema       = 0;
+    header.argc         = argc;
+    memcpy(frame, &header, sizeof(header));
+    memcpy(frame + sizeof(header), payload, size);
+    size += sizeof(header);
+    return write(fd, frame, size) == (ssize_t) size ? 0 : -1;
+}
+
+/*
+ * Reads a response, returns its status or -1 when the daemon closed the
+ * connection instead.
+ */
+static int
+raw_receive(int fd)
+{
+    validator_response_header header;
+    char body[4096];
+    size_t got = 0;
+
+    while (got < sizeof(header)) {
+        ssize_t n = read(fd, (char*) &header + got, sizeof(header) - got);
+        if (n <= 0)
+            return -1;
+        got += (size_t) n;
+    }
+    for (got = 0; got < header.length;) {
+        size_t want = header.length - got;
+        ssize_t n = read(fd, body, want < sizeof(body) ? want : sizeof(body));
+        if (n <= 0)
+            return -1;
+        got += (size_t) n;
+    }
+    return header.status;
+}
+
+/*
+ * Stops the daemon once it has closed the connections of the tests.
+ */
+static void
+stop_daemon(void)
+{
+    int fd;
+
+    if (g_daemon > 0) {
+        // The daemon closes a connection after those that closed before.
+        fd = raw_connect();
+        if (fd >= 0) {
+            shutdown(fd, SHUT_WR);
+            raw_receive(fd);
+            close(fd);
+        }
+        kill(g_daemon, SIGTERM);
+        waitpid(g_daemon, NULL, 0);
+    }
+    remove(g_schema_path);
+}
+
+void framing_test()
+{
+    // "cc -c gcc main.c" as it goes over the wire.
+    const char payload[] = "cc\0-c\0gcc\0main.c";
+    const uint32_t size = sizeof(payload);
+    int fd = raw_connect();
+
+    CU_ASSERT_FATAL(fd >= 0);
+    CU_ASSERT_EQUAL(raw_send(fd, size, 4, payload, size), 0);
+    CU_ASSERT_EQUAL(raw_receive(fd), OPTION_OK);
+
+    // The items don't fill the frame or the frame ends before them.
+    CU_ASSERT_EQUAL(raw_send(fd, size, 3, payload, size), 0);
+    CU_ASSERT_EQUAL(raw_receive(fd), OPTION_PARSE_ERROR);
+    CU_ASSERT_EQUAL(raw_send(fd, size, 5, payload, size), 0);
+    CU_ASSERT_EQUAL(raw_receive(fd), OPTION_PARSE_ERROR);
+    CU_ASSERT_EQUAL(raw_send(fd, size, 0, payload, size), 0);
+    CU_ASSERT_EQUAL(raw_receive(fd), OPTION_INVALID_ARGUMENT);
+
+    // The last item lacks its '\0'.
+    CU_ASSERT_EQUAL(raw_send(fd, size - 1, 4, payload, size - 1), 0);
+    CU_ASSERT_EQUAL(raw_receive(fd), OPTION_PARSE_ERROR);
+
+    // A bad frame doesn't cost the connection.
+    CU_ASSERT_EQUAL(raw_send(fd, size, 4, payload, size), 0);
+    CU_ASSERT_EQUAL(raw_receive(fd), OPTION_OK);
+    close(fd);
+
+    // A frame that is cut short isn't answered.
+    fd = raw_connect();
+    CU_ASSERT_FATAL(fd >= 0);
+    CU_ASSERT_EQUAL(raw_send(fd, size, 4, payload, size / 2), 0);
+    shutdown(fd, SHUT_WR);
+    CU_ASSERT_EQUAL(raw_receive(fd), -1);
+    close(fd);
+
+    // A frame longer than VALIDATOR_MAX_FRAME closes the connection.
+    fd = raw_connect();
+    CU_ASSERT_FATAL(fd >= 0);
+    CU_ASSERT_EQUAL(
+            raw_send(fd, VALIDATOR_MAX_FRAME + 1, 4, payload, size), 0
+            );
+    CU_ASSERT_EQUAL(raw_receive(fd), -1);
+    close(fd);
+}
+
+void client_test()
+{
+    const char* valid[] = {"cc", "-c", "gcc", "--jobs", "4", "main.c"};
+    const char* invalid[] = {"cc", "--jobs", "many"};
+    const char* twice[] = {"cc", "--jobs", "many", "--nope"};
+    const char* huge[] = {"cc", NULL};
+    validator_client* client = NULL;
+    validator_response response;
+    char* text;
+    unsigned i;
+    int arguments = 0;
+
+    CU_ASSERT_EQUAL_FATAL(
+            validator_client_connect(&client, g_socket_path), OPTION_OK
+            );
+
+    text = malloc(VALIDATOR_MAX_FRAME + 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(text);
+    memset(text, 'x', VALIDATOR_MAX_FRAME);
+    text[VALIDATOR_MAX_FRAME] = '\0';
+    huge[1] = text;
+    CU_ASSERT_EQUAL(
+            validator_client_send(client, 0, VALIDATOR_VALIDATE, 0, 2, huge),
+            OPTION_LIMIT_EXCEEDED
+            );
+    free(text);
+
+    CU_ASSERT_EQUAL(
+            validator_client_send(client, 1, VALIDATOR_VALIDATE, 1, 6, valid),
+            OPTION_OK
+            );
+    CU_ASSERT_EQUAL(
+            validator_client_send(client, 2, 9, 0, 6, valid), OPTION_OK
+            );
+    CU_ASSERT_EQUAL(
+            validator_client_send(client, 3, VALIDATOR_VALIDATE, 0, 3, invalid),
+            OPTION_OK
+            );
+    CU_ASSERT_EQUAL(
+            validator_client_send(client, 4, VALIDATOR_PARSE, 0, 6, valid),
+            OPTION_OK
+            );
+
+    // An unknown schema or operation.
+    CU_ASSERT_EQUAL_FATAL(
+            validator_client_receive(client, &response), OPTION_OK
+            );
+    CU_ASSERT_EQUAL(response.id, 1);
+    CU_ASSERT_EQUAL(response.status, OPTION_INVALID_ARGUMENT);
+    CU_ASSERT_EQUAL_FATAL(
+            validator_client_receive(client, &response), OPTION_OK
+            );
+    CU_ASSERT_EQUAL(response.id, 2);
+    CU_ASSERT_EQUAL(response.status, OPTION_INVALID_ARGUMENT);
+
+    CU_ASSERT_EQUAL_FATAL(
+            validator_client_receive(client, &response), OPTION_OK
+            );
+    CU_ASSERT_EQUAL(response.id, 3);
+    CU_ASSERT_EQUAL(response.status, OPTION_PARSE_ERROR);
+    CU_ASSERT_EQUAL_FATAL(response.count, 1);
+    CU_ASSERT_EQUAL(response.records[0].kind, VALIDATOR_DIAGNOSTIC);
+    CU_ASSERT_EQUAL(response.records[0].argv_index, 2);
+
+    CU_ASSERT_EQUAL_FATAL(
+            validator_client_receive(client, &response), OPTION_OK
+            );
+    CU_ASSERT_EQUAL(response.id, 4);
+    CU_ASSERT_EQUAL(response.status, OPTION_OK);
+    CU_ASSERT_EQUAL(response.count, 3);
+    for (i = 0; i < response.count; i++) {
+        const validator_record* record = &response.records[i];
+        const char* value = validator_record_text(&response, record);
+        if (record->kind == VALIDATOR_ARGUMENT) {
+            CU_ASSERT_STRING_EQUAL(value, "main.c");
+            arguments++;
+        }
+        else if (record->option_index == 0)
+            CU_ASSERT_STRING_EQUAL(value, "gcc");
+        else if (record->option_index == 1)
+            CU_ASSERT_STRING_EQUAL(value, "4");
+    }
+    CU_ASSERT_EQUAL(arguments, 1);
+
+    // Parsing an invalid command line reports all of its problems.
+    CU_ASSERT_EQUAL(
+            validator_client_send(client, 5, VALIDATOR_PARSE, 0, 4, twice),
+            OPTION_OK
+            );
+    CU_ASSERT_EQUAL_FATAL(
+            validator_client_receive(client, &response), OPTION_OK
+            );
+    CU_ASSERT_EQUAL(response.id, 5);
+    CU_ASSERT_EQUAL(response.status, OPTION_PARSE_ERROR);
+    CU_ASSERT_EQUAL_FATAL(response.count, 2);
+    CU_ASSERT_EQUAL(response.records[0].kind, VALIDATOR_DIAGNOSTIC);
+    CU_ASSERT_EQUAL(response.records[1].kind, VALIDATOR_DIAGNOSTIC);
+    CU_ASSERT_EQUAL(response.records[1].error, OPTION_UNKNOWN);
+    validator_client_close(client);
+}
+
+void pipeline_test()
+{
+    // More than the daemon keeps unsent before it stops reading.
+    const uint32_t n_requests = 200000;
+    const char* argv[] = {"cc", "-c", "gcc", "main.c"};
+    validator_client* client = NULL;
+    validator_response response;
+    uint32_t id;
+    int ret = OPTION_OK;
+
+    CU_ASSERT_EQUAL_FATAL(
+            validator_client_connect(&client, g_socket_path), OPTION_OK
+            );
+    for (id = 0; id < n_requests && ret == OPTION_OK; id++)
+        ret = validator_client_send(
+                client, id, VALIDATOR_PARSE, 0, 4, argv
+                );
+    CU_ASSERT_EQUAL_FATAL(ret, OPTION_OK);
+
+    for (id = 0; id < n_requests; id++) {
+        ret = validator_client_receive(client, &response);
+        if (ret != OPTION_OK || response.id != id ||
+            response.status != OPTION_OK || response.count != 2)
+            break;
+    }
+    CU_ASSERT_EQUAL(ret, OPTION_OK);
+    CU_ASSERT_EQUAL(id, n_requests);
+    validator_client_close(client);
+}
+
+int add_suites() {
+
+    CU_pSuite suite = CU_add_suite("validator suite", NULL, NULL);
+    CU_pTest  test  = NULL;
+
+    if (!suite) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(suite, "framing-test", framing_test);
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(suite, "client-test", client_test);
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    test = CU_add_test(suite, "pipeline-test", pipeline_test);
+    if (!test) {
+        fprintf(stderr,
+                "unable to create test suite: %s\n",
+                CU_get_error_msg()
+               );
+        return CU_get_error();
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+
+    (void) argc;
+    (void) argv;
+
+    if (start_daemon() != 0) {
+        fprintf(stderr, "unable to start %s\n", VALIDATORD);
+        stop_daemon();
+        return EXIT_FAILURE;
+    }
+
+    if(CU_initialize_registry() != CUE_SUCCESS) {
+        fprintf(stderr, "Unable to initialze the unittesting frame work\n");
+        stop_daemon();
+        return EXIT_FAILURE;
+    }
+
+    add_suites();
+
+    if (CU_basic_run_tests() != CUE_SUCCESS) {
+        fprintf(stderr, "unable to run tests.\n");
+        stop_daemon();
+        return EXIT_FAILURE;
+    }
+
+    CU_cleanup_registry();
+    stop_daemon();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+#
+# This file is part of parse-cmd library
+# 
+# parse-cmd library is free software: you can redistribute it and/or modify
+# it under the terms of the Lesser General Public License as published by
+# the Free Software Foundation, either version 2.1 of the License, or
+# (at your option) any later version.
+# 
+# The parse-cmd library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# Lesser General Public License for more details.
+# 
+# You should have received a copy of the Lesser General Public License
+# along with libparse-cmd.  If not, see <http://www.gnu.org/licenses/>
+#
+
+
+# parse_cmd_prerender_help(<output>
+#                          SCHEMA <source> OPTIONS <table>
+#                          PROGRAM <name> NAME <symbol>
+#                          [DESCRIPTION <symbol>]
+#                          [WIDTHS <width>...]
+#                          [LIBRARY <library>])
+#
+# Generates the C file <output> that defines the option_prerendered_help
+# <symbol>, the help of the schema rendered for each width, by default for
+# 80, 100, 120 and 160 columns. Add <output> to the sources of the program
+# and pass the help to option_context_set_prerendered_help():
+#
+#   parse_cmd_prerender_help(${CMAKE_CURRENT_BINARY_DIR}/help.c
+#                            SCHEMA options.c OPTIONS prog_options
+#                            PROGRAM prog NAME prog_help)
+#   add_executable(prog main.c options.c ${CMAKE_CURRENT_BINARY_DIR}/help.c)
+#
+# The source of the schema is included by a generator that is built and
+# run on the build machine, so it should only define the table <table> of
+# cmd_option and optionally the string <symbol> of DESCRIPTION, not main().
+# PROGRAM is the argv[0] the usage line is rendered for, the rest of the
+# help is used for any program name.
+
+# parse_cmd_completion_index(<program>
+#                            SCHEMA <source> OPTIONS <table>
+#                            [LIBRARY <library>] [INSTALL])
+#
+# Writes the completion index <program>.idx of the schema to the binary
+# directory when target all is built. With INSTALL it is installed into
+# share/parse-cmd/completions next to the completion script, where
+# parse_cmd_completion.bash looks for it:
+#
+#   parse_cmd_completion_index(prog SCHEMA options.c OPTIONS prog_options
+#                              INSTALL)
+#
+# The source of the schema is included as by parse_cmd_prerender_help().
+
+include(CMakeParseArguments)
+
+set(PARSE_CMD_PRERENDER_DIR ${CMAKE_CURRENT_LIST_DIR})
+set(PARSE_CMD_PRERENDER_INCLUDES
+    ${CMAKE_CURRENT_LIST_DIR}/../src
+    ${CMAKE_BINARY_DIR}/src
+    )
+
+function(parse_cmd_prerender_help output)
+    cmake_parse_arguments(PRERENDER
+        ""
+        "SCHEMA;OPTIONS;PROGRAM;NAME;DESCRIPTION;LIBRARY"
+        "WIDTHS"
+        ${ARGN}
+        )
+    if(NOT PRERENDER_SCHEMA OR NOT PRERENDER_OPTIONS OR
+       NOT PRERENDER_PROGRAM OR NOT PRERENDER_NAME)
+        message(FATAL_ERROR
+            "parse_cmd_prerender_help needs SCHEMA, OPTIONS, PROGRAM and NAME")
+    endif()
+    if(NOT PRERENDER_WIDTHS)
+        set(PRERENDER_WIDTHS 80 100 120 160)
+    endif()
+    if(NOT PRERENDER_LIBRARY)
+        set(PRERENDER_LIBRARY ${PARSE_CMD_STATIC_LIB})
+    endif()
+
+    get_filename_component(schema ${PRERENDER_SCHEMA} ABSOLUTE)
+    set(generator ${PRERENDER_NAME}_prerender)
+
+    add_executable(${generator} ${PARSE_CMD_PRERENDER_DIR}/parse_cmd_prerender.c)
+    target_compile_definitions(${generator} PRIVATE
+        PRERENDER_SCHEMA_SOURCE="${schema}"
+        PRERENDER_SCHEMA=${PRERENDER_OPTIONS}
+        )
+    if(PRERENDER_DESCRIPTION)
+        target_compile_definitions(${generator} PRIVATE
+            PRERENDER_DESCRIPTION=${PRERENDER_DESCRIPTION}
+            )
+    endif()
+    target_include_directories(${generator} PRIVATE
+        ${PARSE_CMD_PRERENDER_INCLUDES}
+        )
+    target_link_libraries(${generator} ${PRERENDER_LIBRARY})
+
+    add_custom_command(OUTPUT ${output}
+        COMMAND ${generator} ${output} ${PRERENDER_NAME} ${PRERENDER_PROGRAM}
+                ${PRERENDER_WIDTHS}
+        DEPENDS ${generator} ${schema}
+        COMMENT "Prerendering the help of ${PRERENDER_NAME}"
+        )
+endfunction()
+
+function(parse_cmd_completion_index program)
+    cmake_parse_arguments(COMPLETION
+        "INSTALL"
+        "SCHEMA;OPTIONS;LIBRARY"
+        ""
+        ${ARGN}
+        )
+    if(NOT COMPLETION_SCHEMA OR NOT COMPLETION_OPTIONS)
+        message(FATAL_ERROR
+            "parse_cmd_completion_index needs SCHEMA and OPTIONS")
+    endif()
+    if(NOT COMPLETION_LIBRARY)
+        set(COMPLETION_LIBRARY ${PARSE_CMD_STATIC_LIB})
+    endif()
+
+    get_filename_component(schema ${COMPLETION_SCHEMA} ABSOLUTE)
+    set(generator ${program}_complete_index)
+    set(output ${CMAKE_CURRENT_BINARY_DIR}/${program}.idx)
+
+    add_executable(${generator}
+        ${PARSE_CMD_PRERENDER_DIR}/parse_cmd_complete_index.c
+        )
+    target_compile_definitions(${generator} PRIVATE
+        PRERENDER_SCHEMA_SOURCE="${schema}"
+        PRERENDER_SCHEMA=${COMPLETION_OPTIONS}
+        )
+    target_include_directories(${generator} PRIVATE
+        ${PARSE_CMD_PRERENDER_INCLUDES}
+        )
+    target_link_libraries(${generator} ${COMPLETION_LIBRARY})
+
+    add_custom_command(OUTPUT ${output}
+        COMMAND ${generator} ${output}
+        DEPENDS ${generator} ${schema}
+        COMMENT "Writing the completion index of ${program}"
+        )
+    add_custom_target(${program}_completion ALL DEPENDS ${output})
+    if(COMPLETION_INSTALL)
+        install(FILES ${output} DESTINATION share/parse-cmd/completions)
+    endif()
+endfunction()
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+#
+# This file is part of parse-cmd library
+#
+# parse-cmd library is free software: you can redistribute it and/or modify
+# it under the terms of the Lesser General Public License as published by
+# the Free Software Foundation, either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# The parse-cmd library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the Lesser General Public License
+# along with libparse-cmd.  If not, see <http://www.gnu.org/licenses/>
+#
+
+"""
+Generates src/display_width_table.h, the terminal display width of every
+Unicode code point in a two level table.
+
+The code points are split in blocks of 256. The first level maps a block to
+one of the distinct blocks, the second level stores the width of each code
+point of a distinct block in 2 bits. Run it with the Python whose unicodedata
+should be used, e.g. through the display_width_table target of CMake:
+
+    python3 tools/gen_display_width.py src/display_width_table.h
+"""
+
+import sys
+import unicodedata
+
+BLOCK_SIZE = 256
+MAX_CODE_POINT = 0x110000
+
+
+def width(cp):
+    """The number of columns a terminal uses to display cp."""
+    if cp == 0x00AD:                        # soft hyphen is visible
+        return 1
+    if 0x1160 <= cp <= 0x11FF:              # Hangul medial and final jamo
+        return 0
+    if 0x20000 <= cp <= 0x3FFFD:            # ideographic planes
+        return 2
+    char = chr(cp)
+    if unicodedata.category(char) in ("Mn", "Me", "Cf", "Cc"):
+        return 0
+    if unicodedata.east_asian_width(char) in ("W", "F"):
+        return 2
+    return 1
+
+
+def pack(widths):
+    """Packs the widths of a block, four code points per byte."""
+    out = bytearray(len(widths) // 4)
+    for i, w in enumerate(widths):
+        out[i // 4] |= w << (2 * (i % 4))
+    return bytes(out)
+
+
+def main(path):
+    blocks = []
+    index = {}
+    stage1 = []
+    for start in range(0, MAX_CODE_POINT, BLOCK_SIZE):
+        block = pack([width(cp) for cp in range(start, start + BLOCK_SIZE)])
+        if block not in index:
+            index[block] = len(blocks)
+            blocks.append(block)
+        stage1.append(index[block])
+    assert len(blocks) <= 256
+
+    lines = []
+    lines.append("/*")
+    lines.append(" * Generated by tools/gen_display_width.py from Unicode %s,"
+                 % unicodedata.unidata_version)
+    lines.append(" * don't edit.")
+    lines.append(" */")
+    lines.append("")
+    lines.append("#ifndef DISPLAY_WIDTH_TABLE_H")
+    lines.append("#define DISPLAY_WIDTH_TABLE_H")
+    lines.append("")
+    lines.append("#define DISPLAY_WIDTH_BLOCK_SHIFT 8")
+    lines.append("")
+    lines.append("/* The distinct block of every block of 256 code points. */")
+    lines.append("static const unsigned char display_width_blocks[%d] = {"
+                 % len(stage1))
+    for i in range(0, len(stage1), 16):
+        lines.append("    " + ", ".join("%3d" % b for b in stage1[i:i + 16])
+                     + ",")
+    lines.append("};")
+    lines.append("")
+    lines.append("/* The widths of the distinct blocks, 2 bits per code point. */")
+    lines.append("static const unsigned char display_width_bits[%d][%d] = {"
+                 % (len(blocks), BLOCK_SIZE // 4))
+    for block in blocks:
+        lines.append("    {")
+        for i in range(0, len(block), 12):
+            lines.append("        " +
+                         ", ".join("0x%02x" % b for b in block[i:i + 12]) +
+                         ",")
+        lines.append("    },")
+    lines.append("};")
+    lines.append("")
+    lines.append("#endif")
+
+    with open(path, "w") as out:
+        out.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 2:
+        sys.exit("usage: gen_display_width.py <output>")
+    main(sys.argv[1])
@@ -0,0 +1,67 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file parse_cmd_complete_index.c
+ *
+ * Writes the completion index of a schema that
+ * tools/parse_cmd_completion.bash searches. It is built for one schema by
+ * the parse_cmd_completion_index() CMake function in
+ * ParseCmdPrerender.cmake.
+ *
+ * The source of the schema is included as by parse_cmd_prerender.c:
+ *
+ *     cc -DPRERENDER_SCHEMA_SOURCE='"schema.c"' -DPRERENDER_SCHEMA=opts
+ *        parse_cmd_complete_index.c
+ *
+ * usage: parse_cmd_complete_index <program.idx>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "parse_cmd.h"
+
+#if !defined(PRERENDER_SCHEMA_SOURCE) || !defined(PRERENDER_SCHEMA)
+#error "define PRERENDER_SCHEMA_SOURCE and PRERENDER_SCHEMA"
+#endif
+
+#include PRERENDER_SCHEMA_SOURCE
+
+int main(int argc, char** argv)
+{
+    option_completer* completer = NULL;
+    unsigned n_opts = sizeof(PRERENDER_SCHEMA) / sizeof(PRERENDER_SCHEMA[0]);
+    int ret;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <program.idx>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ret = option_completer_create(&completer, PRERENDER_SCHEMA, n_opts);
+    if (ret == OPTION_OK)
+        ret = option_completer_write_index(completer, argv[1]);
+    option_completer_free(completer);
+    if (ret != OPTION_OK) {
+        fprintf(stderr, "unable to write %s: error %d\n", argv[1], ret);
+        remove(argv[1]);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
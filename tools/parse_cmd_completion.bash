@@ -0,0 +1,170 @@
+#
+# This file is part of parse-cmd library
+#
+# parse-cmd library is free software: you can redistribute it and/or modify
+# it under the terms of the Lesser General Public License as published by
+# the Free Software Foundation, either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# The parse-cmd library is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# Lesser General Public License for more details.
+#
+# You should have received a copy of the Lesser General Public License
+# along with libparse-cmd.  If not, see <http://www.gnu.org/licenses/>
+#
+
+# Bash completion from the index written by option_completer_write_index(),
+# the program itself isn't started. The index of a program is looked up as
+# <dir>/<program>.idx in $PARSE_CMD_COMPLETION_DIR, $HOME/.cache/parse-cmd
+# and the completions directory next to this script, e.g.:
+#
+#   . parse_cmd_completion.bash
+#   complete -F _parse_cmd_complete myprog
+#
+# The index is written at build time by parse_cmd_completion_index() of
+# ParseCmdPrerender.cmake, which installs it into that completions
+# directory, or at run time by a program that calls
+# option_completer_write_index().
+#
+# The index is sorted bytewise, so look(1) finds a prefix with a binary
+# search; without look(1) the index is scanned.
+
+_parse_cmd_completion_installed="$(cd "$(dirname "${BASH_SOURCE[0]}")" \
+    2> /dev/null && pwd)/completions"
+
+_parse_cmd_lookup()
+{
+    if command -v look > /dev/null 2>&1; then
+        LC_ALL=C look -- "$1" "$2"
+    else
+        awk -v prefix="$1" 'index($0, prefix) == 1' "$2"
+    fi
+}
+
+# Prints the type of the option exactly spelled $1, e.g. "int".
+_parse_cmd_type()
+{
+    _parse_cmd_lookup "$1"$'\t' "$2" | cut -f2
+}
+
+# The shell version of word_value() in option_completion.c: when the word
+# $1 names an option that takes a value, prints its type and where the
+# value starts in the word, 0 when the value is the next word.
+_parse_cmd_word_value()
+{
+    local word="$1" index="$2" type name i c
+
+    case "$word" in
+        --*)
+            name="${word%%=*}"
+            type=$(_parse_cmd_type "$name" "$index")
+            [ -n "$type" ] && [ "$type" != flag ] || return 1
+            if [ "$name" != "$word" ]; then
+                echo "$type $((${#name} + 1))"
+            else
+                echo "$type 0"
+            fi
+            ;;
+        -?*)
+            # A cluster of flags that may end in an option with a value.
+            for ((i = 1; i < ${#word}; i++)); do
+                c="${word:i:1}"
+                [ "$c" = "=" ] && return 1
+                type=$(_parse_cmd_type "-$c" "$index")
+                [ -n "$type" ] || return 1
+                [ "$type" = flag ] && continue
+                if ((i + 1 == ${#word})); then
+                    echo "$type 0"
+                elif [ "${word:i+1:1}" = "=" ]; then
+                    echo "$type $((i + 2))"
+                else
+                    echo "$type $((i + 1))"
+                fi
+                return 0
+            done
+            return 1
+            ;;
+    esac
+    return 1
+}
+
+_parse_cmd_complete()
+{
+    local program="${1##*/}"
+    local index="" dir pending="" found type offset cut i n=0
+    local -a words=()
+    local cur reply
+
+    COMPREPLY=()
+    for dir in "$PARSE_CMD_COMPLETION_DIR" "$HOME/.cache/parse-cmd" \
+               "$_parse_cmd_completion_installed"; do
+        if [ -n "$dir" ] && [ -r "$dir/$program.idx" ]; then
+            index="$dir/$program.idx"
+            break
+        fi
+    done
+    [ -n "$index" ] || return 1
+
+    # Bash splits "--name=value" at the '=' of COMP_WORDBREAKS, join the
+    # pieces again.
+    for ((i = 1; i <= COMP_CWORD; i++)); do
+        if ((n > 0)) && { [ "${COMP_WORDS[i]}" = "=" ] ||
+                          [ "${COMP_WORDS[i-1]}" = "=" ]; }; then
+            words[n-1]+="${COMP_WORDS[i]}"
+        else
+            words[n++]="${COMP_WORDS[i]}"
+        fi
+    done
+    cur="${words[n-1]}"
+    # The length of what bash doesn't replace of the current word.
+    cut="${COMP_WORDS[COMP_CWORD]}"
+    [ "$cut" = "=" ] && cut=""
+    cut=$((${#cur} - ${#cut}))
+
+    # Replay the words in front of the current one, a value may look like
+    # an option.
+    for ((i = 0; i < n - 1; i++)); do
+        if [ -n "$pending" ]; then
+            pending=""
+            continue
+        fi
+        found=$(_parse_cmd_word_value "${words[i]}" "$index")
+        [ "${found#* }" = 0 ] && pending="${found% *}"
+    done
+
+    # The word after an option that takes a value, or a value in the word.
+    type="$pending"
+    offset=0
+    if [ -z "$type" ]; then
+        found=$(_parse_cmd_word_value "$cur" "$index")
+        if [ -n "$found" ] && [ "${found#* }" != 0 ]; then
+            type="${found% *}"
+            offset="${found#* }"
+        fi
+    fi
+    case "$type" in
+        file)
+            COMPREPLY=($(compgen -P "${cur:0:offset}" -f -- "${cur:offset}"))
+            ;;
+        ?*)
+            ;;
+        *)
+            case "$cur" in
+                -*)
+                    COMPREPLY=($(_parse_cmd_lookup "$cur" "$index" | cut -f1))
+                    ;;
+                *)
+                    COMPREPLY=($(compgen -f -- "$cur"))
+                    ;;
+            esac
+            ;;
+    esac
+
+    for ((i = 0; i < ${#COMPREPLY[@]}; i++)); do
+        reply="${COMPREPLY[i]}"
+        COMPREPLY[i]="${reply:cut}"
+    done
+    return 0
+}
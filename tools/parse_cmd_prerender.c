@@ -0,0 +1,193 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file parse_cmd_prerender.c
+ *
+ * Renders the help of a schema for a number of terminal widths and writes
+ * it as constant data to a C file. It is built for one schema by the
+ * parse_cmd_prerender_help() CMake function in ParseCmdPrerender.cmake.
+ *
+ * The source of the schema is included, so the number of options follows
+ * from the size of the table:
+ *
+ *     cc -DPRERENDER_SCHEMA_SOURCE='"schema.c"' -DPRERENDER_SCHEMA=opts
+ *        [-DPRERENDER_DESCRIPTION=description] parse_cmd_prerender.c
+ *
+ * usage: parse_cmd_prerender <output.c> <name> <program> <width>...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parse_cmd.h"
+
+#if !defined(PRERENDER_SCHEMA_SOURCE) || !defined(PRERENDER_SCHEMA)
+#error "define PRERENDER_SCHEMA_SOURCE and PRERENDER_SCHEMA"
+#endif
+
+#include PRERENDER_SCHEMA_SOURCE
+
+/*
+ * Writes text and a terminating '\0' as the initializer of a char array,
+ * a string literal may be too long for the compiler.
+ */
+static void
+write_bytes(FILE* out, const char* text, size_t length)
+{
+    size_t i;
+
+    fputs("{", out);
+    for (i = 0; i <= length; i++)
+        fprintf(out, "%s0x%02x,",
+                i % 12 == 0 ? "\n    " : " ",
+                i < length ? (unsigned char) text[i] : 0
+                );
+    fputs("\n};\n\n", out);
+}
+
+static int
+write_help(
+        FILE*                   out,
+        const option_context*   options,
+        const char*             name,
+        int                     n_widths,
+        char**                  widths
+        )
+{
+    const char* description = option_context_get_description(options);
+    const char* help;
+    const char* usage;
+    int i;
+
+    fprintf(out,
+            "/*\n"
+            " * Generated by parse_cmd_prerender from %s, don't edit.\n"
+            " */\n\n"
+            "#include \"parse_cmd.h\"\n\n",
+            PRERENDER_SCHEMA_SOURCE
+            );
+
+    for (i = 0; i < n_widths; i++) {
+        int width = atoi(widths[i]);
+        help  = NULL;
+        usage = NULL;
+        if (width <= 0) {
+            fprintf(stderr, "invalid width: %s\n", widths[i]);
+            return EXIT_FAILURE;
+        }
+        if (option_context_help_cached(options, width, &help) != OPTION_OK ||
+            option_context_short_help_cached(options, width, &usage)
+                != OPTION_OK) {
+            fprintf(stderr, "unable to render the help\n");
+            return EXIT_FAILURE;
+        }
+        // The runtime takes the short help from the start of the help.
+        if (strncmp(help, usage, strlen(usage)) != 0) {
+            fprintf(stderr, "the help doesn't start with the usage\n");
+            return EXIT_FAILURE;
+        }
+        fprintf(out, "static const char %s_%d[] = ", name, width);
+        write_bytes(out, help, strlen(help));
+    }
+
+    fprintf(out, "static const char %s_prog_name[] = ", name);
+    write_bytes(out, option_context_prog_name(options),
+                strlen(option_context_prog_name(options)));
+    if (description) {
+        fprintf(out, "static const char %s_description[] = ", name);
+        write_bytes(out, description, strlen(description));
+    }
+
+    fprintf(out, "static const option_help_rendering %s_renderings[] = {\n",
+            name);
+    for (i = 0; i < n_widths; i++) {
+        int width = atoi(widths[i]);
+        option_context_help_cached(options, width, &help);
+        option_context_short_help_cached(options, width, &usage);
+        fprintf(out, "    {%d, %s_%d, %lu, %lu},\n",
+                width, name, width,
+                (unsigned long) strlen(help),
+                (unsigned long) strlen(usage)
+                );
+    }
+    fputs("};\n\n", out);
+
+    fprintf(out,
+            "const option_prerendered_help %s = {\n"
+            "    %s_prog_name,\n",
+            name, name
+            );
+    if (description)
+        fprintf(out, "    %s_description,\n", name);
+    else
+        fputs("    NULL,\n", out);
+    fprintf(out,
+            "    %u,\n"
+            "    %s_renderings,\n"
+            "    %d\n"
+            "};\n",
+            (unsigned) option_context_num_predef_options(options),
+            name,
+            n_widths
+            );
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+    option_context* options = NULL;
+    const char* args[1];
+    unsigned n_opts = sizeof(PRERENDER_SCHEMA) / sizeof(PRERENDER_SCHEMA[0]);
+    FILE* out;
+    int ret;
+
+    if (argc < 5) {
+        fprintf(stderr,
+                "usage: %s <output.c> <name> <program> <width>...\n",
+                argv[0]
+                );
+        return EXIT_FAILURE;
+    }
+
+    args[0] = argv[3];
+    if (options_parse(&options, 1, args, PRERENDER_SCHEMA, n_opts)
+            != OPTION_OK) {
+        fprintf(stderr, "unable to parse the schema\n");
+        return EXIT_FAILURE;
+    }
+#if defined(PRERENDER_DESCRIPTION)
+    option_context_set_description(options, PRERENDER_DESCRIPTION);
+#endif
+
+    out = fopen(argv[1], "w");
+    if (!out) {
+        perror(argv[1]);
+        option_context_free(options);
+        return EXIT_FAILURE;
+    }
+    ret = write_help(out, options, argv[2], argc - 4, argv + 4);
+    if (fclose(out) != 0)
+        ret = EXIT_FAILURE;
+    if (ret != EXIT_SUCCESS)
+        remove(argv[1]);
+
+    option_context_free(options);
+    return ret;
+}
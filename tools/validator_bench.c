@@ -0,0 +1,231 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file validator_bench.c
+ *
+ * parse-cmd-validator-bench sends the same command line over a number of
+ * connections, each from its own thread, and keeps a number of requests
+ * in flight on every connection. It reports the throughput and the
+ * latencies of the requests, e.g.
+ *
+ *     parse-cmd-validator-bench -s /tmp/v.sock -c 4 -d 16 -n 100000 \
+ *         --line "cc -O2 -o main main.c"
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "../src/parse_cmd.h"
+#include "validator_client.h"
+
+/**
+ * What one thread does and measures.
+ */
+typedef struct bench_worker {
+    pthread_t           thread;     ///< The thread.
+    const char*         path;       ///< The socket of the daemon.
+    int                 operation;  ///< The VALIDATOR_OPERATION to request.
+    int                 schema;     ///< The schema to use.
+    int                 argc;       ///< Items in the command line.
+    const char* const*  argv;       ///< The command line.
+    int                 depth;      ///< Requests in flight.
+    long                requests;   ///< Requests to send.
+    double*             latencies;  ///< The latency of each request in s.
+    long                failures;   ///< Responses that weren't OPTION_OK.
+    int                 error;      ///< OPTION_OK or what went wrong.
+} bench_worker;
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void*
+bench_run(void* data)
+{
+    bench_worker* w = data;
+    validator_client* client = NULL;
+    double* started = malloc((size_t) w->requests * sizeof(double));
+    long sent = 0, received = 0;
+
+    w->error = started ? validator_client_connect(&client, w->path) :
+                         OPTION_OUT_OF_MEM;
+    while (w->error == OPTION_OK && received < w->requests) {
+        validator_response response;
+        // Keep depth requests in flight.
+        while (sent < w->requests && sent - received < w->depth) {
+            started[sent] = now();
+            w->error = validator_client_send(
+                    client, (uint32_t) sent, w->operation, w->schema,
+                    w->argc, w->argv
+                    );
+            if (w->error)
+                break;
+            sent++;
+        }
+        if (w->error)
+            break;
+        w->error = validator_client_receive(client, &response);
+        if (w->error)
+            break;
+        w->latencies[response.id] = now() - started[response.id];
+        if (response.status != OPTION_OK)
+            w->failures++;
+        received++;
+    }
+    validator_client_close(client);
+    free(started);
+    return NULL;
+}
+
+static int
+compare_double(const void* a, const void* b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+    return x < y ? -1 : x > y;
+}
+
+static cmd_option bench_options[] = {
+    {'s', "socket",         OPT_STR},
+    {'l', "line",           OPT_STR},
+    {'c', "connections",    OPT_INT},
+    {'d', "depth",          OPT_INT},
+    {'n', "requests",       OPT_INT},
+    {'S', "schema",         OPT_INT},
+    {'p', "parse",          OPT_FLAG},
+    {'h', "help",           OPT_FLAG}
+};
+
+int main(int argc, char** argv)
+{
+    option_context* options = NULL;
+    option_context* line = NULL;
+    option_parse_settings split = {OPTION_FLAG_IGNORE_UNKNOWN};
+    const char* path = NULL;
+    const char* text = "program";
+    char* command;
+    bench_worker* workers;
+    double* latencies;
+    double start, elapsed;
+    int connections = 1, depth = 1, requests = 10000, schema = 0;
+    int i, line_argc, ret;
+    const char* const* line_argv;
+    long total, failures = 0;
+
+    ret = options_parse(
+            &options, argc, (const char* const*) argv, bench_options,
+            sizeof(bench_options) / sizeof(bench_options[0])
+            );
+    if (ret)
+        return EXIT_FAILURE;
+    option_context_set_description(
+            options,
+            "Measures parse-cmd-validatord: sends --line, split as a shell "
+            "would, --requests times per connection."
+            );
+    if (option_context_have_option(options, "help") ||
+        option_context_str_value(options, "socket", &path)) {
+        char* help = NULL;
+        int asked = option_context_have_option(options, "help");
+        if (option_context_help(options, &help) == OPTION_OK)
+            fprintf(asked ? stdout : stderr, "%s", help);
+        free(help);
+        option_context_free(options);
+        return asked ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    option_context_str_value(options, "line", &text);
+    option_context_int_value(options, "connections", &connections);
+    option_context_int_value(options, "depth", &depth);
+    option_context_int_value(options, "requests", &requests);
+    option_context_int_value(options, "schema", &schema);
+    if (connections < 1 || depth < 1 || requests < 1) {
+        fprintf(stderr, "connections, depth and requests must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    // Split the line with the library, without options it keeps all items.
+    command = strdup(text);
+    if (!command || options_parse_string(
+                &line, "", command, NULL, 0, &split) != OPTION_OK)
+        return EXIT_FAILURE;
+    line_argv = option_context_argv(line, &line_argc);
+    // The first item of the line is its program name.
+    line_argv++;
+    line_argc--;
+    if (line_argc < 1) {
+        fprintf(stderr, "--line is empty\n");
+        return EXIT_FAILURE;
+    }
+
+    total = (long) connections * requests;
+    workers = calloc((size_t) connections, sizeof(bench_worker));
+    latencies = malloc((size_t) total * sizeof(double));
+    if (!workers || !latencies)
+        return EXIT_FAILURE;
+
+    start = now();
+    for (i = 0; i < connections; i++) {
+        bench_worker* w = &workers[i];
+        w->path         = path;
+        w->operation    = option_context_have_option(options, "parse") ?
+                          VALIDATOR_PARSE : VALIDATOR_VALIDATE;
+        w->schema       = schema;
+        w->argc         = line_argc;
+        w->argv         = line_argv;
+        w->depth        = depth;
+        w->requests     = requests;
+        w->latencies    = latencies + (long) i * requests;
+        if (pthread_create(&w->thread, NULL, bench_run, w) != 0)
+            return EXIT_FAILURE;
+    }
+    for (i = 0; i < connections; i++) {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].error) {
+            fprintf(stderr, "connection %d failed: error %d\n",
+                    i, workers[i].error);
+            return EXIT_FAILURE;
+        }
+        failures += workers[i].failures;
+    }
+    elapsed = now() - start;
+
+    qsort(latencies, (size_t) total, sizeof(double), compare_double);
+    printf("requests:   %ld (%ld not OPTION_OK)\n", total, failures);
+    printf("elapsed:    %.3f s\n", elapsed);
+    printf("throughput: %.0f requests/s\n", total / elapsed);
+    printf("latency:    p50 %.1f us, p99 %.1f us, max %.1f us\n",
+           latencies[total / 2] * 1e6,
+           latencies[total * 99 / 100] * 1e6,
+           latencies[total - 1] * 1e6);
+
+    free(latencies);
+    free(workers);
+    option_context_free(line);
+    free(command);
+    option_context_free(options);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,299 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file validator_client.c
+ *
+ * The client side of the validator protocol.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../src/parse_cmd.h"
+#include "validator_client.h"
+
+/**
+ * Send the queued requests once this many bytes are queued.
+ */
+#define CLIENT_SEND_BATCH 65536
+
+struct validator_client {
+    int     fd;             ///< The socket.
+    char*   out;            ///< The queued requests.
+    size_t  out_size;       ///< Bytes queued.
+    size_t  out_capacity;   ///< Capacity of out.
+    char*   in;             ///< The received bytes.
+    size_t  in_size;        ///< Bytes received.
+    size_t  in_start;       ///< Start of the first unread response.
+    size_t  in_capacity;    ///< Capacity of in.
+    char*   frame;          ///< The response last returned.
+    size_t  frame_capacity; ///< Capacity of frame.
+};
+
+static int
+reserve(char** data, size_t* capacity, size_t needed)
+{
+    size_t n = *capacity ? *capacity : 4096;
+    char* grown;
+    if (needed <= *capacity)
+        return OPTION_OK;
+    while (n < needed)
+        n *= 2;
+    grown = realloc(*data, n);
+    if (!grown)
+        return OPTION_OUT_OF_MEM;
+    *data = grown;
+    *capacity = n;
+    return OPTION_OK;
+}
+
+int
+validator_client_connect(validator_client** client, const char* path)
+{
+    struct sockaddr_un addr;
+    validator_client* c;
+
+    if (!client || !path || strlen(path) >= sizeof(addr.sun_path))
+        return OPTION_INVALID_ARGUMENT;
+
+    c = calloc(1, sizeof(validator_client));
+    if (!c)
+        return OPTION_OUT_OF_MEM;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    c->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (c->fd < 0 ||
+        connect(c->fd, (struct sockaddr*) &addr, sizeof(addr)) != 0) {
+        if (c->fd >= 0)
+            close(c->fd);
+        free(c);
+        return OPTION_FILE_ERROR;
+    }
+    *client = c;
+    return OPTION_OK;
+}
+
+void
+validator_client_close(validator_client* client)
+{
+    if (!client)
+        return;
+    close(client->fd);
+    free(client->out);
+    free(client->in);
+    free(client->frame);
+    free(client);
+}
+
+int
+validator_client_send(
+        validator_client*   client,
+        uint32_t            id,
+        int                 operation,
+        int                 schema,
+        int                 argc,
+        const char* const*  argv
+        )
+{
+    validator_request_header header;
+    size_t length = 0;
+    char* p;
+    int i;
+
+    if (!client || argc < 1 || !argv)
+        return OPTION_INVALID_ARGUMENT;
+    for (i = 0; i < argc; i++)
+        length += strlen(argv[i]) + 1;
+    if (length > VALIDATOR_MAX_FRAME)
+        return OPTION_LIMIT_EXCEEDED;
+
+    if (reserve(&client->out, &client->out_capacity,
+                client->out_size + sizeof(header) + length))
+        return OPTION_OUT_OF_MEM;
+
+    header.length       = (uint32_t) length;
+    header.id           = id;
+    header.operation    = (uint16_t) operation;
+    header.schema       = (uint16_t) schema;
+    header.argc         = (uint32_t) argc;
+    p = client->out + client->out_size;
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    for (i = 0; i < argc; i++) {
+        size_t n = strlen(argv[i]) + 1;
+        memcpy(p, argv[i], n);
+        p += n;
+    }
+    client->out_size += sizeof(header) + length;
+
+    if (client->out_size >= CLIENT_SEND_BATCH)
+        return validator_client_flush(client);
+    return OPTION_OK;
+}
+
+/*
+ * Reads the responses that arrived into the input without waiting.
+ */
+static int
+read_available(validator_client* client)
+{
+    if (client->in_start) {
+        memmove(client->in, client->in + client->in_start,
+                client->in_size - client->in_start);
+        client->in_size -= client->in_start;
+        client->in_start = 0;
+    }
+    for (;;) {
+        ssize_t n;
+        if (reserve(&client->in, &client->in_capacity,
+                    client->in_size + 65536))
+            return OPTION_OUT_OF_MEM;
+        n = recv(client->fd, client->in + client->in_size,
+                 client->in_capacity - client->in_size, MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return OPTION_OK;
+        if (n <= 0)
+            return OPTION_FILE_ERROR;
+        client->in_size += (size_t) n;
+    }
+}
+
+int
+validator_client_flush(validator_client* client)
+{
+    size_t sent = 0;
+
+    if (!client)
+        return OPTION_INVALID_ARGUMENT;
+    while (sent < client->out_size) {
+        struct pollfd pfd;
+        ssize_t n = send(client->fd, client->out + sent,
+                         client->out_size - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n > 0) {
+            sent += (size_t) n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            return OPTION_FILE_ERROR;
+
+        // The daemon stops reading while our responses pile up, take them
+        // in while we wait or neither side makes progress.
+        pfd.fd = client->fd;
+        pfd.events = POLLIN | POLLOUT;
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            return OPTION_FILE_ERROR;
+        }
+        if (pfd.revents & POLLIN) {
+            int ret = read_available(client);
+            if (ret)
+                return ret;
+        }
+        else if (!(pfd.revents & POLLOUT))
+            return OPTION_FILE_ERROR;
+    }
+    client->out_size = 0;
+    return OPTION_OK;
+}
+
+int
+validator_client_receive(validator_client* client, validator_response* response)
+{
+    validator_response_header header;
+    const char* body;
+    size_t available;
+
+    if (!client || !response)
+        return OPTION_INVALID_ARGUMENT;
+    if (client->out_size && validator_client_flush(client))
+        return OPTION_FILE_ERROR;
+
+    for (;;) {
+        size_t needed;
+        ssize_t n;
+        available = client->in_size - client->in_start;
+        if (available >= sizeof(header)) {
+            memcpy(&header, client->in + client->in_start, sizeof(header));
+            if (available >= sizeof(header) + header.length)
+                break;
+        }
+        // Keep what is left of the responses read before.
+        if (client->in_start) {
+            memmove(client->in, client->in + client->in_start, available);
+            client->in_size = available;
+            client->in_start = 0;
+        }
+        needed = available + 65536;
+        if (available >= sizeof(header) &&
+            sizeof(header) + header.length > needed)
+            needed = sizeof(header) + header.length;
+        if (reserve(&client->in, &client->in_capacity, needed))
+            return OPTION_OUT_OF_MEM;
+        n = recv(client->fd, client->in + client->in_size,
+                 client->in_capacity - client->in_size, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return OPTION_FILE_ERROR;
+        client->in_size += (size_t) n;
+    }
+
+    if ((size_t) header.count * sizeof(validator_record) > header.length)
+        return OPTION_PARSE_ERROR;
+    // The responses follow each other unaligned, the records are read from
+    // a copy.
+    if (reserve(&client->frame, &client->frame_capacity, header.length + 1))
+        return OPTION_OUT_OF_MEM;
+    memcpy(client->frame, client->in + client->in_start + sizeof(header),
+           header.length);
+    client->in_start += sizeof(header) + header.length;
+    if (client->in_start == client->in_size)
+        client->in_start = client->in_size = 0;
+
+    body = client->frame;
+    response->id        = header.id;
+    response->status    = header.status;
+    response->count     = header.count;
+    response->records   = (const validator_record*) body;
+    response->text      = body + header.count * sizeof(validator_record);
+    return OPTION_OK;
+}
+
+const char*
+validator_record_text(
+        const validator_response*   response,
+        const validator_record*     record
+        )
+{
+    return response->text + record->text;
+}
@@ -0,0 +1,120 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef VALIDATOR_CLIENT_H
+#define VALIDATOR_CLIENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "validator_protocol.h"
+
+/**
+ * \file validator_client.h
+ *
+ * A client of parse-cmd-validatord. Requests are buffered and sent when
+ * the buffer fills up or a response is awaited, so a client that sends a
+ * batch of requests before reading pays few system calls. While sending
+ * waits for the daemon, the responses that arrive are read and kept until
+ * validator_client_receive() returns them, so any number of requests may
+ * be sent before the first response is read. The functions return the
+ * OPTION_RET_VAL of the library; OPTION_FILE_ERROR when the connection
+ * fails.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// A connection to the daemon.
+typedef struct validator_client validator_client;
+
+/**
+ * A response of the daemon, it is valid until the next call to
+ * validator_client_receive().
+ */
+typedef struct validator_response {
+    uint32_t                id;         ///< The id of the request.
+    int                     status;     ///< The OPTION_RET_VAL of the request.
+    unsigned                count;      ///< The number of records.
+    const validator_record* records;    ///< The results.
+    const char*             text;       ///< The text area of the records.
+} validator_response;
+
+/**
+ * Connects to the daemon listening at path.
+ */
+int
+validator_client_connect(validator_client** client, const char* path);
+
+/**
+ * Closes the connection and frees the client.
+ */
+void
+validator_client_close(validator_client* client);
+
+/**
+ * Queues a request.
+ *
+ * \param[in] client    The connection.
+ * \param[in] id        Returned in the response.
+ * \param[in] operation A VALIDATOR_OPERATION.
+ * \param[in] schema    The position of the schema on the daemon's command
+ *                      line.
+ * \param[in] argc      The number of items, argv[0] included.
+ * \param[in] argv      The command line.
+ *
+ * \returns OPTION_OK, OPTION_LIMIT_EXCEEDED when the request is larger than
+ *          VALIDATOR_MAX_FRAME or an error of sending.
+ */
+int
+validator_client_send(
+        validator_client*   client,
+        uint32_t            id,
+        int                 operation,
+        int                 schema,
+        int                 argc,
+        const char* const*  argv
+        );
+
+/**
+ * Sends the queued requests.
+ */
+int
+validator_client_flush(validator_client* client);
+
+/**
+ * Waits for the next response, sends the queued requests first.
+ */
+int
+validator_client_receive(validator_client* client, validator_response* response);
+
+/**
+ * Returns the text of a record of a response.
+ */
+const char*
+validator_record_text(
+        const validator_response*   response,
+        const validator_record*     record
+        );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
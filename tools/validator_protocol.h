@@ -0,0 +1,107 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef VALIDATOR_PROTOCOL_H
+#define VALIDATOR_PROTOCOL_H
+
+#include <stdint.h>
+
+/**
+ * \file validator_protocol.h
+ *
+ * The framing spoken over the UNIX domain socket of parse-cmd-validatord.
+ *
+ * A client writes requests and reads responses, it may write any number
+ * of requests before it reads; the responses come in the order of the
+ * requests. The daemon stops reading a connection while its responses
+ * aren't taken, so a client that writes much must read while a write
+ * would block. All integers are in the byte order of the host, the socket
+ * never leaves the machine.
+ *
+ * A request is a validator_request_header followed by argc items of the
+ * command line that are each terminated by a '\0', argv[0] included. A
+ * response is a validator_response_header followed by count
+ * validator_records and a text area of '\0' terminated strings that the
+ * records refer to by their offset in the text area.
+ */
+
+/**
+ * The largest frame accepted, a connection that sends more is closed.
+ */
+#define VALIDATOR_MAX_FRAME (1u << 20)
+
+/**
+ * What a request asks for.
+ */
+enum VALIDATOR_OPERATION {
+    /**
+     * Check the command line, the response holds a VALIDATOR_DIAGNOSTIC
+     * for every problem.
+     */
+    VALIDATOR_VALIDATE = 1,
+    /**
+     * Parse the command line, when it is valid the response holds a
+     * VALIDATOR_OPTION for every option specified and a VALIDATOR_ARGUMENT
+     * for every argument, otherwise it is as for VALIDATOR_VALIDATE.
+     */
+    VALIDATOR_PARSE = 2
+};
+
+/**
+ * What a validator_record describes.
+ */
+enum VALIDATOR_RECORD_KIND {
+    VALIDATOR_DIAGNOSTIC = 1,   ///< A problem, text is the message.
+    VALIDATOR_OPTION,           ///< An option, text is its value.
+    VALIDATOR_ARGUMENT          ///< An argument, text is the argument.
+};
+
+/**
+ * Starts every request.
+ */
+typedef struct validator_request_header {
+    uint32_t    length;     ///< Bytes after the header.
+    uint32_t    id;         ///< Chosen by the client, echoed in the response.
+    uint16_t    operation;  ///< A VALIDATOR_OPERATION.
+    uint16_t    schema;     ///< The schema, in the order given to the daemon.
+    uint32_t    argc;       ///< The number of items in the command line.
+} validator_request_header;
+
+/**
+ * Starts every response.
+ */
+typedef struct validator_response_header {
+    uint32_t    length;     ///< Bytes after the header.
+    uint32_t    id;         ///< The id of the request.
+    int32_t     status;     ///< OPTION_OK or the first OPTION_RET_VAL found.
+    uint32_t    count;      ///< The number of records.
+} validator_response_header;
+
+/**
+ * One result of a request.
+ */
+typedef struct validator_record {
+    int32_t     kind;           ///< A VALIDATOR_RECORD_KIND.
+    int32_t     error;          ///< The OPTION_RET_VAL of a diagnostic.
+    int32_t     option_index;   ///< The option in the schema or -1.
+    int32_t     argv_index;     ///< The item of the command line or -1.
+    int32_t     byte_offset;    ///< Where in the item a problem is.
+    uint32_t    text;           ///< Offset of the text in the text area.
+} validator_record;
+
+#endif
@@ -0,0 +1,750 @@
+/*
+ * This file is part of lib parse cmd a utility that helps parsing arguments
+ * from the command line. Copyright (C) 2018 Maarten Duijndam
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc. , 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/**
+ * \file validatord.c
+ *
+ * parse-cmd-validatord loads schemas once and validates or parses command
+ * lines for clients on a UNIX domain socket, so a check doesn't pay for
+ * starting a process. One thread serves all connections from an epoll
+ * loop; the requests of a connection are answered in order, a client may
+ * send many before it reads the responses.
+ *
+ * A schema file has one option per line: the short name or '-' when there
+ * is none, the long name and the type (string, int, float, flag or file).
+ * Empty lines and lines that start with '#' are ignored, e.g.
+ *
+ *     # short  long        type
+ *     c        compiler    string
+ *     -        jobs        int
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../src/parse_cmd.h"
+#include "validator_protocol.h"
+
+/**
+ * The number of diagnostics returned for one request at most.
+ */
+#define MAX_DIAGNOSTICS 64
+
+/**
+ * Stop reading requests of a connection while this many bytes of
+ * responses wait to be sent. The client reads while it sends, see
+ * validator_client_flush().
+ */
+#define OUTPUT_HIGH_WATER (4u << 20)
+
+/**
+ * A schema that is loaded from a file.
+ */
+typedef struct schema {
+    char*               text;       ///< The file, the names point into it.
+    cmd_option*         options;    ///< The options for validating.
+    unsigned            n_options;  ///< The number of options.
+    option_registry*    registry;   ///< The options for parsing.
+} schema;
+
+/**
+ * A growable buffer of bytes.
+ */
+typedef struct byte_buffer {
+    char*   data;       ///< The bytes.
+    size_t  size;       ///< The bytes used.
+    size_t  capacity;   ///< The bytes allocated.
+} byte_buffer;
+
+/**
+ * A client.
+ */
+typedef struct connection {
+    int             fd;         ///< The socket.
+    byte_buffer     in;         ///< Received bytes, not yet handled.
+    byte_buffer     out;        ///< Responses, not yet sent.
+    size_t          sent;       ///< The bytes of out already sent.
+    unsigned        events;     ///< The events registered with epoll.
+    int             eof;        ///< The client doesn't send anymore.
+} connection;
+
+/**
+ * The state of the daemon.
+ */
+typedef struct daemon_state {
+    schema*             schemas;    ///< The loaded schemas.
+    unsigned            n_schemas;  ///< The number of schemas.
+    option_limits       limits;     ///< Limits on the command lines.
+    int                 epoll_fd;   ///< The event loop.
+    int                 listen_fd;  ///< The listening socket.
+    const char**        argv;       ///< Scratch for the items of a request.
+    size_t              argv_capacity;  ///< Capacity of argv.
+    validator_record*   records;    ///< Scratch for the records.
+    size_t              records_capacity;   ///< Capacity of records.
+    unsigned            n_records;  ///< Records of the current response.
+    byte_buffer         text;       ///< Scratch for the text area.
+} daemon_state;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void
+on_signal(int sig)
+{
+    (void) sig;
+    g_stop = 1;
+}
+
+static int
+buffer_reserve(byte_buffer* buf, size_t extra)
+{
+    size_t capacity = buf->capacity ? buf->capacity : 4096;
+    char* data;
+
+    if (buf->size + extra <= buf->capacity)
+        return OPTION_OK;
+    while (capacity < buf->size + extra)
+        capacity *= 2;
+    data = realloc(buf->data, capacity);
+    if (!data)
+        return OPTION_OUT_OF_MEM;
+    buf->data = data;
+    buf->capacity = capacity;
+    return OPTION_OK;
+}
+
+static int
+buffer_append(byte_buffer* buf, const void* data, size_t size)
+{
+    if (size == 0)
+        return OPTION_OK;
+    if (buffer_reserve(buf, size))
+        return OPTION_OUT_OF_MEM;
+    memcpy(buf->data + buf->size, data, size);
+    buf->size += size;
+    return OPTION_OK;
+}
+
+/*
+ * Reads a schema file, see the top of this file for the format.
+ */
+static int
+schema_load(schema* s, const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    long size;
+    char* line;
+    char* save = NULL;
+    unsigned capacity = 0;
+    int ret;
+
+    memset(s, 0, sizeof(schema));
+    if (!file)
+        return OPTION_FILE_ERROR;
+    if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < 0 ||
+        fseek(file, 0, SEEK_SET) != 0) {
+        fclose(file);
+        return OPTION_FILE_ERROR;
+    }
+    s->text = malloc((size_t) size + 1);
+    if (!s->text) {
+        fclose(file);
+        return OPTION_OUT_OF_MEM;
+    }
+    if (fread(s->text, 1, (size_t) size, file) != (size_t) size) {
+        fclose(file);
+        return OPTION_FILE_ERROR;
+    }
+    fclose(file);
+    s->text[size] = '\0';
+
+    for (line = strtok_r(s->text, "\n", &save); line;
+         line = strtok_r(NULL, "\n", &save)) {
+        char* fields[4];
+        char* field;
+        char* field_save = NULL;
+        cmd_option* option;
+        int n = 0;
+
+        for (field = strtok_r(line, " \t\r", &field_save); field && n < 4;
+             field = strtok_r(NULL, " \t\r", &field_save))
+            fields[n++] = field;
+        if (n == 0 || fields[0][0] == '#')
+            continue;
+        if (n != 3 || strlen(fields[0]) != 1)
+            return OPTION_PARSE_ERROR;
+
+        if (s->n_options == capacity) {
+            cmd_option* grown;
+            capacity = capacity ? capacity * 2 : 16;
+            grown = realloc(s->options, capacity * sizeof(cmd_option));
+            if (!grown)
+                return OPTION_OUT_OF_MEM;
+            s->options = grown;
+        }
+        option = &s->options[s->n_options++];
+        memset(option, 0, sizeof(cmd_option));
+        option->short_opt   = fields[0][0] == '-' ? '\0' : fields[0][0];
+        option->long_opt    = fields[1];
+        if (strcmp(fields[2], "string") == 0)
+            option->option_type = OPT_STR;
+        else if (strcmp(fields[2], "int") == 0)
+            option->option_type = OPT_INT;
+        else if (strcmp(fields[2], "float") == 0)
+            option->option_type = OPT_FLOAT;
+        else if (strcmp(fields[2], "flag") == 0)
+            option->option_type = OPT_FLAG;
+        else if (strcmp(fields[2], "file") == 0)
+            option->option_type = OPT_FILE;
+        else
+            return OPTION_PARSE_ERROR;
+    }
+
+    ret = option_registry_create(&s->registry);
+    if (ret)
+        return ret;
+    return option_registry_add(s->registry, NULL, s->options, s->n_options);
+}
+
+static void
+schema_free(schema* s)
+{
+    option_registry_free(s->registry);
+    free(s->options);
+    free(s->text);
+}
+
+/*
+ * Adds a record to the current response, text may be NULL.
+ */
+static int
+add_record(daemon_state* d, const validator_record* record, const char* text)
+{
+    validator_record* r;
+
+    if (d->n_records == d->records_capacity) {
+        size_t capacity = d->records_capacity ? d->records_capacity * 2 : 64;
+        validator_record* grown = realloc(
+                d->records, capacity * sizeof(validator_record)
+                );
+        if (!grown)
+            return OPTION_OUT_OF_MEM;
+        d->records = grown;
+        d->records_capacity = capacity;
+    }
+    r = &d->records[d->n_records++];
+    *r = *record;
+    r->text = (uint32_t) d->text.size;
+    if (!text)
+        text = "";
+    return buffer_append(&d->text, text, strlen(text) + 1);
+}
+
+/*
+ * Adds the diagnostics of a command line to the response.
+ */
+static int
+add_diagnostics(
+        daemon_state*               d,
+        const schema*               s,
+        const char* const*          argv,
+        const option_diagnostics*   diags
+        )
+{
+    char message[512];
+    unsigned i, n = diags->count < diags->capacity ?
+                    diags->count : diags->capacity;
+
+    for (i = 0; i < n; i++) {
+        const option_diagnostic* diag = &diags->records[i];
+        validator_record record = {
+            VALIDATOR_DIAGNOSTIC,
+            diag->error,
+            diag->option_index,
+            diag->argv_index,
+            diag->byte_offset,
+            0
+        };
+        option_diagnostic_format(
+                diag, argv, s->options, message, sizeof(message)
+                );
+        if (add_record(d, &record, message))
+            return OPTION_OUT_OF_MEM;
+    }
+    return OPTION_OK;
+}
+
+/*
+ * Parses a command line, when it is valid its options and arguments are
+ * added to the response.
+ */
+static int
+add_parsed(
+        daemon_state*                   d,
+        const schema*                   s,
+        int                             argc,
+        const char* const*              argv,
+        const option_parse_settings*    settings
+        )
+{
+    option_context* options = NULL;
+    const cmd_option* predef;
+    char value[64];
+    int i, n, ret;
+
+    ret = options_parse_registry_ex(
+            &options, argc, argv, s->registry, settings
+            );
+    if (ret)
+        return ret;
+
+    predef = option_context_get_predef_options(options);
+    n = option_context_num_predef_options(options);
+    for (i = 0; i < n && ret == OPTION_OK; i++) {
+        validator_record record = {VALIDATOR_OPTION, 0, i, -1, 0, 0};
+        const char* text = value;
+
+        if (!option_context_have_option(options, predef[i].long_opt))
+            continue;
+        switch (predef[i].option_type) {
+            case OPT_INT:
+            case OPT_FLAG:
+                snprintf(value, sizeof(value), "%d",
+                         predef[i].value.integer_value);
+                break;
+            case OPT_FLOAT:
+                snprintf(value, sizeof(value), "%.17g",
+                         predef[i].value.floating_value);
+                break;
+            default:
+                text = predef[i].value.string_value;
+        }
+        ret = add_record(d, &record, text);
+    }
+    n = option_context_nargs(options);
+    for (i = 0; i < n && ret == OPTION_OK; i++) {
+        validator_record record = {VALIDATOR_ARGUMENT, 0, -1, -1, 0, 0};
+        ret = add_record(d, &record, option_context_get_argument(options, i));
+    }
+    option_context_free(options);
+    return ret;
+}
+
+/*
+ * Answers one request, the response is appended to the output of c.
+ */
+static int
+handle_request(
+        daemon_state*                   d,
+        connection*                     c,
+        const validator_request_header* request,
+        char*                           payload
+        )
+{
+    validator_response_header response;
+    option_diagnostic records[MAX_DIAGNOSTICS];
+    option_diagnostics diags = {records, MAX_DIAGNOSTICS, 0};
+    option_parse_settings settings;
+    const schema* s = NULL;
+    int status = OPTION_OK;
+    uint32_t i, offset = 0;
+
+    d->n_records = 0;
+    d->text.size = 0;
+
+    if (request->schema >= d->n_schemas || request->argc == 0 ||
+        (request->operation != VALIDATOR_VALIDATE &&
+         request->operation != VALIDATOR_PARSE))
+        status = OPTION_INVALID_ARGUMENT;
+    else if (request->argc > request->length)
+        status = OPTION_PARSE_ERROR;    // every item takes at least a byte
+
+    if (status == OPTION_OK && request->argc > d->argv_capacity) {
+        const char** grown = realloc(
+                (void*) d->argv, request->argc * sizeof(const char*)
+                );
+        if (!grown)
+            return OPTION_OUT_OF_MEM;
+        d->argv = grown;
+        d->argv_capacity = request->argc;
+    }
+    // Point the items into the payload, they must fill it exactly.
+    for (i = 0; status == OPTION_OK && i < request->argc; i++) {
+        char* end = memchr(payload + offset, '\0', request->length - offset);
+        if (!end) {
+            status = OPTION_PARSE_ERROR;
+            break;
+        }
+        d->argv[i] = payload + offset;
+        offset = (uint32_t) (end - payload) + 1;
+    }
+    if (status == OPTION_OK && offset != request->length)
+        status = OPTION_PARSE_ERROR;
+
+    if (status == OPTION_OK) {
+        s = &d->schemas[request->schema];
+        memset(&settings, 0, sizeof(settings));
+        settings.flags          = OPTION_FLAG_SILENT;
+        settings.diagnostics    = &diags;
+        settings.limits         = d->limits;
+        // A valid command line is scanned once. The parser stops at the
+        // first problem, so an invalid one is validated for all of them.
+        if (request->operation == VALIDATOR_PARSE)
+            status = add_parsed(
+                    d, s, (int) request->argc, d->argv, &settings
+                    );
+        if (request->operation == VALIDATOR_VALIDATE ||
+            (status != OPTION_OK && status != OPTION_OUT_OF_MEM)) {
+            int validated = options_validate_registry(
+                    (int) request->argc, d->argv, s->registry, &settings
+                    );
+            if (validated != OPTION_OK || status == OPTION_OK)
+                status = validated;
+        }
+        if (status != OPTION_OK && status != OPTION_INVALID_ARGUMENT &&
+            status != OPTION_OUT_OF_MEM) {
+            if (add_diagnostics(d, s, d->argv, &diags))
+                status = OPTION_OUT_OF_MEM;
+        }
+    }
+
+    response.id     = request->id;
+    response.status = status;
+    response.count  = d->n_records;
+    response.length = (uint32_t) (
+            d->n_records * sizeof(validator_record) + d->text.size
+            );
+    if (buffer_append(&c->out, &response, sizeof(response)) ||
+        buffer_append(&c->out, d->records,
+                      d->n_records * sizeof(validator_record)) ||
+        buffer_append(&c->out, d->text.data, d->text.size))
+        return OPTION_OUT_OF_MEM;
+    return OPTION_OK;
+}
+
+/*
+ * Answers the complete requests in the input of c.
+ *
+ * \returns OPTION_OK or an error after which the connection is closed.
+ */
+static int
+handle_input(daemon_state* d, connection* c)
+{
+    size_t done = 0;
+    int ret = OPTION_OK;
+
+    while (c->out.size - c->sent < OUTPUT_HIGH_WATER) {
+        validator_request_header request;
+        size_t available = c->in.size - done;
+
+        if (available < sizeof(request))
+            break;
+        memcpy(&request, c->in.data + done, sizeof(request));
+        if (request.length > VALIDATOR_MAX_FRAME) {
+            ret = OPTION_LIMIT_EXCEEDED;
+            break;
+        }
+        if (available < sizeof(request) + request.length)
+            break;
+        ret = handle_request(
+                d, c, &request, c->in.data + done + sizeof(request)
+                );
+        if (ret)
+            break;
+        done += sizeof(request) + request.length;
+    }
+    memmove(c->in.data, c->in.data + done, c->in.size - done);
+    c->in.size -= done;
+    return ret;
+}
+
+/*
+ * Whether a complete request waits in the input.
+ */
+static int
+has_request(const connection* c)
+{
+    validator_request_header request;
+    if (c->in.size < sizeof(request))
+        return 0;
+    memcpy(&request, c->in.data, sizeof(request));
+    return request.length > VALIDATOR_MAX_FRAME ||
+           c->in.size >= sizeof(request) + request.length;
+}
+
+/*
+ * Sends as much of the output as the socket takes.
+ */
+static int
+flush_output(connection* c)
+{
+    while (c->sent < c->out.size) {
+        ssize_t n = send(c->fd, c->out.data + c->sent, c->out.size - c->sent,
+                         MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return OPTION_OK;
+        if (n < 0)
+            return OPTION_FILE_ERROR;
+        c->sent += (size_t) n;
+    }
+    c->out.size = 0;
+    c->sent = 0;
+    return OPTION_OK;
+}
+
+/*
+ * Reads what is available, handles it and registers the events that are
+ * of interest now.
+ *
+ * \returns OPTION_OK or an error after which the connection is closed.
+ */
+static int
+serve(daemon_state* d, connection* c, unsigned events)
+{
+    struct epoll_event ev;
+    unsigned wanted;
+    int ret;
+
+    if (events & EPOLLIN) {
+        for (;;) {
+            ssize_t n;
+            if (buffer_reserve(&c->in, 65536))
+                return OPTION_OUT_OF_MEM;
+            n = recv(c->fd, c->in.data + c->in.size,
+                     c->in.capacity - c->in.size, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            if (n <= 0) {
+                c->eof = 1;
+                break;
+            }
+            c->in.size += (size_t) n;
+            if (c->in.size >= 2 * VALIDATOR_MAX_FRAME)
+                break;
+        }
+    }
+
+    // Requests held back by the high water mark are handled once the
+    // responses before them are sent.
+    do {
+        ret = handle_input(d, c);
+        if (ret)
+            return ret;
+        ret = flush_output(c);
+        if (ret)
+            return ret;
+    } while (c->out.size == 0 && has_request(c));
+
+    // Read when there is room for more responses, write when they wait.
+    wanted = 0;
+    if (!c->eof && c->out.size - c->sent < OUTPUT_HIGH_WATER &&
+        c->in.size < 2 * VALIDATOR_MAX_FRAME)
+        wanted |= EPOLLIN;
+    if (c->sent < c->out.size)
+        wanted |= EPOLLOUT;
+    if (wanted != c->events) {
+        ev.events = wanted;
+        ev.data.ptr = c;
+        if (epoll_ctl(d->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev) != 0)
+            return OPTION_FILE_ERROR;
+        c->events = wanted;
+    }
+    // Nothing left to do: the client is done and has all responses.
+    if (!wanted)
+        return OPTION_FILE_ERROR;
+    return OPTION_OK;
+}
+
+static void
+connection_close(connection* c)
+{
+    close(c->fd);
+    free(c->in.data);
+    free(c->out.data);
+    free(c);
+}
+
+static void
+accept_connections(daemon_state* d)
+{
+    for (;;) {
+        struct epoll_event ev;
+        connection* c;
+        int fd = accept4(d->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;     // EAGAIN, or a client that went away already
+        c = calloc(1, sizeof(connection));
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->events = EPOLLIN;
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        if (epoll_ctl(d->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0)
+            connection_close(c);
+    }
+}
+
+static int
+listen_on(const char* path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static cmd_option daemon_options[] = {
+    {'s', "socket",             OPT_STR},
+    {'h', "help",               OPT_FLAG},
+    {'\0',"max-argc",           OPT_INT},
+    {'\0',"max-token-length",   OPT_INT}
+};
+
+int main(int argc, char** argv)
+{
+    option_context* options = NULL;
+    daemon_state d;
+    struct epoll_event ev;
+    const char* socket_path = NULL;
+    int i, value, ret;
+
+    memset(&d, 0, sizeof(d));
+    ret = options_parse(
+            &options, argc, (const char* const*) argv, daemon_options,
+            sizeof(daemon_options) / sizeof(daemon_options[0])
+            );
+    if (ret)
+        return EXIT_FAILURE;
+    option_context_set_description(
+            options,
+            "Validates and parses command lines for clients on a UNIX "
+            "domain socket. The arguments are the schema files, a request "
+            "selects a schema by its position."
+            );
+    if (option_context_have_option(options, "help") ||
+        option_context_nargs(options) == 0 ||
+        option_context_str_value(options, "socket", &socket_path)) {
+        char* help = NULL;
+        int asked = option_context_have_option(options, "help");
+        if (option_context_help(options, &help) == OPTION_OK)
+            fprintf(asked ? stdout : stderr, "%s", help);
+        free(help);
+        option_context_free(options);
+        return asked ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (option_context_int_value(options, "max-argc", &value) == OPTION_OK)
+        d.limits.max_argc = (unsigned) value;
+    if (option_context_int_value(options, "max-token-length", &value) ==
+            OPTION_OK)
+        d.limits.max_token_length = (size_t) value;
+
+    d.n_schemas = (unsigned) option_context_nargs(options);
+    d.schemas = calloc(d.n_schemas, sizeof(schema));
+    if (!d.schemas)
+        return EXIT_FAILURE;
+    for (i = 0; i < (int) d.n_schemas; i++) {
+        const char* path = option_context_get_argument(options, i);
+        ret = schema_load(&d.schemas[i], path);
+        if (ret) {
+            fprintf(stderr, "unable to load schema %s: error %d\n", path, ret);
+            return EXIT_FAILURE;
+        }
+    }
+
+    d.listen_fd = listen_on(socket_path);
+    d.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (d.listen_fd < 0 || d.epoll_fd < 0)
+        return EXIT_FAILURE;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(d.epoll_fd, EPOLL_CTL_ADD, d.listen_fd, &ev);
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    while (!g_stop) {
+        struct epoll_event events[64];
+        int n = epoll_wait(d.epoll_fd, events, 64, -1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            perror("epoll_wait");
+            break;
+        }
+        for (i = 0; i < n; i++) {
+            connection* c = events[i].data.ptr;
+            unsigned what = events[i].events;
+            if (!c) {
+                accept_connections(&d);
+                continue;
+            }
+            if (what & (EPOLLHUP | EPOLLERR))
+                what |= EPOLLIN;    // recv tells what happened
+            if (serve(&d, c, what) != OPTION_OK)
+                connection_close(c);
+        }
+    }
+
+    unlink(socket_path);
+    close(d.listen_fd);
+    close(d.epoll_fd);
+    for (i = 0; i < (int) d.n_schemas; i++)
+        schema_free(&d.schemas[i]);
+    free(d.schemas);
+    free((void*) d.argv);
+    free(d.records);
+    free(d.text.data);
+    option_context_free(options);
+    return EXIT_SUCCESS;
+}